@@ -7,7 +7,29 @@ include $(CLEAR_VARS)
 LOCAL_CFLAGS += -DANDROID_BUILD
 LOCAL_CFLAGS += -Wall
 
-LOCAL_SRC_FILES += host/main.c
+LOCAL_SRC_FILES += host/main.c \
+		host/session_pool.c \
+		host/bench.c \
+		host/batch.c \
+		host/sensor_ring.c \
+		host/control_sched.c \
+		host/events.c \
+		host/mpsc_queue.c \
+		host/tank_daemon.c \
+		host/loadgen.c \
+		host/trace_replay.c \
+		host/async_invoke.c \
+		host/dedup_cache.c \
+		host/tank_control.c \
+		host/plant_model.c \
+		host/plant_sim.c \
+		host/sensor_auth.c \
+		host/sha256.c \
+		host/channels.c \
+		host/host_log.c \
+		host/phase_trace.c \
+		host/metrics.c \
+		host/ingest.c
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include \
 		$(OPTEE_CLIENT_EXPORT)/include \
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Per call cost of the channel descriptor model in ta/channels.c as the
+ * plant grows: synthetic channel tables of 4 up to WT_SENSORS_MAX
+ * sensors and actuators, each actuator with WT_ACT_TERMS conditions on
+ * random sensors, and calls that bring just the readings those need.
+ * Every verdict is checked against a plain scan of the terms.
+ *
+ * Usage: wt_channels_bench [calls]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <water_treatment_ta.h>
+
+#include "channels.h"
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void build_map(struct channel_map *m, struct pump_range *limits,
+		      struct channel_actuator *acts, uint32_t channels)
+{
+	struct channel_term *t;
+	uint32_t i, k;
+
+	for (i = 0; i < channels; i++)
+		limits[i] = (struct pump_range)PUMP_RANGE(0, 1000);
+
+	for (i = 0; i < channels; i++) {
+		for (k = 0; k < WT_ACT_TERMS; k++) {
+			t = &acts[i].on[k];
+			t->sensor = rand() % channels;
+			t->range = (struct pump_range)PUMP_RANGE(100, 900);
+			acts[i].off[k] = *t;
+		}
+		acts[i].on_terms = WT_ACT_TERMS;
+		acts[i].off_terms = WT_ACT_TERMS;
+	}
+
+	m->limits = limits;
+	m->sensor_count = channels;
+	m->actuators = acts;
+	m->actuator_count = channels;
+}
+
+/* What channel_check() should say, when every reading it needs is there */
+static uint32_t expected(const struct channel_actuator *a,
+			 const struct wt_reading *in, uint32_t n)
+{
+	uint32_t i, k;
+
+	for (k = 0; k < a->on_terms; k++)
+		for (i = n; i--; )
+			if (in[i].sensor == a->on[k].sensor) {
+				if (in[i].value < 100 || in[i].value > 900)
+					return WT_REJECT_ARGS_OOB;
+				break;
+			}
+	return WT_REJECT_NONE;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct pump_range limits[WT_SENSORS_MAX];
+	static struct channel_actuator acts[WT_ACTUATORS_MAX];
+	static struct channel_readings r;
+	size_t calls = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+	struct wt_reading (*in)[WT_ACT_TERMS];
+	uint32_t *act;
+	uint32_t channels;
+	struct channel_map m;
+	uint32_t verdict;
+	size_t mismatches = 0;
+	size_t i;
+	uint64_t t0, t;
+	int k;
+
+	in = calloc(calls, sizeof(*in));
+	act = calloc(calls, sizeof(*act));
+	if (!in || !act)
+		err(1, "calloc");
+
+	srand(1);
+	printf("%zu calls per table, %d readings each\n", calls, WT_ACT_TERMS);
+	for (channels = 4; channels <= WT_SENSORS_MAX; channels *= 2) {
+		build_map(&m, limits, acts, channels);
+
+		for (i = 0; i < calls; i++) {
+			act[i] = rand() % channels;
+			for (k = 0; k < WT_ACT_TERMS; k++) {
+				in[i][k].sensor = acts[act[i]].on[k].sensor;
+				in[i][k].value = rand() % 1000;
+			}
+		}
+
+		t0 = now_ns();
+		for (i = 0; i < calls; i++) {
+			verdict = channel_load(&m, &r, in[i], WT_ACT_TERMS);
+			if (verdict == WT_REJECT_NONE)
+				verdict = channel_check(&m, &r, act[i], 1);
+			/* Keep the compiler from dropping the calls */
+			mismatches += verdict > WT_REJECT_MISSING;
+		}
+		t = now_ns() - t0;
+
+		for (i = 0; i < calls; i++) {
+			channel_load(&m, &r, in[i], WT_ACT_TERMS);
+			verdict = channel_check(&m, &r, act[i], 1);
+			if (verdict != expected(&acts[act[i]], in[i],
+						WT_ACT_TERMS))
+				mismatches++;
+		}
+
+		printf("%4u sensors, %4u actuators: %.2fns/call\n", channels,
+		       channels, t / (double)calls);
+	}
+	printf("%zu mismatching verdicts\n", mismatches);
+
+	free(act);
+	free(in);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Simulated plant comparison of the two ways the TA can dose: the pump
+ * rules toggling each valve between off and flow 1, and the PI dosing
+ * loop in ta/ph_dosing.c setting 0-10 flows. The plant is a mixing tank
+ * fed with off-spec water, its pH pulled towards the feed's and pushed
+ * up or down linearly by the dosing flows, one tick per second. Either
+ * way the host makes the same number of invokes, one CONTROL or DOSE per
+ * tick. What differs is where the pH ends up and how many commands the
+ * valves get: every setpoint the TA changes is one to a valve.
+ *
+ * Usage: wt_dosing_bench [ticks]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <water_treatment_ta.h>
+
+#include "ph_dosing.h"
+#include "pump_rules.h"
+
+/* Fraction of the tank replaced by feed per tick */
+#define PLANT_FEED_RATE		0.01
+/* pH change per tick per unit of dosing flow */
+#define PLANT_DOSE_GAIN		0.05
+/* Settled means within this of neutral from then on */
+#define SETTLE_BAND		0.5
+
+struct scenario {
+	const char *name;
+	double ph0;		/* tank pH at the start */
+	double feed_ph;		/* feed pH, for the first half */
+	double feed_ph2;	/* and after a step in the second half */
+};
+
+static const struct scenario scenarios[] = {
+	{ "acidic feed", 4.0, 5.0, 5.0 },
+	{ "alkaline feed", 10.0, 9.0, 9.0 },
+	{ "feed step 5 -> 6", 7.0, 5.0, 6.0 },
+};
+
+struct result {
+	long settle_tick;	/* -1 if it never settled */
+	unsigned long invokes;	/* CONTROL or DOSE, one per tick */
+	unsigned long commands;	/* valve setpoint changes */
+	double in_band;		/* fraction of ticks within the band */
+	double iae;		/* integral of |pH - 7| */
+};
+
+static double plant_step(double ph, double feed_ph, uint32_t sod_hydrox,
+			 uint32_t acid)
+{
+	ph += (feed_ph - ph) * PLANT_FEED_RATE;
+	ph += PLANT_DOSE_GAIN * ((double)sod_hydrox - (double)acid);
+	return ph < 0 ? 0 : ph > 14 ? 14 : ph;
+}
+
+/*
+ * What a host running the pump commands every tick ends up with. The
+ * rules only open a valve at pH 4 or below, or 10 and above, and close it
+ * again at 6 or 8, so the tank is left to drift to the feed's pH. None of
+ * the feeds here is that far out, so the baseline settles never: it makes
+ * few commands because it gives up on the tank, not because it holds it.
+ */
+static void toggle_step(double ph, uint32_t *sod_hydrox, uint32_t *acid)
+{
+	uint32_t in[PUMP_INPUTS] = {
+		[PUMP_IN_TEMP] = 70,
+		[PUMP_IN_PH] = (uint32_t)lround(ph),
+		[PUMP_IN_ACID_FLOW] = *acid,
+		[PUMP_IN_SOD_HYDROX_FLOW] = *sod_hydrox,
+	};
+	uint32_t mask = pump_in_bounds(in) ? pump_rules_eval(in) : 0;
+	size_t r;
+
+	for (r = 0; r < pump_rule_count; r++) {
+		if (!(mask & (1u << pump_rules[r].cmd)))
+			continue;
+		if (pump_rules[r].valve == PUMP_VALVE_SOD_HYDROX)
+			*sod_hydrox = pump_rules[r].state;
+		else
+			*acid = pump_rules[r].state;
+	}
+}
+
+static void run(const struct scenario *sc, long ticks, int pi,
+		struct result *res)
+{
+	struct ph_dosing dose = { 0 };
+	uint32_t sod_hydrox = 0, acid = 0;
+	uint32_t prev_sh, prev_acid;
+	double ph = sc->ph0;
+	unsigned long in_band = 0;
+	long t;
+
+	res->settle_tick = 0;
+	res->invokes = 0;
+	res->commands = 0;
+	res->iae = 0;
+
+	for (t = 0; t < ticks; t++) {
+		prev_sh = sod_hydrox;
+		prev_acid = acid;
+		if (pi)
+			ph_dosing_step(&dose, lround(ph * 1000), &sod_hydrox,
+				       &acid);
+		else
+			toggle_step(ph, &sod_hydrox, &acid);
+		res->invokes++;
+		res->commands += (sod_hydrox != prev_sh) + (acid != prev_acid);
+
+		ph = plant_step(ph, t < ticks / 2 ? sc->feed_ph : sc->feed_ph2,
+				sod_hydrox, acid);
+
+		res->iae += fabs(ph - 7);
+		if (fabs(ph - 7) <= SETTLE_BAND) {
+			in_band++;
+		} else {
+			res->settle_tick = t + 1;
+		}
+	}
+
+	if (res->settle_tick >= ticks)
+		res->settle_tick = -1;
+	res->in_band = in_band / (double)ticks;
+}
+
+static void print_result(const char *label, const struct result *r)
+{
+	char settle[32];
+
+	if (r->settle_tick < 0)
+		snprintf(settle, sizeof(settle), "never");
+	else
+		snprintf(settle, sizeof(settle), "%lds", r->settle_tick);
+
+	printf("  %-8s settled %-7s %6lu invokes, %5lu valve commands, "
+	       "%5.1f%% in band, IAE %.0f\n", label, settle, r->invokes,
+	       r->commands, r->in_band * 100, r->iae);
+}
+
+int main(int argc, char *argv[])
+{
+	long ticks = argc > 1 ? strtol(argv[1], NULL, 0) : 7200;
+	struct result toggle, pi;
+	size_t s;
+	int worse = 0;
+
+	printf("%ld ticks of 1s, settled = within %.1f pH of 7 for good\n",
+	       ticks, SETTLE_BAND);
+
+	for (s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+		run(&scenarios[s], ticks, 0, &toggle);
+		run(&scenarios[s], ticks, 1, &pi);
+
+		printf("%s, starting at pH %.1f\n", scenarios[s].name,
+		       scenarios[s].ph0);
+		print_result("toggle", &toggle);
+		print_result("PI", &pi);
+
+		worse |= pi.settle_tick < 0 || pi.iae > toggle.iae;
+	}
+
+	return worse;
+}
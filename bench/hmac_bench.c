@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * HMAC-SHA256 of host/sha256.c, which signs sensor batches on the REE
+ * side and backs the stand-in's TEE MAC operations. Checks it against the
+ * RFC 4231 test vectors first, every message fed both whole and a byte at
+ * a time, and fails if any differs. Then times the MAC of an
+ * AUTH_BATCH of 0 to 1024 samples, with the key schedule done once the
+ * way both users keep it.
+ *
+ * Usage: wt_hmac_bench [megabytes]
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <water_treatment_ta.h>
+
+#include "sha256.h"
+
+struct vector {
+	const char *key;	/* hex */
+	const char *data;	/* hex, or text when not starting with 0x */
+	const char *mac;	/* hex, test case 5 only has 16 bytes */
+};
+
+/* RFC 4231 section 4, test cases 1 to 7 */
+static const struct vector vectors[] = {
+	{ "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
+	  "Hi There",
+	  "b0344c61d8db38535ca8afceaf0bf12b"
+	  "881dc200c9833da726e9376c2e32cff7" },
+	{ "4a656665",
+	  "what do ya want for nothing?",
+	  "5bdcc146bf60754e6a042426089575c7"
+	  "5a003f089d2739839dec58b964ec3843" },
+	{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+	  "0xdddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd"
+	  "dddddddddddddddddddddddddddddddddddd",
+	  "773ea91e36800e46854db8ebd09181a7"
+	  "2959098b3ef8c122d9635514ced565fe" },
+	{ "0102030405060708090a0b0c0d0e0f10111213141516171819",
+	  "0xcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd"
+	  "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd",
+	  "82558a389a443c0ea4cc819899f2083a"
+	  "85f0faa3e578f8077a2e3ff46729665b" },
+	{ "0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c",
+	  "Test With Truncation",
+	  "a3b6167473100ee06e0c796c2955552b" },
+	{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaa",
+	  "Test Using Larger Than Block-Size Key - Hash Key First",
+	  "60e431591ee0b67f0d8a26aacbf5b77f"
+	  "8e0bc6213728c5140546040f0ee37f54" },
+	{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+	  "aaaaaa",
+	  "This is a test using a larger than block-size key and a larger "
+	  "than block-size data. The key needs to be hashed before being "
+	  "used by the HMAC algorithm.",
+	  "9b09ffa71b942fcb27635fbcd5b0e944"
+	  "bfdc63644f0713938a7f51535c3a35e2" },
+};
+
+static size_t unhex(const char *hex, uint8_t *out)
+{
+	size_t n = 0;
+	unsigned int b;
+
+	for (; hex[0] && hex[1]; hex += 2) {
+		sscanf(hex, "%2x", &b);
+		out[n++] = b;
+	}
+	return n;
+}
+
+static size_t message(const char *s, uint8_t *out)
+{
+	if (!strncmp(s, "0x", 2))
+		return unhex(s + 2, out);
+	memcpy(out, s, strlen(s));
+	return strlen(s);
+}
+
+static int check_vectors(void)
+{
+	uint8_t key[256], data[256], expected[SHA256_DIGEST];
+	uint8_t mac[SHA256_DIGEST], piecewise[SHA256_DIGEST];
+	struct hmac_sha256 k;
+	struct sha256 s;
+	size_t key_len, len, mac_len, i, v;
+	int bad = 0;
+
+	for (v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+		key_len = unhex(vectors[v].key, key);
+		len = message(vectors[v].data, data);
+		mac_len = unhex(vectors[v].mac, expected);
+
+		hmac_sha256_key(&k, key, key_len);
+		hmac_sha256(&k, data, len, mac);
+
+		s = k.inner;
+		for (i = 0; i < len; i++)
+			sha256_update(&s, data + i, 1);
+		hmac_sha256_final(&k, &s, piecewise);
+
+		if (memcmp(mac, expected, mac_len) ||
+		    memcmp(piecewise, expected, mac_len)) {
+			printf("RFC 4231 test case %zu: MAC differs\n", v + 1);
+			bad = 1;
+		}
+	}
+
+	printf("RFC 4231 test cases 1-%zu: %s\n", v, bad ? "FAILED" : "ok");
+	return bad;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t samples[] = { 0, 16, 256, WT_AUTH_MAX_SAMPLES };
+	size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+	uint8_t mac[SHA256_DIGEST];
+	struct hmac_sha256 k;
+	uint64_t t0, ns;
+	unsigned long n, macs;
+	uint8_t *buf;
+	size_t len;
+	size_t i;
+
+	if (check_vectors())
+		return 1;
+
+	buf = calloc(1, WT_AUTH_BATCH_BYTES(WT_AUTH_MAX_SAMPLES));
+	if (!buf)
+		return 1;
+	hmac_sha256_key(&k, WT_AUTH_DEMO_KEY, WT_AUTH_DEMO_KEY_SIZE);
+
+	for (i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+		/* What the MAC covers: the header up to it, then the samples */
+		len = offsetof(struct wt_auth_batch, mac) +
+		      samples[i] * sizeof(struct wt_sample);
+		macs = megabytes * 1000000 / len;
+		t0 = now_ns();
+		for (n = 0; n < macs; n++) {
+			buf[0] = n;
+			hmac_sha256(&k, buf, len, mac);
+		}
+		ns = now_ns() - t0;
+		printf("%4zu samples, %5zu bytes: %9.0f MACs/s, %6.1f MB/s, "
+		       "%6.0f ns each\n", samples[i], len, macs / (ns / 1e9),
+		       macs * len / (ns / 1e3), (double)ns / macs);
+	}
+
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Readings per second through the epoll ingestion front end in
+ * host/ingest.c, and per second of the ingest thread's own CPU time,
+ * which is all one core can do since it is a single thread. Half the
+ * producers connect to a Unix socket, the other half each write to a
+ * FIFO of their own; every frame is checked on arrival. Gateways that
+ * batch are compared against sensors writing one frame at a time.
+ *
+ * Usage: wt_ingest_bench [readings] [producers]
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ingest.h"
+
+#define BENCH_TANKS		16
+#define BENCH_MAX_PRODUCERS	64
+
+struct producer {
+	pthread_t thread;
+	const char *path;
+	int fifo;
+	size_t count;
+	size_t per_write;
+	uint32_t first;
+};
+
+struct sink {
+	unsigned long readings;
+	unsigned long bad;
+};
+
+static uint64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Every field follows from the timestamp, so damage shows */
+static void fill(struct ingest_frame *f, uint32_t i, uint16_t seq)
+{
+	f->magic = INGEST_MAGIC;
+	f->tank = i % BENCH_TANKS;
+	f->temp = 60 + i % 20;
+	f->ph = i % 15;
+	f->acid_flow = i & 1;
+	f->sod_hydrox_flow = (i >> 1) & 1;
+	f->seq = seq;
+	f->timestamp = i;
+}
+
+static int route(void *arg, uint32_t tank, const struct tank_reading *r)
+{
+	struct sink *s = arg;
+	uint32_t i = r->sample.timestamp;
+
+	if (tank != i % BENCH_TANKS ||
+	    r->sample.temp != 60 + (int32_t)(i % 20) ||
+	    r->sample.ph != (int32_t)(i % 15))
+		s->bad++;
+	/* Polled by the main thread */
+	__atomic_store_n(&s->readings, s->readings + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static int connect_to(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void *producer_run(void *arg)
+{
+	struct ingest_frame frames[256];
+	struct producer *p = arg;
+	uint16_t seq = 0;
+	size_t done = 0;
+	size_t n;
+	size_t k;
+	ssize_t w;
+	size_t off;
+	int fd;
+
+	fd = p->fifo ? open(p->path, O_WRONLY) : connect_to(p->path);
+	if (fd < 0)
+		err(1, "%s", p->path);
+
+	while (done < p->count) {
+		n = p->count - done < p->per_write ? p->count - done :
+						     p->per_write;
+		for (k = 0; k < n; k++)
+			fill(&frames[k], p->first + done + k, seq++);
+		for (off = 0; off < n * sizeof(frames[0]); off += w) {
+			w = write(fd, (char *)frames + off,
+				  n * sizeof(frames[0]) - off);
+			if (w < 0)
+				err(1, "write %s", p->path);
+		}
+		done += n;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void run(size_t readings, size_t producers, size_t per_write)
+{
+	struct producer prod[BENCH_MAX_PRODUCERS];
+	char fifo_paths[BENCH_MAX_PRODUCERS][64];
+	char sock_path[64];
+	struct sink sink = { 0 };
+	struct ingest in;
+	clockid_t cpu_clock;
+	uint64_t t0, cpu0;
+	uint64_t wall, cpu;
+	size_t per = readings / producers;
+	size_t i;
+
+	snprintf(sock_path, sizeof(sock_path), "/tmp/wt_ingest_bench.%d.sock",
+		 (int)getpid());
+	if (ingest_init(&in, route, &sink, 0))
+		err(1, "ingest_init");
+	if (ingest_listen(&in, sock_path))
+		err(1, "%s", sock_path);
+	for (i = 1; i < producers; i += 2) {
+		snprintf(fifo_paths[i], sizeof(fifo_paths[i]),
+			 "/tmp/wt_ingest_bench.%d.fifo%zu", (int)getpid(), i);
+		if (ingest_add_fifo(&in, fifo_paths[i]))
+			err(1, "%s", fifo_paths[i]);
+	}
+	if (ingest_start(&in))
+		errx(1, "Failed to start the ingest thread");
+	if (pthread_getcpuclockid(in.thread, &cpu_clock))
+		errx(1, "No CPU clock for the ingest thread");
+
+	t0 = now_ns(CLOCK_MONOTONIC);
+	cpu0 = now_ns(cpu_clock);
+	for (i = 0; i < producers; i++) {
+		prod[i].fifo = i & 1;
+		prod[i].path = prod[i].fifo ? fifo_paths[i] : sock_path;
+		prod[i].first = i * per;
+		prod[i].count = i == producers - 1 ? readings - i * per : per;
+		prod[i].per_write = per_write;
+		if (pthread_create(&prod[i].thread, NULL, producer_run,
+				   &prod[i]))
+			err(1, "pthread_create");
+	}
+	for (i = 0; i < producers; i++)
+		pthread_join(prod[i].thread, NULL);
+
+	/* Written is not yet read */
+	while (__atomic_load_n(&sink.readings, __ATOMIC_RELAXED) < readings &&
+	       now_ns(CLOCK_MONOTONIC) - t0 < 60000000000ULL)
+		usleep(100);
+	wall = now_ns(CLOCK_MONOTONIC) - t0;
+	cpu = now_ns(cpu_clock) - cpu0;
+	ingest_stop(&in);
+
+	printf("%3zu frames per write: %8.0f readings/s, %8.0f per ingest "
+	       "CPU second (%.0f%% of a core), %.1f per read, "
+	       "%lu lost, %lu bad\n", per_write, sink.readings / (wall / 1e9),
+	       sink.readings / (cpu / 1e9), 100.0 * cpu / wall,
+	       in.stats.reads ? (double)in.stats.frames / in.stats.reads : 0,
+	       in.stats.lost, sink.bad);
+	if (sink.readings != readings)
+		printf("    only %lu of %zu readings arrived\n", sink.readings,
+		       readings);
+
+	ingest_destroy(&in);
+	for (i = 1; i < producers; i += 2)
+		unlink(fifo_paths[i]);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t readings = argc > 1 ? strtoul(argv[1], NULL, 0) : 4000000;
+	size_t producers = argc > 2 ? strtoul(argv[2], NULL, 0) : 4;
+
+	if (!readings || !producers || producers > BENCH_MAX_PRODUCERS)
+		errx(1, "Usage: %s [readings] [producers, up to %d]", argv[0],
+		     BENCH_MAX_PRODUCERS);
+
+	printf("%zu readings of %zu bytes from %zu producers, %zu on a "
+	       "socket and %zu on FIFOs\n", readings,
+	       sizeof(struct ingest_frame), producers, (producers + 1) / 2,
+	       producers / 2);
+	run(readings, producers, 64);
+	run(readings, producers, 1);
+	return 0;
+}
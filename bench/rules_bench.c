@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmark of the TA's pump rule evaluation: the hand-coded if
+ * chains the four command handlers used to carry, against the table
+ * driven kernel in ta/pump_rules.c. Both run over the same random
+ * readings and must agree on every verdict.
+ *
+ * Usage: wt_rules_bench [samples] [rounds]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <water_treatment_ta.h>
+
+#include "pump_rules.h"
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The checks as the handlers wrote them before the rule table */
+static int verify_safe_bounds(int temp, int ph, int acid_flow, int sh_flow)
+{
+	if (temp >= -40 && temp <= 160 && ph >= 0 && ph <= 14 &&
+	    acid_flow >= 0 && acid_flow <= 10 &&
+	    sh_flow >= 0 && sh_flow <= 10)
+		return 1;
+	return 0;
+}
+
+static uint32_t legacy_eval(const uint32_t in[PUMP_INPUTS], uint32_t *bounds)
+{
+	uint32_t t = in[0], ph = in[1], acid = in[2], sh = in[3];
+	uint32_t mask = 0;
+
+	*bounds = verify_safe_bounds(t, ph, acid, sh);
+	if (!*bounds)
+		return 0;
+
+	if (t > 40 && ph < 5 && acid == 0 && sh == 0)
+		mask |= 1u << TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON;
+	if (ph >= 6 && sh > 0)
+		mask |= 1u << TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF;
+	if (t < 90 && ph > 9 && acid == 0 && sh == 0)
+		mask |= 1u << TA_WATER_TREATMENT_CMD_ACID_ON;
+	if (ph <= 8 && acid > 0)
+		mask |= 1u << TA_WATER_TREATMENT_CMD_ACID_OFF;
+	return mask;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1 << 16;
+	size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 0) : 100;
+	uint32_t (*in)[PUMP_INPUTS];
+	uint32_t *bounds, *masks, *ref_bounds, *ref_masks;
+	uint64_t t_legacy = 0, t_table = 0, t0;
+	size_t mismatches = 0;
+	size_t r, i;
+
+	in = calloc(n, sizeof(*in));
+	bounds = calloc(n, sizeof(*bounds));
+	masks = calloc(n, sizeof(*masks));
+	ref_bounds = calloc(n, sizeof(*ref_bounds));
+	ref_masks = calloc(n, sizeof(*ref_masks));
+	if (!in || !bounds || !masks || !ref_bounds || !ref_masks)
+		err(1, "calloc");
+
+	/* Mostly in range, with some readings past the device limits */
+	srand(1);
+	for (i = 0; i < n; i++) {
+		in[i][PUMP_IN_TEMP] = rand() % 240 - 60;
+		in[i][PUMP_IN_PH] = rand() % 17;
+		in[i][PUMP_IN_ACID_FLOW] = rand() % 3 ? 0 : rand() % 12;
+		in[i][PUMP_IN_SOD_HYDROX_FLOW] = rand() % 3 ? 0 : rand() % 12;
+	}
+
+	for (r = 0; r < rounds; r++) {
+		t0 = now_ns();
+		for (i = 0; i < n; i++)
+			ref_masks[i] = legacy_eval(in[i], &ref_bounds[i]);
+		t_legacy += now_ns() - t0;
+
+		t0 = now_ns();
+		pump_rules_eval_many(in, n, bounds, masks);
+		t_table += now_ns() - t0;
+	}
+
+	for (i = 0; i < n; i++)
+		if (bounds[i] != ref_bounds[i] || masks[i] != ref_masks[i])
+			mismatches++;
+
+	printf("%zu samples x %zu rounds\n", n, rounds);
+	printf("%-12s %.2fns/sample\n", "if chains",
+	       t_legacy / (double)(n * rounds));
+	printf("%-12s %.2fns/sample\n", "rule table",
+	       t_table / (double)(n * rounds));
+	printf("%zu mismatching verdicts\n", mismatches);
+
+	free(ref_masks);
+	free(ref_bounds);
+	free(masks);
+	free(bounds);
+	free(in);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <water_treatment_ta.h>
+
+#include "async_invoke.h"
+#include "bench.h"
+#include "metrics.h"
+
+/* How long an invoker that found every queued pool busy waits */
+#define ASYNC_BUSY_WAIT_NS	100000
+
+struct async_req {
+	struct async_req *next;
+	struct session_pool *pool;
+	uint64_t deadline_ns;		/* 0 when there is none */
+	int cancel;			/* async_cancel() asked for it */
+	int cancel_sent;		/* TEEC_RequestCancellation() done */
+	async_done_fn done;
+	void *arg;
+	TEEC_Operation op;
+	struct async_result r;
+};
+
+static void complete(struct async_invoker *ai, struct async_req *req)
+{
+	req->r.latency_ns = bench_now_ns() - req->r.latency_ns;
+	req->done(req->arg, &req->r);
+
+	pthread_mutex_lock(&ai->lock);
+	ai->completed++;
+	if (req->r.timed_out)
+		ai->timed_out++;
+	else if (req->r.res == TEEC_ERROR_CANCEL)
+		ai->cancelled++;
+	else if (req->r.res != TEEC_SUCCESS)
+		ai->failed++;
+	if (!--ai->pending)
+		pthread_cond_broadcast(&ai->idle_cond);
+	/* A session came free, for invokers waiting out busy pools */
+	pthread_cond_broadcast(&ai->work_cond);
+	pthread_mutex_unlock(&ai->lock);
+
+	free(req);
+}
+
+/* The slot a pump command reports the new valve state in */
+static int state_param(uint32_t cmd)
+{
+	return cmd == TA_WATER_TREATMENT_CMD_ACID_ON ||
+	       cmd == TA_WATER_TREATMENT_CMD_ACID_OFF ? 2 : 3;
+}
+
+static int past_deadline(struct async_req *req)
+{
+	if (!req->deadline_ns || bench_now_ns() < req->deadline_ns)
+		return 0;
+	req->r.res = TEEC_ERROR_CANCEL;
+	req->r.origin = TEEC_ORIGIN_API;
+	req->r.timed_out = 1;
+	return 1;
+}
+
+/*
+ * Returns -1 without running req when every session of its pool is in
+ * use: waiting for one would hold this invoker for as long as the
+ * slowest tank takes, and out of the watchdog's reach.
+ */
+static int run(struct async_req *req)
+{
+	struct test_ctx *tee;
+	int out = state_param(req->r.cmd);
+	int busy;
+	int k;
+
+	if (past_deadline(req))
+		return 0;
+
+	tee = session_pool_try_acquire(req->pool, &busy);
+	if (busy)
+		return -1;
+	if (!tee) {
+		req->r.res = TEEC_ERROR_COMMUNICATION;
+		req->r.origin = TEEC_ORIGIN_API;
+		return 0;
+	}
+	/* Opening the session may have taken a while */
+	if (past_deadline(req)) {
+		session_pool_release(req->pool, tee, TEEC_SUCCESS, 0);
+		return 0;
+	}
+
+	req->r.res = TEEC_InvokeCommand(&tee->sess, req->r.cmd, &req->op,
+					&req->r.origin);
+	session_pool_release(req->pool, tee, req->r.res, req->r.origin);
+	metrics_command(req->r.cmd, req->r.res);
+	if (req->r.res != TEEC_SUCCESS)
+		return 0;
+
+	/* Same check as the turn_* functions: all but one slot zeroed */
+	req->r.accepted = 1;
+	for (k = 0; k < 4; k++)
+		if (k != out && req->op.params[k].value.a)
+			req->r.accepted = 0;
+	req->r.state = req->op.params[out].value.a;
+	metrics_verdict(req->r.accepted ? METRIC_ACCEPTED : METRIC_REJECTED,
+			1);
+	if (req->r.accepted)
+		metrics_valve(req->r.tank_id, out == 2 ? METRIC_VALVE_ACID :
+			      METRIC_VALVE_SOD_HYDROX, req->r.state);
+	return 0;
+}
+
+static void *invoker_run(void *arg)
+{
+	struct async_invoker_thread *t = arg;
+	struct async_invoker *ai = t->ai;
+	struct async_req *req;
+	struct timespec ts;
+	size_t skipped = 0;	/* requests put back in a row */
+	uint64_t until;
+
+	pthread_mutex_lock(&ai->lock);
+	for (;;) {
+		while (!ai->head && !ai->stopping)
+			pthread_cond_wait(&ai->work_cond, &ai->lock);
+		req = ai->head;
+		if (!req)
+			break;
+		/*
+		 * Everything queued was for a busy pool last time round:
+		 * wait for a command to complete or a moment to pass
+		 * rather than spin, other users may hold the sessions.
+		 */
+		if (skipped && skipped >= ai->queued) {
+			until = bench_now_ns() + ASYNC_BUSY_WAIT_NS;
+			ts.tv_sec = until / 1000000000ULL;
+			ts.tv_nsec = until % 1000000000ULL;
+			pthread_cond_timedwait(&ai->work_cond, &ai->lock, &ts);
+			skipped = 0;
+			continue;
+		}
+		ai->head = req->next;
+		if (!ai->head)
+			ai->tail = NULL;
+		ai->queued--;
+
+		t->current = req;
+		if (req->deadline_ns)
+			pthread_cond_signal(&ai->watch_cond);
+		pthread_mutex_unlock(&ai->lock);
+
+		if (run(req)) {
+			/* To the back, behind commands for other tanks */
+			pthread_mutex_lock(&ai->lock);
+			t->current = NULL;
+			if (!req->cancel) {
+				req->next = NULL;
+				if (ai->tail)
+					ai->tail->next = req;
+				else
+					ai->head = req;
+				ai->tail = req;
+				ai->queued++;
+				skipped++;
+				continue;
+			}
+			/* async_cancel() found it while it was out */
+			pthread_mutex_unlock(&ai->lock);
+			req->r.res = TEEC_ERROR_CANCEL;
+			req->r.origin = TEEC_ORIGIN_API;
+			complete(ai, req);
+			pthread_mutex_lock(&ai->lock);
+			continue;
+		}
+		skipped = 0;
+
+		/* After this the watchdog can no longer touch req->op */
+		pthread_mutex_lock(&ai->lock);
+		t->current = NULL;
+		if (req->cancel_sent && req->r.res == TEEC_ERROR_CANCEL &&
+		    req->deadline_ns && !req->cancel)
+			req->r.timed_out = 1;
+		pthread_mutex_unlock(&ai->lock);
+
+		complete(ai, req);
+		pthread_mutex_lock(&ai->lock);
+	}
+	pthread_mutex_unlock(&ai->lock);
+
+	return NULL;
+}
+
+static void *watchdog_run(void *arg)
+{
+	struct async_invoker *ai = arg;
+	struct async_req *req;
+	struct timespec ts;
+	uint64_t earliest;
+	uint64_t now;
+	size_t i;
+
+	pthread_mutex_lock(&ai->lock);
+	while (!ai->watchdog_stop) {
+		now = bench_now_ns();
+		earliest = 0;
+		for (i = 0; i < ai->nthreads; i++) {
+			req = ai->threads[i].current;
+			if (!req || !req->deadline_ns || req->cancel_sent)
+				continue;
+			if (req->deadline_ns <= now) {
+				TEEC_RequestCancellation(&req->op);
+				req->cancel_sent = 1;
+			} else if (!earliest || req->deadline_ns < earliest) {
+				earliest = req->deadline_ns;
+			}
+		}
+
+		if (!earliest) {
+			pthread_cond_wait(&ai->watch_cond, &ai->lock);
+			continue;
+		}
+		ts.tv_sec = earliest / 1000000000ULL;
+		ts.tv_nsec = earliest % 1000000000ULL;
+		pthread_cond_timedwait(&ai->watch_cond, &ai->lock, &ts);
+	}
+	pthread_mutex_unlock(&ai->lock);
+
+	return NULL;
+}
+
+TEEC_Result async_invoker_init(struct async_invoker *ai, size_t nthreads)
+{
+	pthread_condattr_t attr;
+	size_t i;
+
+	memset(ai, 0, sizeof(*ai));
+	ai->threads = calloc(nthreads, sizeof(*ai->threads));
+	if (!ai->threads)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	ai->nthreads = nthreads;
+	ai->next_ticket = 1;
+
+	pthread_mutex_init(&ai->lock, NULL);
+	pthread_cond_init(&ai->idle_cond, NULL);
+	/* Deadlines come from bench_now_ns(), CLOCK_MONOTONIC */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&ai->work_cond, &attr);
+	pthread_cond_init(&ai->watch_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	for (i = 0; i < nthreads; i++) {
+		ai->threads[i].ai = ai;
+		if (pthread_create(&ai->threads[i].thread, NULL, invoker_run,
+				   &ai->threads[i]))
+			err(1, "pthread_create");
+	}
+	if (pthread_create(&ai->watchdog, NULL, watchdog_run, ai))
+		err(1, "pthread_create");
+
+	return TEEC_SUCCESS;
+}
+
+void async_invoker_destroy(struct async_invoker *ai)
+{
+	size_t i;
+
+	if (!ai->threads)
+		return;
+
+	pthread_mutex_lock(&ai->lock);
+	ai->stopping = 1;
+	pthread_cond_broadcast(&ai->work_cond);
+	pthread_mutex_unlock(&ai->lock);
+
+	/* Deadlines still apply to what is left in the queue */
+	for (i = 0; i < ai->nthreads; i++)
+		pthread_join(ai->threads[i].thread, NULL);
+
+	pthread_mutex_lock(&ai->lock);
+	ai->watchdog_stop = 1;
+	pthread_cond_signal(&ai->watch_cond);
+	pthread_mutex_unlock(&ai->lock);
+	pthread_join(ai->watchdog, NULL);
+
+	pthread_cond_destroy(&ai->watch_cond);
+	pthread_cond_destroy(&ai->idle_cond);
+	pthread_cond_destroy(&ai->work_cond);
+	pthread_mutex_destroy(&ai->lock);
+	free(ai->threads);
+	ai->threads = NULL;
+}
+
+TEEC_Result async_submit(struct async_invoker *ai, struct session_pool *pool,
+			 uint32_t cmd, const int32_t in[4],
+			 uint64_t timeout_ns, async_done_fn done, void *arg,
+			 uint64_t *ticket)
+{
+	struct async_req *req;
+	int k;
+
+	if (cmd > TA_WATER_TREATMENT_CMD_ACID_OFF || !done)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	req->pool = pool;
+	req->done = done;
+	req->arg = arg;
+	req->r.cmd = cmd;
+	req->r.tank_id = pool->tank_id;
+	/* Holds the submit time until complete() turns it into latency */
+	req->r.latency_ns = bench_now_ns();
+	if (timeout_ns)
+		req->deadline_ns = req->r.latency_ns + timeout_ns;
+
+	req->op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+					      TEEC_VALUE_INOUT,
+					      TEEC_VALUE_INOUT,
+					      TEEC_VALUE_INOUT);
+	for (k = 0; k < 4; k++)
+		req->op.params[k].value.a = in[k];
+
+	pthread_mutex_lock(&ai->lock);
+	if (ai->stopping) {
+		pthread_mutex_unlock(&ai->lock);
+		free(req);
+		return TEEC_ERROR_BAD_STATE;
+	}
+	req->r.ticket = ai->next_ticket++;
+	if (ticket)
+		*ticket = req->r.ticket;
+	if (ai->tail)
+		ai->tail->next = req;
+	else
+		ai->head = req;
+	ai->tail = req;
+	ai->queued++;
+	ai->pending++;
+	pthread_cond_signal(&ai->work_cond);
+	pthread_mutex_unlock(&ai->lock);
+
+	return TEEC_SUCCESS;
+}
+
+int async_cancel(struct async_invoker *ai, uint64_t ticket)
+{
+	struct async_req **pp;
+	struct async_req *req;
+	struct async_req *prev = NULL;
+	size_t i;
+
+	pthread_mutex_lock(&ai->lock);
+
+	for (pp = &ai->head; *pp; prev = *pp, pp = &(*pp)->next) {
+		req = *pp;
+		if (req->r.ticket != ticket)
+			continue;
+		/* Still queued: complete it without going near the TEE */
+		*pp = req->next;
+		if (ai->tail == req)
+			ai->tail = prev;
+		ai->queued--;
+		pthread_mutex_unlock(&ai->lock);
+
+		req->r.res = TEEC_ERROR_CANCEL;
+		req->r.origin = TEEC_ORIGIN_API;
+		complete(ai, req);
+		return 0;
+	}
+
+	for (i = 0; i < ai->nthreads; i++) {
+		req = ai->threads[i].current;
+		if (!req || req->r.ticket != ticket)
+			continue;
+		req->cancel = 1;
+		if (!req->cancel_sent) {
+			TEEC_RequestCancellation(&req->op);
+			req->cancel_sent = 1;
+		}
+		pthread_mutex_unlock(&ai->lock);
+		return 0;
+	}
+
+	pthread_mutex_unlock(&ai->lock);
+	return -1;
+}
+
+void async_invoker_wait(struct async_invoker *ai)
+{
+	pthread_mutex_lock(&ai->lock);
+	while (ai->pending)
+		pthread_cond_wait(&ai->idle_cond, &ai->lock);
+	pthread_mutex_unlock(&ai->lock);
+}
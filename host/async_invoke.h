@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ASYNC_INVOKE_H
+#define ASYNC_INVOKE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+#include "session_pool.h"
+
+/* Outcome of one asynchronous pump command */
+struct async_result {
+	uint64_t ticket;	/* as returned by async_submit() */
+	uint32_t cmd;
+	uint32_t tank_id;
+	TEEC_Result res;	/* TEEC_ERROR_CANCEL if it missed its deadline */
+	uint32_t origin;
+	int accepted;		/* the TA moved the valve */
+	uint32_t state;		/* valve state reported back, when accepted */
+	int timed_out;		/* cancelled because of its deadline */
+	uint64_t latency_ns;	/* submit to completion */
+};
+
+/* Called on an invoker thread, once per submitted command */
+typedef void (*async_done_fn)(void *arg, const struct async_result *r);
+
+struct async_req;
+
+struct async_invoker_thread {
+	struct async_invoker *ai;
+	pthread_t thread;
+	struct async_req *current;	/* being invoked, under ai->lock */
+};
+
+/*
+ * Pump commands queued by any thread and run by a few invoker threads,
+ * each command on a session from the pool of the tank it is for. A
+ * watchdog thread calls TEEC_RequestCancellation() on commands still in
+ * the TEE past their deadline, commands already late when they are
+ * dequeued or once they have a session are not sent at all. A command
+ * whose tank has no free session goes back to the end of the queue, so
+ * that one slow tank cannot hold every invoker.
+ */
+struct async_invoker {
+	struct async_invoker_thread *threads;
+	size_t nthreads;
+	pthread_t watchdog;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* queue grew, a command completed or stopping */
+	pthread_cond_t watch_cond;	/* a command with a deadline started */
+	pthread_cond_t idle_cond;	/* queue drained and nothing running */
+	struct async_req *head;
+	struct async_req *tail;
+	size_t queued;			/* on the list */
+	size_t pending;			/* queued plus running */
+	uint64_t next_ticket;
+	int stopping;
+	int watchdog_stop;
+	/* Under lock */
+	unsigned long completed;
+	unsigned long failed;
+	unsigned long timed_out;
+	unsigned long cancelled;
+};
+
+TEEC_Result async_invoker_init(struct async_invoker *ai, size_t nthreads);
+
+/* Completes everything queued, then stops the threads */
+void async_invoker_destroy(struct async_invoker *ai);
+
+/*
+ * Queues pump command cmd with readings in[] for pool's tank and returns
+ * at once. timeout_ns is relative to now, 0 for none. done runs exactly
+ * once, on success *ticket identifies the command until then.
+ */
+TEEC_Result async_submit(struct async_invoker *ai, struct session_pool *pool,
+			 uint32_t cmd, const int32_t in[4],
+			 uint64_t timeout_ns, async_done_fn done, void *arg,
+			 uint64_t *ticket);
+
+/*
+ * Cancels a command that has not completed yet. Returns 0 if it was
+ * found, its callback then reports TEEC_ERROR_CANCEL unless the TA had
+ * already finished it.
+ */
+int async_cancel(struct async_invoker *ai, uint64_t ticket);
+
+/* Blocks until every command submitted so far has completed */
+void async_invoker_wait(struct async_invoker *ai);
+
+#endif /* ASYNC_INVOKE_H */
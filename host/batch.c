@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <string.h>
+
+#include "batch.h"
+#include "metrics.h"
+#include "phase_trace.h"
+
+TEEC_Result evaluate_batch(struct test_ctx *ctx,
+			   const struct wt_sample *samples, size_t n,
+			   struct wt_decision *decisions, size_t *rejected,
+			   uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_OUTPUT,
+					 phase_trace_enabled() ?
+					 TEEC_VALUE_OUTPUT : TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)samples;
+	op.params[0].tmpref.size = n * sizeof(*samples);
+	op.params[1].tmpref.buffer = decisions;
+	op.params[1].tmpref.size = n * sizeof(*decisions);
+	phase_mark(PHASE_MARSHAL);
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 TA_WATER_TREATMENT_CMD_EVALUATE_BATCH, &op,
+				 &origin);
+	phase_mark(PHASE_INVOKE);
+	phase_reply(TA_WATER_TREATMENT_CMD_EVALUATE_BATCH, &op, res);
+	metrics_command(TA_WATER_TREATMENT_CMD_EVALUATE_BATCH, res);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	if (op.params[2].value.a != n) {
+		warnx("TA evaluated %u of %zu samples", op.params[2].value.a, n);
+		if (err_origin)
+			*err_origin = TEEC_ORIGIN_TRUSTED_APP;
+		return TEEC_ERROR_BAD_FORMAT;
+	}
+	if (rejected)
+		*rejected = op.params[2].value.b;
+	metrics_verdict(METRIC_ACCEPTED, n - op.params[2].value.b);
+	metrics_verdict(METRIC_DEVICE_LIMITS, op.params[2].value.b);
+
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result evaluate_auth_batch(struct test_ctx *ctx,
+				const struct wt_auth_batch *batch,
+				struct wt_decision *decisions,
+				size_t *rejected, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)batch;
+	op.params[0].tmpref.size = WT_AUTH_BATCH_BYTES(batch->count);
+	op.params[1].tmpref.buffer = decisions;
+	op.params[1].tmpref.size = batch->count * sizeof(*decisions);
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_AUTH_BATCH,
+				 &op, &origin);
+	metrics_command(TA_WATER_TREATMENT_CMD_AUTH_BATCH, res);
+	if (res != TEEC_SUCCESS) {
+		if (res != TEEC_ERROR_SECURITY)
+			warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+			      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	if (rejected)
+		*rejected = op.params[2].value.b;
+	metrics_verdict(METRIC_ACCEPTED,
+			op.params[2].value.a - op.params[2].value.b);
+	metrics_verdict(METRIC_DEVICE_LIMITS, op.params[2].value.b);
+
+	return TEEC_SUCCESS;
+}
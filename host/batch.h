@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* For struct wt_sample and struct wt_decision */
+#include <water_treatment_ta.h>
+
+#include "session_pool.h"
+
+/*
+ * Sends n samples to the TA in one TA_WATER_TREATMENT_CMD_EVALUATE_BATCH
+ * invoke and fills decisions[0..n-1]. If rejected is not NULL it receives
+ * the number of samples outside the device limits.
+ */
+TEEC_Result evaluate_batch(struct test_ctx *ctx,
+			   const struct wt_sample *samples, size_t n,
+			   struct wt_decision *decisions, size_t *rejected,
+			   uint32_t *err_origin);
+
+/*
+ * Sends a signed batch, samples included, to the TA as one
+ * TA_WATER_TREATMENT_CMD_AUTH_BATCH invoke and fills
+ * decisions[0..batch->count - 1]. Returns TEEC_ERROR_SECURITY, without a
+ * warning, if the TA did not accept the batch as authentic.
+ */
+TEEC_Result evaluate_auth_batch(struct test_ctx *ctx,
+				const struct wt_auth_batch *batch,
+				struct wt_decision *decisions,
+				size_t *rejected, uint32_t *err_origin);
+
+#endif /* BATCH_H */
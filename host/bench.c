@@ -0,0 +1,1081 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <water_treatment_ta.h>
+
+#include "async_invoke.h"
+#include "batch.h"
+#include "bench.h"
+#include "dedup_cache.h"
+#include "events.h"
+#include "sensor_auth.h"
+#include "sensor_ring.h"
+#include "tank_control.h"
+
+/* bench_async() spreads its commands over this many tanks */
+#define BENCH_ASYNC_TANKS	4
+/* and in its second run gives each this long */
+#define BENCH_ASYNC_DEADLINE_NS	1000000
+/* bench_auth() locks this tank to signed readings for a while */
+#define BENCH_SIGNED_TANK	1000
+
+uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+void bench_report(const char *label, uint64_t *samples_ns, size_t n)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	if (!n)
+		return;
+
+	qsort(samples_ns, n, sizeof(*samples_ns), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += samples_ns[i];
+
+	printf("%-24s n=%zu min=%.1fus avg=%.1fus p50=%.1fus p99=%.1fus max=%.1fus\n",
+	       label, n, samples_ns[0] / 1e3, sum / (double)n / 1e3,
+	       samples_ns[n / 2] / 1e3, samples_ns[(n * 99) / 100] / 1e3,
+	       samples_ns[n - 1] / 1e3);
+}
+
+/* Time one acquire + command + release cycle per sample */
+static int run_pool(struct session_pool *pool, uint64_t *samples,
+		    size_t iterations)
+{
+	struct test_ctx *tee;
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+	uint64_t t0;
+	size_t i;
+
+	for (i = 0; i < iterations; i++) {
+		t0 = bench_now_ns();
+
+		tee = session_pool_acquire(pool);
+		if (!tee)
+			return -1;
+
+		/* Valid readings that the TA rejects: no pump state change */
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT);
+		op.params[0].value.a = 70;
+		op.params[1].value.a = 7;
+		op.params[2].value.a = 0;
+		op.params[3].value.a = 0;
+		res = TEEC_InvokeCommand(&tee->sess,
+					 TA_WATER_TREATMENT_CMD_ACID_OFF, &op,
+					 &origin);
+		session_pool_release(pool, tee, res, origin);
+		if (res != TEEC_SUCCESS) {
+			warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+			      res, origin);
+			return -1;
+		}
+
+		samples[i] = bench_now_ns() - t0;
+	}
+
+	return 0;
+}
+
+int bench_session_reuse(size_t iterations, size_t pool_size)
+{
+	struct session_pool pool;
+	uint64_t *samples;
+	int ret = -1;
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples)
+		err(1, "calloc");
+
+	printf("Session reuse benchmark, %zu commands per mode\n", iterations);
+
+	if (session_pool_init(&pool, 0, 1, 0) != TEEC_SUCCESS)
+		goto out;
+	ret = run_pool(&pool, samples, iterations);
+	session_pool_destroy(&pool);
+	if (ret)
+		goto out;
+	bench_report("open/close per command", samples, iterations);
+
+	ret = -1;
+	if (session_pool_init(&pool, 0, pool_size, 1) != TEEC_SUCCESS)
+		goto out;
+	ret = run_pool(&pool, samples, iterations);
+	session_pool_destroy(&pool);
+	if (ret)
+		goto out;
+	bench_report("pooled session", samples, iterations);
+
+out:
+	free(samples);
+	return ret;
+}
+
+static void fill_samples(struct wt_sample *samples, size_t n)
+{
+	size_t i;
+
+	/* Sweep pH across the whole device range so every rule gets hit */
+	for (i = 0; i < n; i++) {
+		samples[i].temp = 70;
+		samples[i].ph = i % 15;
+		samples[i].acid_flow = (i / 15) % 2;
+		samples[i].sod_hydrox_flow = 0;
+		samples[i].timestamp = i;
+	}
+}
+
+int bench_batch(size_t total, size_t batch_size)
+{
+	struct wt_decision *decisions = NULL;
+	struct wt_sample *samples = NULL;
+	struct session_pool pool;
+	struct test_ctx *tee;
+	TEEC_Operation op;
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	uint64_t *samples_ns = NULL;
+	size_t batches = (total + batch_size - 1) / batch_size;
+	size_t chunk;
+	size_t i;
+	uint64_t t0;
+	uint64_t t_single;
+	uint64_t t_batch;
+	int ret = -1;
+
+	samples = calloc(total, sizeof(*samples));
+	decisions = calloc(total, sizeof(*decisions));
+	samples_ns = calloc(batches, sizeof(*samples_ns));
+	if (!samples || !decisions || !samples_ns)
+		err(1, "calloc");
+	fill_samples(samples, total);
+
+	if (session_pool_init(&pool, 0, 1, 1) != TEEC_SUCCESS)
+		goto out;
+	tee = session_pool_acquire(&pool);
+	if (!tee)
+		goto out_pool;
+
+	printf("Batch benchmark, %zu samples, %zu per batch\n", total,
+	       batch_size);
+
+	t0 = bench_now_ns();
+	for (i = 0; i < total; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT);
+		op.params[0].value.a = samples[i].temp;
+		op.params[1].value.a = samples[i].ph;
+		op.params[2].value.a = samples[i].acid_flow;
+		op.params[3].value.a = samples[i].sod_hydrox_flow;
+		res = TEEC_InvokeCommand(&tee->sess,
+					 TA_WATER_TREATMENT_CMD_ACID_OFF, &op,
+					 &origin);
+		if (res != TEEC_SUCCESS) {
+			warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+			      res, origin);
+			goto out_release;
+		}
+	}
+	t_single = bench_now_ns() - t0;
+
+	t0 = bench_now_ns();
+	for (i = 0; i < batches; i++) {
+		uint64_t t1 = bench_now_ns();
+
+		chunk = total - i * batch_size;
+		if (chunk > batch_size)
+			chunk = batch_size;
+		res = evaluate_batch(tee, samples + i * batch_size, chunk,
+				     decisions + i * batch_size, NULL,
+				     &origin);
+		if (res != TEEC_SUCCESS)
+			goto out_release;
+		samples_ns[i] = bench_now_ns() - t1;
+	}
+	t_batch = bench_now_ns() - t0;
+
+	printf("%-24s %zu invokes, %.2fus/sample\n", "one command per sample",
+	       total, t_single / 1e3 / total);
+	printf("%-24s %zu invokes, %.2fus/sample\n", "batched", batches,
+	       t_batch / 1e3 / total);
+	bench_report("per batch", samples_ns, batches);
+	ret = 0;
+
+out_release:
+	session_pool_release(&pool, tee, res, origin);
+out_pool:
+	session_pool_destroy(&pool);
+out:
+	free(samples_ns);
+	free(decisions);
+	free(samples);
+	return ret;
+}
+
+/*
+ * Signs total samples into batches of up to per samples laid out back to
+ * back, stride bytes apart, and returns how many batches that made.
+ */
+static size_t sign_batches(struct sensor_signer *signer, uint8_t *buf,
+			   size_t stride, const struct wt_sample *samples,
+			   size_t total, size_t per)
+{
+	struct wt_auth_batch *b;
+	size_t chunk;
+	size_t n;
+
+	for (n = 0; n * per < total; n++) {
+		b = (struct wt_auth_batch *)(buf + n * stride);
+		chunk = total - n * per < per ? total - n * per : per;
+		memcpy(b->samples, samples + n * per, chunk * sizeof(*samples));
+		sensor_sign_batch(signer, b, chunk);
+	}
+	return n;
+}
+
+/* Runs every signed batch in buf, returns the time it took or 0 */
+static uint64_t run_auth_batches(struct test_ctx *tee, const uint8_t *buf,
+				 size_t stride, size_t batches,
+				 struct wt_decision *decisions,
+				 TEEC_Result *res, uint32_t *origin)
+{
+	const struct wt_auth_batch *b;
+	uint64_t t0 = bench_now_ns();
+	size_t done = 0;
+	size_t i;
+
+	for (i = 0; i < batches; i++) {
+		b = (const struct wt_auth_batch *)(buf + i * stride);
+		*res = evaluate_auth_batch(tee, b, decisions + done, NULL,
+					   origin);
+		if (*res != TEEC_SUCCESS) {
+			warnx("Authenticated batch %zu refused, code 0x%x",
+			      i, *res);
+			return 0;
+		}
+		done += b->count;
+	}
+	return bench_now_ns() - t0;
+}
+
+/*
+ * Invokes cmd with an unsigned pH 4 reading, quietly: the helpers in
+ * tank_control.c and batch.c warn about every failure, and here failing
+ * is the point.
+ */
+static TEEC_Result invoke_unsigned(struct test_ctx *tee, uint32_t cmd)
+{
+	struct wt_sample sample = { .temp = 70, .ph = 4 };
+	struct wt_decision decision;
+	TEEC_Operation op;
+	uint32_t origin;
+
+	memset(&op, 0, sizeof(op));
+	switch (cmd) {
+	case TA_WATER_TREATMENT_CMD_CONTROL:
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_VALUE_OUTPUT,
+						 TEEC_VALUE_OUTPUT);
+		op.params[0].value.a = sample.temp;
+		op.params[0].value.b = sample.ph;
+		break;
+	case TA_WATER_TREATMENT_CMD_EVALUATE_BATCH:
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_MEMREF_TEMP_OUTPUT,
+						 TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].tmpref.buffer = &sample;
+		op.params[0].tmpref.size = sizeof(sample);
+		op.params[1].tmpref.buffer = &decision;
+		op.params[1].tmpref.size = sizeof(decision);
+		break;
+	case TA_WATER_TREATMENT_CMD_PH_CHECK:
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						 TEEC_VALUE_OUTPUT,
+						 TEEC_VALUE_OUTPUT,
+						 TEEC_VALUE_OUTPUT);
+		op.params[0].value.a = sample.ph;
+		op.params[0].value.b = WT_PH_CHECK_RECORD;
+		break;
+	default:
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+	return TEEC_InvokeCommand(&tee->sess, cmd, &op, &origin);
+}
+
+/*
+ * On a tank opened WT_SESSION_SIGNED_ONLY unsigned readings must not get
+ * through, from that session or a plain one opened after it, while a
+ * signed batch is recorded and acted on. Once the signed only session
+ * closes the tank takes unsigned readings again, the next run of the
+ * TA's instance may open it any way it likes. Returns 0 if so.
+ */
+static int check_signed_only(void)
+{
+	static const uint32_t refused[] = {
+		TA_WATER_TREATMENT_CMD_CONTROL,
+		TA_WATER_TREATMENT_CMD_EVALUATE_BATCH,
+		TA_WATER_TREATMENT_CMD_PH_CHECK,
+	};
+	uint8_t buf[WT_AUTH_BATCH_BYTES(1)];
+	struct wt_auth_batch *b = (struct wt_auth_batch *)buf;
+	struct sensor_signer signer;
+	struct session_pool signed_pool;
+	struct session_pool plain_pool;
+	struct wt_decision decision;
+	struct ph_report before;
+	struct ph_report after;
+	struct test_ctx *tee;
+	struct test_ctx *plain;
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	int signed_open = 1;
+	size_t i;
+	int ret = -1;
+
+	if (session_pool_init_mode(&signed_pool, BENCH_SIGNED_TANK, 1, 1,
+				   WT_SESSION_SIGNED_ONLY) != TEEC_SUCCESS)
+		return -1;
+	tee = session_pool_acquire(&signed_pool);
+	if (!tee)
+		goto out_signed;
+	if (session_pool_init(&plain_pool, BENCH_SIGNED_TANK, 1, 1) !=
+	    TEEC_SUCCESS)
+		goto out_release;
+	plain = session_pool_acquire(&plain_pool);
+	if (!plain)
+		goto out_plain;
+
+	for (i = 0; i < 2 * sizeof(refused) / sizeof(refused[0]); i++) {
+		res = invoke_unsigned(i % 2 ? plain : tee, refused[i / 2]);
+		if (res != TEEC_ERROR_ACCESS_DENIED) {
+			warnx("Unsigned %s taken by a signed only tank, "
+			      "code 0x%x", ta_cmd_name(refused[i / 2]), res);
+			goto out_plain_release;
+		}
+	}
+
+	/* pH 4 with no flow turns the sodium hydroxide on */
+	memset(buf, 0, sizeof(buf));
+	b->samples[0].temp = 70;
+	b->samples[0].ph = 4;
+	res = check_ph(plain, 0, 0, &before, &origin);
+	if (res != TEEC_SUCCESS)
+		goto out_plain_release;
+	sensor_signer_init(&signer, WT_AUTH_DEMO_KEY, WT_AUTH_DEMO_KEY_SIZE,
+			   BENCH_SIGNED_TANK);
+	sensor_sign_batch(&signer, b, 1);
+	res = evaluate_auth_batch(tee, b, &decision, NULL, &origin);
+	if (res == TEEC_SUCCESS)
+		res = check_ph(plain, 0, 0, &after, &origin);
+	if (res != TEEC_SUCCESS || after.count != before.count + 1 ||
+	    !(decision.actions &
+	      WT_ACTION(TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON))) {
+		warnx("Signed batch not taken by a signed only tank, "
+		      "code 0x%x", res);
+		goto out_plain_release;
+	}
+
+	session_pool_release(&signed_pool, tee, TEEC_SUCCESS, origin);
+	session_pool_destroy(&signed_pool);
+	signed_open = 0;
+	res = invoke_unsigned(plain, TA_WATER_TREATMENT_CMD_CONTROL);
+	if (res != TEEC_SUCCESS) {
+		warnx("Tank still signed only after its session closed, "
+		      "code 0x%x", res);
+		goto out_plain_release;
+	}
+	printf("unsigned commands refused on a signed only tank, also from "
+	       "a plain session, until it closes\n");
+	ret = 0;
+
+out_plain_release:
+	session_pool_release(&plain_pool, plain, TEEC_SUCCESS, origin);
+out_plain:
+	session_pool_destroy(&plain_pool);
+out_release:
+	if (signed_open)
+		session_pool_release(&signed_pool, tee, TEEC_SUCCESS, origin);
+out_signed:
+	if (signed_open)
+		session_pool_destroy(&signed_pool);
+	return ret;
+}
+
+int bench_auth(size_t total, size_t batch_size)
+{
+	struct wt_decision *decisions = NULL;
+	struct wt_sample *samples = NULL;
+	struct sensor_signer signer;
+	struct session_pool pool;
+	struct wt_auth_batch *b;
+	struct test_ctx *tee;
+	uint8_t *signed_many = NULL;
+	uint8_t *signed_one = NULL;
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	size_t stride;
+	size_t batches;
+	size_t chunk;
+	size_t i;
+	uint64_t t0;
+	uint64_t t_sign;
+	uint64_t t_plain;
+	uint64_t t_auth;
+	uint64_t t_one;
+	int ret = -1;
+
+	if (batch_size > WT_AUTH_MAX_SAMPLES)
+		batch_size = WT_AUTH_MAX_SAMPLES;
+	stride = WT_AUTH_BATCH_BYTES(batch_size);
+	batches = (total + batch_size - 1) / batch_size;
+
+	samples = calloc(total, sizeof(*samples));
+	decisions = calloc(total, sizeof(*decisions));
+	signed_many = calloc(batches, stride);
+	signed_one = calloc(total, WT_AUTH_BATCH_BYTES(1));
+	if (!samples || !decisions || !signed_many || !signed_one)
+		err(1, "calloc");
+	fill_samples(samples, total);
+
+	/* Sensor side, done before the clock starts for the TA runs */
+	sensor_signer_init(&signer, WT_AUTH_DEMO_KEY, WT_AUTH_DEMO_KEY_SIZE, 0);
+	t0 = bench_now_ns();
+	sign_batches(&signer, signed_many, stride, samples, total, batch_size);
+	t_sign = bench_now_ns() - t0;
+	sign_batches(&signer, signed_one, WT_AUTH_BATCH_BYTES(1), samples,
+		     total, 1);
+
+	if (session_pool_init(&pool, 0, 1, 1) != TEEC_SUCCESS)
+		goto out;
+	tee = session_pool_acquire(&pool);
+	if (!tee)
+		goto out_pool;
+
+	printf("Authentication benchmark, %zu samples, %zu per batch\n", total,
+	       batch_size);
+
+	t0 = bench_now_ns();
+	for (i = 0; i < batches; i++) {
+		chunk = total - i * batch_size;
+		if (chunk > batch_size)
+			chunk = batch_size;
+		res = evaluate_batch(tee, samples + i * batch_size, chunk,
+				     decisions + i * batch_size, NULL,
+				     &origin);
+		if (res != TEEC_SUCCESS)
+			goto out_release;
+	}
+	t_plain = bench_now_ns() - t0;
+
+	t_auth = run_auth_batches(tee, signed_many, stride, batches,
+				  decisions, &res, &origin);
+	if (!t_auth)
+		goto out_release;
+	t_one = run_auth_batches(tee, signed_one, WT_AUTH_BATCH_BYTES(1),
+				 total, decisions, &res, &origin);
+	if (!t_one)
+		goto out_release;
+
+	printf("%-24s %.0f records/s\n", "unauthenticated",
+	       total / (t_plain / 1e9));
+	printf("%-24s %.0f records/s\n", "HMAC per batch",
+	       total / (t_auth / 1e9));
+	printf("%-24s %.0f records/s\n", "HMAC per record",
+	       total / (t_one / 1e9));
+	printf("%-24s %.2fus/record on the sensor side\n", "signing",
+	       t_sign / 1e3 / total);
+
+	/* A sample changed after signing, then a batch sent twice */
+	b = (struct wt_auth_batch *)signed_many;
+	sensor_sign_batch(&signer, b, b->count);
+	b->samples[0].ph ^= 1;
+	res = evaluate_auth_batch(tee, b, decisions, NULL, &origin);
+	if (res != TEEC_ERROR_SECURITY) {
+		warnx("Tampered batch not refused, code 0x%x", res);
+		goto out_release;
+	}
+	b->samples[0].ph ^= 1;
+	res = evaluate_auth_batch(tee, b, decisions, NULL, &origin);
+	if (res == TEEC_SUCCESS)
+		res = evaluate_auth_batch(tee, b, decisions, NULL, &origin);
+	if (res != TEEC_ERROR_SECURITY) {
+		warnx("Replayed batch not refused, code 0x%x", res);
+		goto out_release;
+	}
+
+	/* The tank's state goes with its last session, its seq must not */
+	session_pool_release(&pool, tee, TEEC_SUCCESS, origin);
+	session_pool_destroy(&pool);
+	if (session_pool_init(&pool, 0, 1, 1) != TEEC_SUCCESS)
+		goto out;
+	tee = session_pool_acquire(&pool);
+	if (!tee)
+		goto out_pool;
+	res = evaluate_auth_batch(tee, b, decisions, NULL, &origin);
+	if (res != TEEC_ERROR_SECURITY) {
+		warnx("Batch replayed after a reopen not refused, code 0x%x",
+		      res);
+		goto out_release;
+	}
+	sensor_sign_batch(&signer, b, b->count);
+	res = evaluate_auth_batch(tee, b, decisions, NULL, &origin);
+	if (res != TEEC_SUCCESS) {
+		warnx("Batch signed after a reopen refused, code 0x%x", res);
+		goto out_release;
+	}
+	printf("tampered and replayed batches refused, also after the "
+	       "tank's last session closed\n");
+	res = TEEC_SUCCESS;
+	ret = check_signed_only();
+
+out_release:
+	session_pool_release(&pool, tee, res, origin);
+out_pool:
+	session_pool_destroy(&pool);
+out:
+	free(signed_one);
+	free(signed_many);
+	free(decisions);
+	free(samples);
+	return ret;
+}
+
+int bench_ring(size_t total, uint32_t ring_size)
+{
+	struct sensor_ring ring;
+	struct session_pool pool;
+	struct wt_sample sample;
+	struct test_ctx *tee;
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	uint64_t elapsed;
+	uint64_t t0;
+	size_t i;
+	int ret = -1;
+
+	if (session_pool_init(&pool, 0, 1, 1) != TEEC_SUCCESS)
+		return -1;
+	tee = session_pool_acquire(&pool);
+	if (!tee)
+		goto out_pool;
+	if (sensor_ring_init(&ring, &tee->ctx, ring_size) != TEEC_SUCCESS)
+		goto out_release;
+
+	printf("Ring benchmark, %zu samples, %u slots\n", total,
+	       ring.mask + 1);
+
+	fill_samples(&sample, 1);
+	t0 = bench_now_ns();
+	for (i = 0; i < total; i++) {
+		sample.ph = i % 15;
+		sample.timestamp = i;
+		if (!sensor_ring_push(&ring, &sample))
+			continue;
+
+		res = sensor_ring_drain(&ring, &tee->sess, NULL, NULL, &origin);
+		if (res != TEEC_SUCCESS)
+			goto out_ring;
+		sensor_ring_push(&ring, &sample);
+	}
+	res = sensor_ring_drain(&ring, &tee->sess, NULL, NULL, &origin);
+	if (res != TEEC_SUCCESS)
+		goto out_ring;
+	elapsed = bench_now_ns() - t0;
+
+	printf("%-24s %.0f records/s, %.1f records/world switch\n",
+	       "shared ring", ring.drained / (elapsed / 1e9),
+	       ring.drained / (double)ring.drains);
+	ret = 0;
+
+out_ring:
+	sensor_ring_destroy(&ring);
+out_release:
+	session_pool_release(&pool, tee, res, origin);
+out_pool:
+	session_pool_destroy(&pool);
+	return ret;
+}
+
+struct tank_worker {
+	pthread_t thread;
+	pthread_barrier_t *start;
+	uint32_t tank_id;
+	size_t iterations;
+	uint64_t *samples;
+	uint64_t start_ns;	/* first command sent */
+	uint64_t end_ns;	/* last one answered */
+	int failed;
+};
+
+static void *tank_worker_run(void *arg)
+{
+	struct tank_worker *w = arg;
+	struct session_pool pool;
+	struct test_ctx *tee;
+	TEEC_Operation op;
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	uint32_t on;
+	uint64_t t0;
+	size_t i;
+
+	if (session_pool_init(&pool, w->tank_id, 1, 1) != TEEC_SUCCESS) {
+		w->failed = 1;
+		pthread_barrier_wait(w->start);
+		return NULL;
+	}
+	tee = session_pool_acquire(&pool);
+	pthread_barrier_wait(w->start);
+	if (!tee) {
+		w->failed = 1;
+		goto out;
+	}
+
+	/* Toggle the sodium hydroxide pump, every command is accepted */
+	w->start_ns = bench_now_ns();
+	for (i = 0; i < w->iterations; i++) {
+		on = !(i & 1);
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT);
+		op.params[0].value.a = 70;
+		op.params[1].value.a = on ? 4 : 7;
+		op.params[2].value.a = 0;
+		op.params[3].value.a = !on;
+
+		t0 = bench_now_ns();
+		res = TEEC_InvokeCommand(&tee->sess,
+					 on ? TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON :
+					      TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF,
+					 &op, &origin);
+		w->samples[i] = bench_now_ns() - t0;
+		if (res != TEEC_SUCCESS || op.params[3].value.a != on) {
+			w->failed = 1;
+			break;
+		}
+	}
+	w->end_ns = bench_now_ns();
+
+	session_pool_release(&pool, tee, res, origin);
+out:
+	session_pool_destroy(&pool);
+	return NULL;
+}
+
+static int run_tanks(size_t tanks, size_t iterations)
+{
+	struct tank_worker *workers;
+	pthread_barrier_t start;
+	uint64_t *samples;
+	uint64_t first = UINT64_MAX;
+	uint64_t last = 0;
+	char label[32];
+	int failed = 0;
+	size_t i;
+
+	workers = calloc(tanks, sizeof(*workers));
+	samples = calloc(tanks * iterations, sizeof(*samples));
+	if (!workers || !samples)
+		err(1, "calloc");
+	pthread_barrier_init(&start, NULL, tanks + 1);
+
+	for (i = 0; i < tanks; i++) {
+		workers[i].start = &start;
+		workers[i].tank_id = i;
+		workers[i].iterations = iterations;
+		workers[i].samples = samples + i * iterations;
+		if (pthread_create(&workers[i].thread, NULL, tank_worker_run,
+				   &workers[i]))
+			err(1, "pthread_create");
+	}
+
+	pthread_barrier_wait(&start);
+	/* From the first command of any tank to the last, as they ran */
+	for (i = 0; i < tanks; i++) {
+		pthread_join(workers[i].thread, NULL);
+		failed |= workers[i].failed;
+		if (workers[i].start_ns < first)
+			first = workers[i].start_ns;
+		if (workers[i].end_ns > last)
+			last = workers[i].end_ns;
+	}
+
+	if (failed) {
+		warnx("a tank worker failed or saw another tank's state");
+	} else {
+		printf("%3zu tanks: %.0f commands/s\n", tanks,
+		       tanks * iterations / ((last - first) / 1e9));
+		snprintf(label, sizeof(label), "  latency");
+		bench_report(label, samples, tanks * iterations);
+	}
+
+	pthread_barrier_destroy(&start);
+	free(samples);
+	free(workers);
+	return failed ? -1 : 0;
+}
+
+int bench_tanks(size_t iterations, size_t max_tanks)
+{
+	size_t tanks;
+
+	printf("Multi-tank load test, %zu commands per tank\n", iterations);
+
+	for (tanks = 1; tanks < max_tanks; tanks *= 2)
+		if (run_tanks(tanks, iterations))
+			return -1;
+	return run_tanks(max_tanks, iterations);
+}
+
+struct async_bench {
+	uint64_t *samples;	/* latency by ticket - 1 */
+	unsigned long accepted;
+};
+
+static void async_bench_done(void *arg, const struct async_result *r)
+{
+	struct async_bench *ab = arg;
+
+	ab->samples[r->ticket - 1] = r->latency_ns;
+	if (r->res == TEEC_SUCCESS && r->accepted)
+		__atomic_add_fetch(&ab->accepted, 1, __ATOMIC_RELAXED);
+}
+
+static int run_async(struct session_pool *pools, size_t tanks,
+		     size_t iterations, size_t invokers, uint64_t timeout_ns)
+{
+	/* Inside the rule of SOD_HYDROX_ON whatever the valve state */
+	static const int32_t in[4] = { 70, 4, 0, 0 };
+	struct async_invoker ai;
+	struct async_bench ab = { 0 };
+	uint64_t elapsed;
+	uint64_t t0;
+	size_t i;
+
+	ab.samples = calloc(iterations, sizeof(*ab.samples));
+	if (!ab.samples)
+		err(1, "calloc");
+	if (async_invoker_init(&ai, invokers) != TEEC_SUCCESS)
+		errx(1, "async_invoker_init");
+
+	t0 = bench_now_ns();
+	for (i = 0; i < iterations; i++)
+		if (async_submit(&ai, &pools[i % tanks],
+				 TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON, in,
+				 timeout_ns, async_bench_done, &ab,
+				 NULL) != TEEC_SUCCESS)
+			errx(1, "async_submit");
+	async_invoker_wait(&ai);
+	elapsed = bench_now_ns() - t0;
+
+	printf("%zu invokers, deadline %.0fus (0: none): %.0f commands/s, "
+	       "%lu accepted, %lu timed out, %lu failed\n", invokers,
+	       timeout_ns / 1e3, iterations / (elapsed / 1e9), ab.accepted,
+	       ai.timed_out, ai.failed);
+	bench_report("  submit->callback", ab.samples, iterations);
+
+	async_invoker_destroy(&ai);
+	free(ab.samples);
+	return ai.failed ? -1 : 0;
+}
+
+int bench_async(size_t iterations, size_t invokers)
+{
+	struct session_pool pools[BENCH_ASYNC_TANKS];
+	size_t i;
+	int ret = -1;
+
+	printf("Asynchronous submission, %zu commands over %d tanks\n",
+	       iterations, BENCH_ASYNC_TANKS);
+
+	for (i = 0; i < BENCH_ASYNC_TANKS; i++) {
+		if (session_pool_init(&pools[i], i, invokers, 1) !=
+		    TEEC_SUCCESS) {
+			while (i--)
+				session_pool_destroy(&pools[i]);
+			return -1;
+		}
+	}
+
+	/* Everything completes, then a deadline tight enough to miss */
+	if (!run_async(pools, BENCH_ASYNC_TANKS, iterations, invokers, 0) &&
+	    !run_async(pools, BENCH_ASYNC_TANKS, iterations, invokers,
+		       BENCH_ASYNC_DEADLINE_NS))
+		ret = 0;
+
+	for (i = 0; i < BENCH_ASYNC_TANKS; i++)
+		session_pool_destroy(&pools[i]);
+	return ret;
+}
+
+/* Polls a pump command whose readings change every tenth poll */
+static int run_polls(struct dedup_cache *c, uint64_t *samples,
+		     uint32_t *replies, size_t iterations)
+{
+	struct session_pool pool;
+	struct test_ctx *tee;
+	TEEC_Operation op;
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	uint64_t t0;
+	size_t i;
+
+	if (session_pool_init(&pool, 0, 1, 1) != TEEC_SUCCESS)
+		return -1;
+	tee = session_pool_acquire(&pool);
+	if (!tee) {
+		session_pool_destroy(&pool);
+		return -1;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT);
+		op.params[0].value.a = 70;
+		op.params[1].value.a = (i / 10) % 15;
+		op.params[2].value.a = 0;
+		op.params[3].value.a = (i / 40) & 1;
+
+		t0 = bench_now_ns();
+		res = dedup_invoke(c, 0, &tee->sess,
+				   TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON, &op,
+				   &origin);
+		samples[i] = bench_now_ns() - t0;
+		if (res != TEEC_SUCCESS)
+			break;
+		replies[i] = op.params[1].value.a | op.params[3].value.a << 16;
+	}
+
+	session_pool_release(&pool, tee, res, origin);
+	session_pool_destroy(&pool);
+	return res == TEEC_SUCCESS ? 0 : -1;
+}
+
+int bench_dedup(size_t iterations, size_t cache_size)
+{
+	struct dedup_cache c;
+	uint64_t *samples;
+	uint32_t *plain;
+	uint32_t *cached;
+	int ret = -1;
+
+	samples = calloc(iterations, sizeof(*samples));
+	plain = calloc(iterations, sizeof(*plain));
+	cached = calloc(iterations, sizeof(*cached));
+	if (!samples || !plain || !cached || dedup_cache_init(&c, cache_size))
+		err(1, "calloc");
+
+	printf("Repeated polls, %zu pump commands\n", iterations);
+
+	if (run_polls(NULL, samples, plain, iterations))
+		goto out;
+	bench_report("every poll invoked", samples, iterations);
+
+	if (run_polls(&c, samples, cached, iterations))
+		goto out;
+	bench_report("decision cache", samples, iterations);
+	dedup_cache_report(&c);
+
+	if (memcmp(plain, cached, iterations * sizeof(*plain))) {
+		warnx("cached replies differ from the TA's");
+		goto out;
+	}
+	ret = 0;
+out:
+	dedup_cache_destroy(&c);
+	free(cached);
+	free(plain);
+	free(samples);
+	return ret;
+}
+
+/* Readings a control tick may see, the demo's good and failing cases */
+static const int32_t control_readings[][4] = {
+	{ 70, 4, 0, 0 }, { 70, 7, 1, 0 }, { 70, 10, 0, 0 }, { 70, 7, 0, 1 },
+	{ 70, 7, 1, 1 }, { -60, 4, 0, 0 }, { 20, 4, 0, 0 }, { 95, 12, 0, 0 },
+};
+
+#define CONTROL_READINGS \
+	(sizeof(control_readings) / sizeof(control_readings[0]))
+
+/*
+ * The way call_function() settles a tank: every pump command in turn,
+ * each on a session of its own, tracking the valves from the replies.
+ */
+static TEEC_Result settle_by_commands(struct session_pool *pool,
+				      const int32_t in[4], uint32_t valves[2])
+{
+	static const uint32_t cmds[] = {
+		TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON,
+		TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF,
+		TA_WATER_TREATMENT_CMD_ACID_ON,
+		TA_WATER_TREATMENT_CMD_ACID_OFF,
+	};
+	struct test_ctx *tee;
+	TEEC_Operation op;
+	uint32_t origin = 0;
+	TEEC_Result res;
+	size_t c;
+	int out;
+	int k;
+
+	for (c = 0; c < 4; c++) {
+		tee = session_pool_acquire(pool);
+		if (!tee)
+			return TEEC_ERROR_COMMUNICATION;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INOUT);
+		for (k = 0; k < 4; k++)
+			op.params[k].value.a = in[k];
+		res = TEEC_InvokeCommand(&tee->sess, cmds[c], &op, &origin);
+		session_pool_release(pool, tee, res, origin);
+		if (res != TEEC_SUCCESS)
+			return res;
+
+		/* Accepted when everything but the state slot came back 0 */
+		out = c < 2 ? 3 : 2;
+		for (k = 0; k < 4; k++)
+			if (k != out && op.params[k].value.a)
+				break;
+		if (k == 4)
+			valves[c < 2 ? 0 : 1] = op.params[out].value.a;
+	}
+
+	return TEEC_SUCCESS;
+}
+
+int bench_control(size_t iterations)
+{
+	struct session_pool commands;
+	struct session_pool control;
+	struct control_reply reply;
+	struct test_ctx *tee;
+	uint64_t *samples;
+	uint32_t valves[2] = { 0, 0 };
+	uint32_t origin = 0;
+	TEEC_Result res = TEEC_SUCCESS;
+	const int32_t *in;
+	uint64_t t0;
+	size_t i;
+	int ret = -1;
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples)
+		err(1, "calloc");
+
+	/* Separate tanks so both start with both valves off */
+	if (session_pool_init(&commands, 1, 1, 1) != TEEC_SUCCESS)
+		goto out_free;
+	if (session_pool_init(&control, 2, 1, 1) != TEEC_SUCCESS)
+		goto out_commands;
+
+	printf("Settling a tank, %zu control ticks\n", iterations);
+
+	for (i = 0; i < iterations; i++) {
+		in = control_readings[i % CONTROL_READINGS];
+		t0 = bench_now_ns();
+		res = settle_by_commands(&commands, in, valves);
+		samples[i] = bench_now_ns() - t0;
+		if (res != TEEC_SUCCESS)
+			goto out;
+	}
+	bench_report("four pump commands", samples, iterations);
+
+	memset(valves, 0, sizeof(valves));
+	for (i = 0; i < iterations; i++) {
+		in = control_readings[i % CONTROL_READINGS];
+
+		t0 = bench_now_ns();
+		tee = session_pool_acquire(&control);
+		if (!tee)
+			goto out;
+		res = control_tank(tee, in[0], in[1], in[2], in[3], &reply,
+				   &origin);
+		session_pool_release(&control, tee, res, origin);
+		samples[i] = bench_now_ns() - t0;
+		if (res != TEEC_SUCCESS)
+			goto out;
+
+		/* Same rules, so the same valves as the four commands */
+		settle_by_commands(&commands, in, valves);
+		if (reply.sod_hydrox != valves[0] || reply.acid != valves[1]) {
+			warnx("CONTROL disagrees with the pump commands on tick %zu",
+			      i);
+			goto out;
+		}
+	}
+	bench_report("one CONTROL", samples, iterations);
+	ret = 0;
+
+out:
+	session_pool_destroy(&control);
+out_commands:
+	session_pool_destroy(&commands);
+out_free:
+	free(samples);
+	return ret;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "session_pool.h"
+
+/* Monotonic clock in nanoseconds */
+uint64_t bench_now_ns(void);
+
+/* Prints min/avg/p50/p99/max of samples, sorting them in place */
+void bench_report(const char *label, uint64_t *samples_ns, size_t n);
+
+/*
+ * Runs the same pump command iterations times, first with a session
+ * opened and closed around every command, then through a pool of
+ * pool_size reused sessions.
+ */
+int bench_session_reuse(size_t iterations, size_t pool_size);
+
+/*
+ * Evaluates total samples on one pooled session, first with one pump
+ * command per sample, then batch_size samples per EVALUATE_BATCH invoke.
+ */
+int bench_batch(size_t total, size_t batch_size);
+
+/*
+ * Evaluates total samples batch_size at a time without and with HMAC
+ * authentication, and one per authenticated batch, then checks that a
+ * tampered and a replayed batch are refused, and that a tank opened
+ * WT_SESSION_SIGNED_ONLY refuses unsigned readings.
+ */
+int bench_auth(size_t total, size_t batch_size);
+
+/*
+ * Streams total samples through a shared ring of ring_size slots,
+ * draining whenever it fills up, and reports records per second and
+ * records per world switch.
+ */
+int bench_ring(size_t total, uint32_t ring_size);
+
+/*
+ * Runs 1, 2, 4 ... max_tanks threads at once, each with its own session
+ * for its own tank switching a pump iterations times, and reports how
+ * aggregate throughput and latency scale with the number of sessions.
+ */
+int bench_tanks(size_t iterations, size_t max_tanks);
+
+/*
+ * Submits iterations pump commands through async_submit() to a few tanks
+ * and has invokers threads complete them, once without a deadline and
+ * once with one short enough that some get cancelled.
+ */
+int bench_async(size_t iterations, size_t invokers);
+
+/*
+ * Polls the same pump command iterations times with readings that only
+ * change every few polls, without and then with a cache_size entry
+ * decision cache, and checks both runs got the same replies.
+ */
+int bench_dedup(size_t iterations, size_t cache_size);
+
+/*
+ * Settles a tank iterations times, first by trying all four pump
+ * commands like call_function() would and then with one CONTROL invoke,
+ * and checks both leave the valves in the same state.
+ */
+int bench_control(size_t iterations);
+
+#endif /* BENCH_H */
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "channels.h"
+#include "metrics.h"
+
+TEEC_Result actuate(struct test_ctx *ctx, uint32_t act, int on,
+		    const struct wt_reading *readings, size_t n,
+		    struct actuate_reply *reply, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT);
+	op.params[0].value.a = act;
+	op.params[0].value.b = !!on;
+	op.params[1].tmpref.buffer = (void *)readings;
+	op.params[1].tmpref.size = n * sizeof(*readings);
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_ACTUATE,
+				 &op, &origin);
+	metrics_command(TA_WATER_TREATMENT_CMD_ACTUATE, res);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	reply->reject = op.params[2].value.a;
+	metrics_verdict(metrics_reject_verdict(reply->reject), 1);
+	reply->epoch = op.params[2].value.b;
+	reply->word = (uint64_t)op.params[3].value.b << 32 |
+		      op.params[3].value.a;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result describe_channels(struct test_ctx *ctx,
+			      struct wt_sensor_info *sensors,
+			      size_t max_sensors,
+			      struct wt_actuator_info *actuators,
+			      size_t max_actuators, size_t *n_sensors,
+			      size_t *n_actuators, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_NONE);
+	op.params[0].tmpref.buffer = sensors;
+	op.params[0].tmpref.size = max_sensors * sizeof(*sensors);
+	op.params[1].tmpref.buffer = actuators;
+	op.params[1].tmpref.size = max_actuators * sizeof(*actuators);
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_DESCRIBE,
+				 &op, &origin);
+	*n_sensors = op.params[2].value.a;
+	*n_actuators = op.params[2].value.b;
+	if (res != TEEC_SUCCESS && res != TEEC_ERROR_SHORT_BUFFER) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+	}
+	return res;
+}
+
+static const char *const sensor_names[] = {
+	[WT_SENSOR_TEMP]		= "temperature",
+	[WT_SENSOR_PH]			= "pH",
+	[WT_SENSOR_ACID_FLOW]		= "acid flow",
+	[WT_SENSOR_SOD_HYDROX_FLOW]	= "sodium hydroxide flow",
+	[WT_SENSOR_CHLORINE]		= "chlorine residual",
+	[WT_SENSOR_TURBIDITY]		= "turbidity",
+	[WT_SENSOR_INFLOW]		= "inflow",
+	[WT_SENSOR_CHLORINE_FLOW]	= "chlorine doser flow",
+	[WT_SENSOR_COAGULANT_FLOW]	= "coagulant pump flow",
+};
+
+static const char *const actuator_names[] = {
+	[WT_ACT_SOD_HYDROX]	= "sodium hydroxide valve",
+	[WT_ACT_ACID]		= "acid valve",
+	[WT_ACT_CHLORINE]	= "chlorine doser",
+	[WT_ACT_COAGULANT]	= "coagulant pump",
+};
+
+static const char *channel_name(const char *const *names, size_t count,
+				size_t id)
+{
+	return id < count && names[id] ? names[id] : "?";
+}
+
+#define SENSOR_NAME(id) \
+	channel_name(sensor_names, \
+		     sizeof(sensor_names) / sizeof(sensor_names[0]), (id))
+#define ACTUATOR_NAME(id) \
+	channel_name(actuator_names, \
+		     sizeof(actuator_names) / sizeof(actuator_names[0]), (id))
+
+/* Test cases for the channels the pump commands cannot reach */
+static const struct channel_test {
+	uint32_t act;
+	int on;
+	size_t n;
+	struct wt_reading readings[4];
+	uint32_t expect;	/* WT_REJECT_* */
+} channel_test_vals[] = {
+	{ WT_ACT_CHLORINE, 1, 3, { { WT_SENSOR_CHLORINE, 20 },
+				   { WT_SENSOR_INFLOW, 800 },
+				   { WT_SENSOR_CHLORINE_FLOW, 0 } },
+	  WT_REJECT_NONE },
+	{ WT_ACT_CHLORINE, 0, 2, { { WT_SENSOR_CHLORINE, 120 },
+				   { WT_SENSOR_CHLORINE_FLOW, 1 } },
+	  WT_REJECT_ARGS_OOB },
+	{ WT_ACT_CHLORINE, 0, 2, { { WT_SENSOR_CHLORINE, 230 },
+				   { WT_SENSOR_CHLORINE_FLOW, 1 } },
+	  WT_REJECT_NONE },
+	{ WT_ACT_COAGULANT, 1, 2, { { WT_SENSOR_TURBIDITY, 85 },
+				    { WT_SENSOR_COAGULANT_FLOW, 0 } },
+	  WT_REJECT_MISSING },
+	{ WT_ACT_COAGULANT, 1, 3, { { WT_SENSOR_TURBIDITY, 85 },
+				    { WT_SENSOR_INFLOW, 800 },
+				    { WT_SENSOR_COAGULANT_FLOW, 0 } },
+	  WT_REJECT_NONE },
+	{ WT_ACT_COAGULANT, 0, 2, { { WT_SENSOR_TURBIDITY, 4000 },
+				    { WT_SENSOR_COAGULANT_FLOW, 1 } },
+	  WT_REJECT_DEVICE_LIMITS },
+	{ WT_ACT_SOD_HYDROX, 1, 4, { { WT_SENSOR_TEMP, 70 },
+				     { WT_SENSOR_PH, 3 },
+				     { WT_SENSOR_ACID_FLOW, 0 },
+				     { WT_SENSOR_SOD_HYDROX_FLOW, 0 } },
+	  WT_REJECT_NONE },
+};
+
+static void print_channels(const struct wt_sensor_info *sensors, size_t ns,
+			   const struct wt_actuator_info *actuators, size_t na)
+{
+	size_t i;
+	uint32_t k;
+
+	printf("Sensors\n");
+	for (i = 0; i < ns; i++)
+		printf("  %2zu %-22s %6d .. %d\n", i, SENSOR_NAME(i),
+		       sensors[i].min, sensors[i].max);
+
+	printf("Actuators\n");
+	for (i = 0; i < na; i++) {
+		printf("  %2zu %-22s on reads", i, ACTUATOR_NAME(i));
+		for (k = 0; k < actuators[i].on_terms; k++)
+			printf(" %u", actuators[i].on_sensors[k]);
+		printf(", off reads");
+		for (k = 0; k < actuators[i].off_terms; k++)
+			printf(" %u", actuators[i].off_sensors[k]);
+		printf("\n");
+	}
+}
+
+int channel_tests(struct session_pool *pool)
+{
+	struct wt_sensor_info sensors[WT_SENSORS_MAX];
+	struct wt_actuator_info actuators[WT_ACTUATORS_MAX];
+	const struct channel_test *t;
+	struct actuate_reply reply;
+	struct test_ctx *tee;
+	size_t ns, na;
+	uint32_t origin = 0;
+	TEEC_Result res;
+	size_t failed = 0;
+	size_t i, k;
+
+	tee = session_pool_acquire(pool);
+	if (!tee)
+		return -1;
+
+	res = describe_channels(tee, sensors, WT_SENSORS_MAX, actuators,
+				WT_ACTUATORS_MAX, &ns, &na, &origin);
+	if (res != TEEC_SUCCESS)
+		goto out;
+	print_channels(sensors, ns, actuators, na);
+
+	printf("\nChannel tests\n\n");
+	for (i = 0; i < sizeof(channel_test_vals) /
+			sizeof(channel_test_vals[0]); i++) {
+		t = &channel_test_vals[i];
+
+		printf("Test case %zu: %s %s,", i + 1, ACTUATOR_NAME(t->act),
+		       t->on ? "on" : "off");
+		for (k = 0; k < t->n; k++)
+			printf(" %s=%d", SENSOR_NAME(t->readings[k].sensor),
+			       t->readings[k].value);
+		printf("\n");
+
+		res = actuate(tee, t->act, t->on, t->readings, t->n, &reply,
+			      &origin);
+		if (res != TEEC_SUCCESS)
+			goto out;
+		printf("  reject %u, %s now %s%s\n", reply.reject,
+		       ACTUATOR_NAME(t->act),
+		       actuate_is_on(&reply, t->act) ? "on" : "off",
+		       reply.reject == t->expect ? "" : " (unexpected)");
+		failed += reply.reject != t->expect;
+	}
+
+out:
+	session_pool_release(pool, tee, res, origin);
+	if (res != TEEC_SUCCESS)
+		return -1;
+	return failed ? -1 : 0;
+}
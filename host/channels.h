@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* For struct wt_reading and the channel IDs */
+#include <water_treatment_ta.h>
+
+#include "session_pool.h"
+
+struct actuate_reply {
+	uint32_t reject;	/* WT_REJECT_* */
+	uint32_t epoch;		/* TA state epoch after the command */
+	uint64_t word;		/* actuator bitmask word holding act */
+};
+
+/*
+ * Asks the TA to switch actuator act on or off with one
+ * TA_WATER_TREATMENT_CMD_ACTUATE, given the readings its rules need.
+ */
+TEEC_Result actuate(struct test_ctx *ctx, uint32_t act, int on,
+		    const struct wt_reading *readings, size_t n,
+		    struct actuate_reply *reply, uint32_t *err_origin);
+
+/* Whether act is on according to a reply */
+static inline int actuate_is_on(const struct actuate_reply *reply,
+				uint32_t act)
+{
+	return (reply->word >> (act % 64)) & 1;
+}
+
+/*
+ * Copies the TA's channel table, up to max_sensors and max_actuators
+ * entries. The counts the TA has are returned either way.
+ */
+TEEC_Result describe_channels(struct test_ctx *ctx,
+			      struct wt_sensor_info *sensors,
+			      size_t max_sensors,
+			      struct wt_actuator_info *actuators,
+			      size_t max_actuators, size_t *n_sensors,
+			      size_t *n_actuators, uint32_t *err_origin);
+
+/* Prints the channel table and runs the channel test cases */
+int channel_tests(struct session_pool *pool);
+
+#endif /* CHANNELS_H */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "control_sched.h"
+#include "metrics.h"
+
+#define NSEC_PER_SEC	1000000000ULL
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static void ns_to_ts(uint64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts_to_ns(&ts);
+}
+
+void control_sched_init(struct control_sched *s, uint64_t period_ns,
+			enum ctl_policy policy)
+{
+	memset(s, 0, sizeof(*s));
+	s->period_ns = period_ns;
+	s->policy = policy;
+	s->jitter_min_ns = UINT64_MAX;
+	s->period_min_ns = UINT64_MAX;
+
+	s->last_wake_ns = now_ns();
+	ns_to_ts(s->last_wake_ns + period_ns, &s->deadline);
+}
+
+int control_sched_set_realtime(int priority)
+{
+	struct sched_param param = { .sched_priority = priority };
+	int ret;
+
+	/* A page fault in the loop costs more than a missed deadline */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		warn("mlockall");
+
+	ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (ret) {
+		warnx("SCHED_FIFO priority %d: %s", priority, strerror(ret));
+		return -1;
+	}
+	return 0;
+}
+
+void control_sched_wait(struct control_sched *s)
+{
+	uint64_t deadline = ts_to_ns(&s->deadline);
+	uint64_t now = now_ns();
+	uint64_t late;
+	int on_time = 1;
+
+	if (now > deadline) {
+		s->misses++;
+		metrics_count(METRIC_LOOP_MISSES, 1);
+		on_time = 0;
+		if (s->policy == CTL_SKIP) {
+			late = (now - deadline) / s->period_ns + 1;
+			s->skipped += late;
+			metrics_count(METRIC_LOOP_SKIPPED, late);
+			deadline += late * s->period_ns;
+			ns_to_ts(deadline, &s->deadline);
+			on_time = 1;
+		}
+	}
+
+	if (on_time) {
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &s->deadline, NULL) == EINTR)
+			;
+		now = now_ns();
+		late = now > deadline ? now - deadline : 0;
+		if (late < s->jitter_min_ns)
+			s->jitter_min_ns = late;
+		if (late > s->jitter_max_ns)
+			s->jitter_max_ns = late;
+		s->jitter_sum_ns += late;
+		s->jitter_n++;
+	}
+
+	if (now - s->last_wake_ns < s->period_min_ns)
+		s->period_min_ns = now - s->last_wake_ns;
+	if (now - s->last_wake_ns > s->period_max_ns)
+		s->period_max_ns = now - s->last_wake_ns;
+	s->period_sum_ns += now - s->last_wake_ns;
+	s->period_n++;
+	metrics_loop_period(now - s->last_wake_ns);
+	s->last_wake_ns = now;
+
+	s->ticks++;
+	metrics_count(METRIC_LOOP_TICKS, 1);
+	ns_to_ts(deadline + s->period_ns, &s->deadline);
+}
+
+void control_sched_report(const struct control_sched *s)
+{
+	printf("Control loop: period %.3fms, %lu ticks, %lu missed, %lu skipped\n",
+	       s->period_ns / 1e6, s->ticks, s->misses, s->skipped);
+	if (s->jitter_n)
+		printf("  wake-up jitter min=%.1fus avg=%.1fus max=%.1fus\n",
+		       s->jitter_min_ns / 1e3,
+		       s->jitter_sum_ns / (double)s->jitter_n / 1e3,
+		       s->jitter_max_ns / 1e3);
+	if (s->period_n)
+		printf("  loop period   min=%.3fms avg=%.3fms max=%.3fms\n",
+		       s->period_min_ns / 1e6,
+		       s->period_sum_ns / (double)s->period_n / 1e6,
+		       s->period_max_ns / 1e6);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef CONTROL_SCHED_H
+#define CONTROL_SCHED_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* What to do with deadlines that have already passed when we wake up */
+enum ctl_policy {
+	CTL_CATCH_UP,	/* run every missed tick back to back */
+	CTL_SKIP,	/* drop missed ticks and realign to the period grid */
+};
+
+/*
+ * Fixed-rate scheduler for the control loop. Deadlines sit on an
+ * absolute CLOCK_MONOTONIC grid (start + n * period) so time spent in the
+ * TA does not stretch the period the way a relative sleep would.
+ */
+struct control_sched {
+	uint64_t period_ns;
+	enum ctl_policy policy;
+	struct timespec deadline;	/* next absolute wake-up */
+	uint64_t last_wake_ns;
+
+	unsigned long ticks;		/* waits that returned */
+	unsigned long misses;		/* waits entered after their deadline */
+	unsigned long skipped;		/* ticks dropped by CTL_SKIP */
+	uint64_t jitter_min_ns;		/* wake-up lateness on on-time ticks */
+	uint64_t jitter_max_ns;
+	uint64_t jitter_sum_ns;
+	unsigned long jitter_n;
+	uint64_t period_min_ns;		/* measured wake-to-wake interval */
+	uint64_t period_max_ns;
+	uint64_t period_sum_ns;
+	unsigned long period_n;
+};
+
+void control_sched_init(struct control_sched *s, uint64_t period_ns,
+			enum ctl_policy policy);
+
+/* Switches the calling thread to SCHED_FIFO, returns 0 on success */
+int control_sched_set_realtime(int priority);
+
+/* Sleeps until the next deadline and advances it by one period */
+void control_sched_wait(struct control_sched *s);
+
+void control_sched_report(const struct control_sched *s);
+
+#endif /* CONTROL_SCHED_H */
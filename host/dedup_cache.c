@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dedup_cache.h"
+#include "metrics.h"
+
+int dedup_cache_init(struct dedup_cache *c, size_t size)
+{
+	size_t n = 1;
+
+	while (n < size)
+		n <<= 1;
+
+	c->entries = calloc(n, sizeof(*c->entries));
+	if (!c->entries)
+		return -1;
+	c->mask = n - 1;
+	c->have_epoch = 0;
+	c->inflight = 0;
+	c->answered = 0;
+	c->lookups = 0;
+	c->hits = 0;
+	pthread_mutex_init(&c->lock, NULL);
+	return 0;
+}
+
+void dedup_cache_destroy(struct dedup_cache *c)
+{
+	if (!c->entries)
+		return;
+	pthread_mutex_destroy(&c->lock);
+	free(c->entries);
+	c->entries = NULL;
+}
+
+static uint32_t key_hash(uint32_t tank_id, uint32_t cmd, const uint32_t in[4])
+{
+	uint32_t h = 2166136261u;
+	int k;
+
+	h = (h ^ tank_id) * 16777619u;
+	h = (h ^ cmd) * 16777619u;
+	for (k = 0; k < 4; k++)
+		h = (h ^ in[k]) * 16777619u;
+	return h ^ (h >> 15);
+}
+
+/* Whatever params[3] is, it is not part of a packed command */
+static int op_is_packed(const TEEC_Operation *op)
+{
+	return (op->paramTypes & 0xfff) == TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+							    TEEC_VALUE_INOUT,
+							    TEEC_NONE,
+							    TEEC_NONE);
+}
+
+static void op_key(const TEEC_Operation *op, int packed, uint32_t in[4])
+{
+	int k;
+
+	if (!packed) {
+		for (k = 0; k < 4; k++)
+			in[k] = op->params[k].value.a;
+		return;
+	}
+	in[0] = op->params[0].value.a;
+	in[1] = op->params[0].value.b;
+	in[2] = op->params[1].value.b;	/* tank ID */
+	in[3] = 0;
+}
+
+static void op_reply_save(const TEEC_Operation *op, int packed,
+			  uint32_t out[4])
+{
+	int k;
+
+	if (!packed) {
+		for (k = 0; k < 4; k++)
+			out[k] = op->params[k].value.a;
+		return;
+	}
+	out[0] = op->params[0].value.a;
+	out[1] = op->params[1].value.b;
+	out[2] = 0;
+	out[3] = 0;
+}
+
+static void op_reply_restore(TEEC_Operation *op, int packed,
+			     const uint32_t out[4])
+{
+	int k;
+
+	if (!packed) {
+		for (k = 0; k < 4; k++)
+			op->params[k].value.a = out[k];
+		return;
+	}
+	op->params[0].value.a = out[0];
+	op->params[1].value.b = out[1];
+}
+
+static int key_equal(const struct dedup_entry *e, uint32_t tank_id,
+		     uint32_t cmd, const uint32_t in[4])
+{
+	return e->valid && e->tank_id == tank_id && e->cmd == cmd &&
+	       e->in[0] == in[0] && e->in[1] == in[1] &&
+	       e->in[2] == in[2] && e->in[3] == in[3];
+}
+
+TEEC_Result dedup_invoke(struct dedup_cache *c, uint32_t tank_id,
+			 TEEC_Session *sess, uint32_t cmd, TEEC_Operation *op,
+			 uint32_t *origin)
+{
+	struct dedup_entry *e;
+	unsigned long answered;
+	uint32_t in[4];
+	TEEC_Result res;
+	int packed;
+
+	if (!c) {
+		res = TEEC_InvokeCommand(sess, cmd, op, origin);
+		metrics_command(cmd, res);
+		return res;
+	}
+
+	packed = op_is_packed(op);
+	op_key(op, packed, in);
+	e = &c->entries[key_hash(tank_id, cmd | (packed ? DEDUP_PACKED : 0),
+				 in) & c->mask];
+
+	pthread_mutex_lock(&c->lock);
+	c->lookups++;
+	if (c->have_epoch && e->epoch == c->epoch &&
+	    key_equal(e, tank_id, cmd | (packed ? DEDUP_PACKED : 0), in)) {
+		c->hits++;
+		op_reply_restore(op, packed, e->out);
+		op->params[0].value.b = e->epoch;
+		pthread_mutex_unlock(&c->lock);
+		metrics_count(METRIC_CACHE_HITS, 1);
+		if (origin)
+			*origin = TEEC_ORIGIN_TRUSTED_APP;
+		return TEEC_SUCCESS;
+	}
+	c->inflight++;
+	answered = c->answered;
+	pthread_mutex_unlock(&c->lock);
+
+	res = TEEC_InvokeCommand(sess, cmd, op, origin);
+	metrics_command(cmd, res);
+
+	pthread_mutex_lock(&c->lock);
+	c->inflight--;
+	c->answered++;
+	if (res != TEEC_SUCCESS) {
+		pthread_mutex_unlock(&c->lock);
+		return res;
+	}
+	if (c->inflight || c->answered != answered + 1) {
+		/* Cannot tell whether this epoch is older than c->epoch */
+		c->have_epoch = 0;
+		pthread_mutex_unlock(&c->lock);
+		return TEEC_SUCCESS;
+	}
+
+	c->epoch = op->params[0].value.b;
+	c->have_epoch = 1;
+	e->valid = 1;
+	e->tank_id = tank_id;
+	e->cmd = cmd | (packed ? DEDUP_PACKED : 0);
+	e->epoch = c->epoch;
+	memcpy(e->in, in, sizeof(e->in));
+	op_reply_save(op, packed, e->out);
+	pthread_mutex_unlock(&c->lock);
+
+	return TEEC_SUCCESS;
+}
+
+void dedup_cache_report(struct dedup_cache *c)
+{
+	pthread_mutex_lock(&c->lock);
+	printf("Decision cache: %lu lookups, %lu hits (%.1f%%), "
+	       "%lu world switches saved\n", c->lookups, c->hits,
+	       c->lookups ? 100.0 * c->hits / c->lookups : 0.0, c->hits);
+	pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef DEDUP_CACHE_H
+#define DEDUP_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+struct dedup_entry {
+	uint32_t valid;
+	uint32_t tank_id;
+	uint32_t cmd;		/* DEDUP_PACKED set for the packed encoding */
+	uint32_t in[4];		/* readings as the TA sees them */
+	uint32_t epoch;		/* TA state epoch the reply was given in */
+	uint32_t out[4];	/* params[0..3].value.a of the reply, packed
+				   the verdict and valve state */
+};
+
+#define DEDUP_PACKED		0x80000000u
+
+/*
+ * Remembers the TA's reply to pump commands. The readings are keyed the
+ * way the TA quantizes them, as the uint32_t it receives, so a hit can
+ * never change a verdict. The pump state needs no key of its own: every
+ * reply carries the TA's state epoch, which moves whenever a valve does,
+ * and only entries from the latest epoch seen are used. Replies to
+ * invokes that overlapped others may arrive out of order, so those empty
+ * the cache instead. Another process moving a valve is only noticed on
+ * this cache's next miss. Packed commands are keyed without their
+ * sequence number, a hit hands back the one the command was sent with.
+ */
+struct dedup_cache {
+	struct dedup_entry *entries;	/* direct mapped */
+	uint32_t mask;
+	uint32_t epoch;			/* latest epoch the TA returned */
+	int have_epoch;
+	unsigned long inflight;		/* invokes not yet answered */
+	unsigned long answered;		/* invokes answered so far */
+	pthread_mutex_t lock;
+	unsigned long lookups;
+	unsigned long hits;		/* world switches saved */
+};
+
+/* size is rounded up to a power of two */
+int dedup_cache_init(struct dedup_cache *c, size_t size);
+void dedup_cache_destroy(struct dedup_cache *c);
+
+/*
+ * Drop-in for TEEC_InvokeCommand() on pump commands of tank_id's session.
+ * Answers from the cache when it can, otherwise invokes the TA and
+ * remembers its reply. c may be NULL to always invoke. Counts the
+ * invokes with metrics_command() and the rest as METRIC_CACHE_HITS.
+ */
+TEEC_Result dedup_invoke(struct dedup_cache *c, uint32_t tank_id,
+			 TEEC_Session *sess, uint32_t cmd, TEEC_Operation *op,
+			 uint32_t *origin);
+
+void dedup_cache_report(struct dedup_cache *c);
+
+#endif /* DEDUP_CACHE_H */
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "events.h"
+
+TEEC_Result set_ta_log_level(struct test_ctx *ctx, uint32_t level,
+			     uint32_t *prev, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = level;
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 TA_WATER_TREATMENT_CMD_SET_LOG_LEVEL, &op,
+				 &origin);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	if (prev)
+		*prev = op.params[1].value.a;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result read_ta_events(struct test_ctx *ctx, struct wt_event *events,
+			   size_t max, size_t *n, uint32_t *lost,
+			   uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_NONE,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = events;
+	op.params[0].tmpref.size = max * sizeof(*events);
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 TA_WATER_TREATMENT_CMD_READ_EVENTS, &op,
+				 &origin);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	*n = op.params[1].value.a;
+	if (lost)
+		*lost = op.params[1].value.b;
+	return TEEC_SUCCESS;
+}
+
+const char *ta_cmd_name(uint32_t cmd)
+{
+	switch (cmd) {
+	case TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON:
+		return "SOD_HYDROX_ON";
+	case TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF:
+		return "SOD_HYDROX_OFF";
+	case TA_WATER_TREATMENT_CMD_ACID_ON:
+		return "ACID_ON";
+	case TA_WATER_TREATMENT_CMD_ACID_OFF:
+		return "ACID_OFF";
+	case TA_WATER_TREATMENT_CMD_PING:
+		return "PING";
+	case TA_WATER_TREATMENT_CMD_EVALUATE_BATCH:
+		return "EVALUATE_BATCH";
+	case TA_WATER_TREATMENT_CMD_DRAIN:
+		return "DRAIN";
+	case TA_WATER_TREATMENT_CMD_READ_EVENTS:
+		return "READ_EVENTS";
+	case TA_WATER_TREATMENT_CMD_SET_LOG_LEVEL:
+		return "SET_LOG_LEVEL";
+	case TA_WATER_TREATMENT_CMD_GET_STATS:
+		return "GET_STATS";
+	case TA_WATER_TREATMENT_CMD_CONTROL:
+		return "CONTROL";
+	case TA_WATER_TREATMENT_CMD_PH_CHECK:
+		return "PH_CHECK";
+	case TA_WATER_TREATMENT_CMD_DOSE:
+		return "DOSE";
+	case TA_WATER_TREATMENT_CMD_AUTH_BATCH:
+		return "AUTH_BATCH";
+	case TA_WATER_TREATMENT_CMD_ACTUATE:
+		return "ACTUATE";
+	case TA_WATER_TREATMENT_CMD_DESCRIBE:
+		return "DESCRIBE";
+	default:
+		return "?";
+	}
+}
+
+static const char *reject_name(uint32_t reject)
+{
+	switch (reject) {
+	case WT_REJECT_NONE:
+		return "accepted";
+	case WT_REJECT_DEVICE_LIMITS:
+		return "device limits exceeded";
+	case WT_REJECT_ARGS_OOB:
+		return "function arguments OOB";
+	case WT_REJECT_MISSING:
+		return "reading missing";
+	default:
+		return "?";
+	}
+}
+
+TEEC_Result dump_ta_events(struct test_ctx *ctx, uint32_t *err_origin)
+{
+	struct wt_event events[16];
+	uint32_t lost;
+	TEEC_Result res;
+	size_t n;
+	size_t i;
+
+	printf("TA event log\n");
+	do {
+		res = read_ta_events(ctx, events, 16, &n, &lost, err_origin);
+		if (res != TEEC_SUCCESS)
+			return res;
+		if (lost)
+			printf("  (%u events lost)\n", lost);
+
+		for (i = 0; i < n; i++)
+			printf("  #%-4u %10" PRIu64 "ms tank %-3u %-14s temp=%d "
+			       "ph=%d acid=%d sh=%d -> %s, valve %u\n",
+			       events[i].seq, events[i].timestamp,
+			       events[i].tank, ta_cmd_name(events[i].cmd),
+			       events[i].in[0],
+			       events[i].in[1], events[i].in[2],
+			       events[i].in[3], reject_name(events[i].reject),
+			       events[i].state);
+	} while (n == 16);
+
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result read_ta_stats(struct test_ctx *ctx, struct wt_stats *stats,
+			  uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = stats;
+	op.params[0].tmpref.size = sizeof(*stats);
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_GET_STATS,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	return TEEC_SUCCESS;
+}
+
+void print_ta_stats(const struct wt_stats *stats)
+{
+	const struct wt_cmd_stats *s;
+	uint64_t invokes;
+	uint32_t cmd;
+	uint32_t b;
+
+	printf("TA statistics, up %" PRIu64 " ms\n", stats->uptime_ms);
+	printf("  %-14s %10s %10s %10s %10s %10s  time (ms: invokes)\n",
+	       "command", "accepted", "limits", "args OOB", "bad params",
+	       "errors");
+
+	for (cmd = 0; cmd < stats->cmds && cmd < WT_STATS_CMDS; cmd++) {
+		s = &stats->cmd[cmd];
+		invokes = 0;
+		for (b = 0; b < WT_STATS_BUCKETS; b++)
+			invokes += s->time_ms[b];
+		if (!invokes)
+			continue;
+
+		printf("  %-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+		       " %10" PRIu64 " %10" PRIu64 " ",
+		       ta_cmd_name(cmd), s->accepted, s->device_limits,
+		       s->args_oob, s->bad_params, s->errors);
+		for (b = 0; b < WT_STATS_BUCKETS; b++) {
+			if (!s->time_ms[b])
+				continue;
+			/* Lower bound of the bucket, see WT_STATS_BUCKETS */
+			printf(" %s%u:%" PRIu64,
+			       b == WT_STATS_BUCKETS - 1 ? ">=" : "",
+			       b ? 1u << (b - 1) : 0, s->time_ms[b]);
+		}
+		printf("\n");
+	}
+}
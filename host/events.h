@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* For struct wt_event and struct wt_stats */
+#include <water_treatment_ta.h>
+
+#include "session_pool.h"
+
+/* Sets the TA's secure log level, *prev (if not NULL) gets the old one */
+TEEC_Result set_ta_log_level(struct test_ctx *ctx, uint32_t level,
+			     uint32_t *prev, uint32_t *err_origin);
+
+/*
+ * Pulls up to max events out of the TA's event ring. *n receives the
+ * number copied and *lost the events overwritten before this read.
+ */
+TEEC_Result read_ta_events(struct test_ctx *ctx, struct wt_event *events,
+			   size_t max, size_t *n, uint32_t *lost,
+			   uint32_t *err_origin);
+
+/* Reads the TA's event ring until it is empty and prints every event */
+TEEC_Result dump_ta_events(struct test_ctx *ctx, uint32_t *err_origin);
+
+/* Name of a TA_WATER_TREATMENT_CMD_* ID, "?" for unknown ones */
+const char *ta_cmd_name(uint32_t cmd);
+
+/* Copies the TA's counters and in-TA time histograms */
+TEEC_Result read_ta_stats(struct test_ctx *ctx, struct wt_stats *stats,
+			  uint32_t *err_origin);
+
+/* One line per command that has been invoked at least once */
+void print_ta_stats(const struct wt_stats *stats);
+
+#endif /* EVENTS_H */
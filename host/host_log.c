@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "host_log.h"
+
+/* Records in flight, a cell is 256 bytes */
+#define HLOG_QUEUE_SIZE		1024
+
+struct hlog_cell {
+	uint64_t seq;
+	struct hlog_bin_record hdr;
+	char text[HLOG_TEXT_MAX];
+};
+
+/*
+ * Same sequence numbered cells as struct mpsc_queue, except that a
+ * producer formats in place into the cell it claimed, which is its own
+ * until it publishes it.
+ */
+static struct {
+	uint64_t head __attribute__((aligned(64)));	/* next claim */
+	uint64_t tail __attribute__((aligned(64)));	/* next write */
+	uint64_t written;	/* records out of the queue */
+	struct hlog_cell *cells;
+	uint64_t mask;
+	int running;
+	int producers;		/* queueing or at the file, see hlog_stop() */
+	int stopping;
+	int sleeping;
+	sem_t wake;
+	pthread_t writer;
+	FILE *bin;
+	enum hlog_level level;
+	uint32_t threads;
+	unsigned long dropped;
+	unsigned long dropped_seen;	/* writer only */
+} lg = { .level = HLOG_INFO };
+
+static __thread uint32_t thread_no;
+
+static void writer_wake(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&lg.sleeping, __ATOMIC_RELAXED) &&
+	    __atomic_exchange_n(&lg.sleeping, 0, __ATOMIC_SEQ_CST))
+		sem_post(&lg.wake);
+}
+
+static int queue_ready(void)
+{
+	struct hlog_cell *cell = &lg.cells[lg.tail & lg.mask];
+
+	return __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == lg.tail + 1;
+}
+
+static void writer_sleep(void)
+{
+	__atomic_store_n(&lg.sleeping, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (queue_ready() ||
+	    __atomic_load_n(&lg.stopping, __ATOMIC_RELAXED)) {
+		if (__atomic_exchange_n(&lg.sleeping, 0, __ATOMIC_SEQ_CST))
+			return;
+	}
+
+	while (sem_wait(&lg.wake) && errno == EINTR)
+		;
+}
+
+static void emit(const struct hlog_bin_record *hdr, const char *text)
+{
+	FILE *bin;
+
+	/* Counted while it holds the file, see hlog_stop() */
+	__atomic_add_fetch(&lg.producers, 1, __ATOMIC_SEQ_CST);
+	bin = __atomic_load_n(&lg.bin, __ATOMIC_SEQ_CST);
+	if (bin) {
+		/* The writer and a producer logging synchronously may meet */
+		flockfile(bin);
+		fwrite(hdr, sizeof(*hdr), 1, bin);
+		fwrite(text, 1, hdr->len, bin);
+		funlockfile(bin);
+	}
+	__atomic_sub_fetch(&lg.producers, 1, __ATOMIC_RELEASE);
+	if (bin)
+		return;
+	fwrite(text, 1, hdr->len, hdr->level == HLOG_ERROR ? stderr : stdout);
+}
+
+static void emit_dropped(void)
+{
+	unsigned long dropped = __atomic_load_n(&lg.dropped, __ATOMIC_RELAXED);
+	struct hlog_bin_record hdr = { .level = HLOG_WARN };
+	char text[64];
+	int len;
+
+	if (dropped == lg.dropped_seen)
+		return;
+
+	len = snprintf(text, sizeof(text), "(%lu log records dropped)\n",
+		       dropped - lg.dropped_seen);
+	lg.dropped_seen = dropped;
+	hdr.timestamp_ns = bench_now_ns();
+	hdr.len = len;
+	emit(&hdr, text);
+}
+
+static void *writer_run(void *arg)
+{
+	struct hlog_cell *cell;
+	size_t n;
+
+	(void)arg;
+
+	for (;;) {
+		for (n = 0; queue_ready(); n++) {
+			cell = &lg.cells[lg.tail & lg.mask];
+			emit(&cell->hdr, cell->text);
+			__atomic_store_n(&cell->seq, lg.tail + lg.mask + 1,
+					 __ATOMIC_RELEASE);
+			lg.tail++;
+		}
+		if (n) {
+			emit_dropped();
+			/* One flush per burst, not per record */
+			fflush(lg.bin ? lg.bin : stdout);
+			fflush(stderr);
+			__atomic_store_n(&lg.written, lg.tail,
+					 __ATOMIC_RELEASE);
+			continue;
+		}
+
+		/*
+		 * Every record was published before stopping was set, but
+		 * maybe after the queue was last looked at.
+		 */
+		if (__atomic_load_n(&lg.stopping, __ATOMIC_ACQUIRE)) {
+			if (queue_ready())
+				continue;
+			break;
+		}
+		writer_sleep();
+	}
+
+	emit_dropped();
+	return NULL;
+}
+
+static struct hlog_cell *claim(uint64_t *claimed)
+{
+	uint64_t pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+	struct hlog_cell *cell;
+	int64_t diff;
+
+	for (;;) {
+		cell = &lg.cells[pos & lg.mask];
+		diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+				 pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&lg.head, &pos, pos + 1,
+							1, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	*claimed = pos;
+	return cell;
+}
+
+static void vlog(enum hlog_level level, const char *fmt, va_list ap)
+{
+	struct hlog_bin_record hdr;
+	struct hlog_cell *cell;
+	char text[HLOG_TEXT_MAX];
+	uint64_t pos;
+	int len;
+
+	if (!thread_no)
+		thread_no = __atomic_add_fetch(&lg.threads, 1,
+					       __ATOMIC_RELAXED);
+
+	hdr.timestamp_ns = bench_now_ns();
+	hdr.thread = thread_no;
+	hdr.level = level;
+
+	/*
+	 * Counted before running is read, hlog_stop() waits for us. Not
+	 * while formatting a synchronous record, so that busy threads
+	 * cannot keep it waiting.
+	 */
+	__atomic_add_fetch(&lg.producers, 1, __ATOMIC_SEQ_CST);
+
+	if (!__atomic_load_n(&lg.running, __ATOMIC_SEQ_CST)) {
+		__atomic_sub_fetch(&lg.producers, 1, __ATOMIC_RELEASE);
+		len = vsnprintf(text, sizeof(text), fmt, ap);
+		hdr.len = len < 0 ? 0 : len >= HLOG_TEXT_MAX ?
+			  HLOG_TEXT_MAX - 1 : len;
+		emit(&hdr, text);
+		return;
+	}
+
+	cell = claim(&pos);
+	if (!cell) {
+		__atomic_add_fetch(&lg.dropped, 1, __ATOMIC_RELAXED);
+		goto out;
+	}
+
+	len = vsnprintf(cell->text, sizeof(cell->text), fmt, ap);
+	hdr.len = len < 0 ? 0 : len >= HLOG_TEXT_MAX ? HLOG_TEXT_MAX - 1 : len;
+	cell->hdr = hdr;
+
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	writer_wake();
+out:
+	__atomic_sub_fetch(&lg.producers, 1, __ATOMIC_RELEASE);
+}
+
+void hlog(enum hlog_level level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level > __atomic_load_n(&lg.level, __ATOMIC_RELAXED))
+		return;
+
+	va_start(ap, fmt);
+	vlog(level, fmt, ap);
+	va_end(ap);
+}
+
+static void call_vlog(enum hlog_level level, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vlog(level, fmt, ap);
+	va_end(ap);
+}
+
+void hlog_ratelimited(struct hlog_ratelimit *rl, enum hlog_level level,
+		      const char *fmt, ...)
+{
+	uint64_t now = bench_now_ns();
+	uint32_t suppressed = 0;
+	int pass;
+	va_list ap;
+
+	if (level > __atomic_load_n(&lg.level, __ATOMIC_RELAXED))
+		return;
+
+	while (__atomic_exchange_n(&rl->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&rl->lock, __ATOMIC_RELAXED))
+			;
+	if (!rl->begin_ns || now - rl->begin_ns >= rl->interval_ns) {
+		rl->begin_ns = now;
+		rl->printed = 0;
+	}
+	pass = rl->printed < rl->burst;
+	if (pass) {
+		rl->printed++;
+		suppressed = rl->suppressed;
+		rl->suppressed = 0;
+	} else {
+		rl->suppressed++;
+	}
+	__atomic_store_n(&rl->lock, 0, __ATOMIC_RELEASE);
+
+	if (!pass)
+		return;
+
+	if (suppressed)
+		call_vlog(level, "(%u similar records suppressed)\n",
+			  suppressed);
+	va_start(ap, fmt);
+	vlog(level, fmt, ap);
+	va_end(ap);
+}
+
+int hlog_start(enum hlog_level level, const char *bin_path)
+{
+	static int registered;
+	size_t i;
+
+	if (lg.running)
+		return 0;
+
+	lg.cells = calloc(HLOG_QUEUE_SIZE, sizeof(*lg.cells));
+	if (!lg.cells)
+		return -1;
+	for (i = 0; i < HLOG_QUEUE_SIZE; i++)
+		lg.cells[i].seq = i;
+	lg.mask = HLOG_QUEUE_SIZE - 1;
+	lg.head = 0;
+	lg.tail = 0;
+	lg.written = 0;
+	lg.stopping = 0;
+	lg.sleeping = 0;
+	lg.level = level;
+
+	lg.bin = NULL;
+	if (bin_path) {
+		lg.bin = fopen(bin_path, "wb");
+		if (!lg.bin)
+			goto err_cells;
+	}
+
+	if (sem_init(&lg.wake, 0, 0))
+		goto err_bin;
+	if (pthread_create(&lg.writer, NULL, writer_run, NULL)) {
+		errno = EAGAIN;
+		goto err_sem;
+	}
+
+	if (!registered && !atexit(hlog_stop))
+		registered = 1;
+	__atomic_store_n(&lg.running, 1, __ATOMIC_RELEASE);
+	return 0;
+
+err_sem:
+	sem_destroy(&lg.wake);
+err_bin:
+	if (lg.bin)
+		fclose(lg.bin);
+	lg.bin = NULL;
+err_cells:
+	free(lg.cells);
+	lg.cells = NULL;
+	return -1;
+}
+
+void hlog_flush(void)
+{
+	struct timespec pause = { .tv_nsec = 100000 };
+	uint64_t target;
+
+	if (!__atomic_load_n(&lg.running, __ATOMIC_ACQUIRE))
+		return;
+
+	target = __atomic_load_n(&lg.head, __ATOMIC_ACQUIRE);
+	writer_wake();
+	while (__atomic_load_n(&lg.written, __ATOMIC_ACQUIRE) < target)
+		nanosleep(&pause, NULL);
+}
+
+/* Until every producer that got into vlog() before now has left it */
+static void producers_wait(void)
+{
+	while (__atomic_load_n(&lg.producers, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+void hlog_stop(void)
+{
+	FILE *bin;
+
+	if (!__atomic_load_n(&lg.running, __ATOMIC_ACQUIRE))
+		return;
+
+	/*
+	 * New records are written synchronously from here on. One that
+	 * saw running set may still be formatting into its cell: the
+	 * writer must publish it before it stops, and the cells must
+	 * outlive it.
+	 */
+	__atomic_store_n(&lg.running, 0, __ATOMIC_SEQ_CST);
+	producers_wait();
+	__atomic_store_n(&lg.stopping, 1, __ATOMIC_RELEASE);
+	writer_wake();
+	pthread_join(lg.writer, NULL);
+
+	/* Nor may the file go while a synchronous record is written to it */
+	bin = lg.bin;
+	__atomic_store_n(&lg.bin, NULL, __ATOMIC_SEQ_CST);
+	producers_wait();
+
+	sem_destroy(&lg.wake);
+	if (bin)
+		fclose(bin);
+	free(lg.cells);
+	lg.cells = NULL;
+}
+
+unsigned long hlog_dropped(void)
+{
+	return __atomic_load_n(&lg.dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef HOST_LOG_H
+#define HOST_LOG_H
+
+#include <stdint.h>
+
+/*
+ * Host log, kept off the control path: a thread formats its record
+ * straight into a slot it claims in a lock-free queue and a writer thread
+ * does the I/O. A full queue drops the record and counts it, logging
+ * never blocks. Until hlog_start() and after hlog_stop() records are
+ * written synchronously instead.
+ */
+
+enum hlog_level {
+	HLOG_ERROR,		/* to stderr, the rest to stdout */
+	HLOG_WARN,		/* TAI alerts */
+	HLOG_INFO,		/* the demo's narration */
+	HLOG_DEBUG,
+};
+
+/* Longest record, longer ones are cut */
+#define HLOG_TEXT_MAX		232
+
+/*
+ * Binary mode writes every record as this header followed by len bytes
+ * of text, no terminating NUL.
+ */
+struct hlog_bin_record {
+	uint64_t timestamp_ns;	/* bench_now_ns() when logged */
+	uint32_t thread;	/* numbered from 1 in order of first record */
+	uint16_t level;		/* enum hlog_level */
+	uint16_t len;
+};
+
+/*
+ * Starts the writer thread, records above level are discarded before
+ * formatting. With bin_path set every record goes to that file in binary
+ * instead of stdout/stderr. Returns 0 or -1 with errno set. Pending
+ * records are also written at exit.
+ */
+int hlog_start(enum hlog_level level, const char *bin_path);
+
+/*
+ * Writes what is queued, records other threads are still formatting
+ * included, and stops the writer thread
+ */
+void hlog_stop(void);
+
+/* Returns once everything logged before the call has been written */
+void hlog_flush(void);
+
+void hlog(enum hlog_level level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/*
+ * At most burst records per interval from one call site, the rest are
+ * counted and the count is logged with the next record let through.
+ */
+struct hlog_ratelimit {
+	uint64_t interval_ns;
+	uint32_t burst;
+	uint32_t lock;
+	uint64_t begin_ns;	/* start of the current interval */
+	uint32_t printed;	/* in the current interval */
+	uint32_t suppressed;	/* since the last record let through */
+};
+
+#define HLOG_RATELIMIT_INIT(interval_ms, n) \
+	{ .interval_ns = (interval_ms) * 1000000ULL, .burst = (n) }
+
+void hlog_ratelimited(struct hlog_ratelimit *rl, enum hlog_level level,
+		      const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/* Records dropped on a full queue so far */
+unsigned long hlog_dropped(void);
+
+#endif /* HOST_LOG_H */
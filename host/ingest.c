@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ingest.h"
+
+#define INGEST_EVENTS		64
+
+enum source_kind {
+	SOURCE_LISTEN,
+	SOURCE_STREAM,
+	SOURCE_FIFO,
+};
+
+struct ingest_source {
+	int fd;
+	enum source_kind kind;
+	struct ingest_source *next_free;
+	size_t len;		/* bytes of a partial frame held in buf */
+	uint16_t seq;		/* last one seen */
+	int seq_valid;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	unsigned char buf[INGEST_RX_SIZE];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct ingest_source *source_get(struct ingest *in, int fd,
+					enum source_kind kind)
+{
+	struct ingest_source *s = in->free_sources;
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	if (!s) {
+		errno = EMFILE;
+		return NULL;
+	}
+
+	ev.data.ptr = s;
+	if (epoll_ctl(in->epfd, EPOLL_CTL_ADD, fd, &ev))
+		return NULL;
+
+	in->free_sources = s->next_free;
+	s->fd = fd;
+	s->kind = kind;
+	s->len = 0;
+	s->seq_valid = 0;
+	s->path[0] = '\0';
+	return s;
+}
+
+static void source_put(struct ingest *in, struct ingest_source *s)
+{
+	epoll_ctl(in->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+	close(s->fd);
+	if (s->kind == SOURCE_LISTEN && s->path[0])
+		unlink(s->path);
+	s->fd = -1;
+	s->next_free = in->free_sources;
+	in->free_sources = s;
+}
+
+int ingest_init(struct ingest *in, ingest_route_fn route, void *arg,
+		uint64_t deadline_ns)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	size_t i;
+
+	memset(in, 0, sizeof(*in));
+	in->route = route;
+	in->arg = arg;
+	in->deadline_ns = deadline_ns;
+
+	in->sources = calloc(INGEST_MAX_SOURCES, sizeof(*in->sources));
+	if (!in->sources)
+		return -1;
+	for (i = INGEST_MAX_SOURCES; i--; ) {
+		in->sources[i].fd = -1;
+		in->sources[i].next_free = in->free_sources;
+		in->free_sources = &in->sources[i];
+	}
+
+	in->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (in->epfd < 0)
+		goto err_sources;
+	in->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (in->stop_fd < 0)
+		goto err_epoll;
+	if (epoll_ctl(in->epfd, EPOLL_CTL_ADD, in->stop_fd, &ev))
+		goto err_stop;
+	return 0;
+
+err_stop:
+	close(in->stop_fd);
+err_epoll:
+	close(in->epfd);
+err_sources:
+	free(in->sources);
+	in->sources = NULL;
+	return -1;
+}
+
+int ingest_listen(struct ingest *in, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct ingest_source *s;
+	int saved;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, 64))
+		goto err;
+
+	s = source_get(in, fd, SOURCE_LISTEN);
+	if (!s) {
+		unlink(path);
+		goto err;
+	}
+	strcpy(s->path, path);
+	return 0;
+
+err:
+	saved = errno;
+	close(fd);
+	errno = saved;
+	return -1;
+}
+
+int ingest_add_fifo(struct ingest *in, const char *path)
+{
+	int saved;
+	int fd;
+
+	if (mkfifo(path, 0660) && errno != EEXIST)
+		return -1;
+
+	/*
+	 * Open for writing too, so that the FIFO never reports end of
+	 * file while no producer has it open and the next one that opens
+	 * it is read from like the last.
+	 */
+	fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (!source_get(in, fd, SOURCE_FIFO)) {
+		saved = errno;
+		close(fd);
+		errno = saved;
+		return -1;
+	}
+	return 0;
+}
+
+static void accept_producers(struct ingest *in, struct ingest_source *l)
+{
+	int fd;
+
+	for (;;) {
+		fd = accept(l->fd, NULL, NULL);
+		if (fd < 0)
+			return;
+		if (fcntl(fd, F_SETFL, O_NONBLOCK) ||
+		    fcntl(fd, F_SETFD, FD_CLOEXEC) ||
+		    !source_get(in, fd, SOURCE_STREAM)) {
+			in->stats.refused++;
+			close(fd);
+			continue;
+		}
+		in->stats.accepted++;
+	}
+}
+
+/* Routes every whole frame in s->buf and keeps the partial one */
+static void parse(struct ingest *in, struct ingest_source *s)
+{
+	const unsigned char *p = s->buf;
+	const unsigned char *end = s->buf + s->len;
+	struct ingest_frame f;
+	struct tank_reading r;
+	uint64_t now = now_ns();
+
+	/* Every frame of one read arrived together */
+	r.capture_ns = now;
+	r.submit_ns = now;
+	r.deadline_ns = in->deadline_ns ? now + in->deadline_ns : 0;
+
+	while ((size_t)(end - p) >= sizeof(f)) {
+		memcpy(&f, p, sizeof(f));
+		if (f.magic != INGEST_MAGIC) {
+			in->stats.skipped++;
+			p++;
+			continue;
+		}
+		p += sizeof(f);
+
+		if (s->seq_valid && f.seq != (uint16_t)(s->seq + 1))
+			in->stats.lost += (uint16_t)(f.seq - s->seq - 1);
+		s->seq = f.seq;
+		s->seq_valid = 1;
+
+		r.sample.temp = f.temp;
+		r.sample.ph = f.ph;
+		r.sample.acid_flow = f.acid_flow;
+		r.sample.sod_hydrox_flow = f.sod_hydrox_flow;
+		r.sample.timestamp = f.timestamp;
+		r.id = in->stats.frames++;
+		if (in->route(in->arg, f.tank, &r))
+			in->stats.dropped++;
+	}
+
+	s->len = end - p;
+	if (s->len)
+		memmove(s->buf, p, s->len);
+}
+
+/*
+ * One read per wake-up, level triggered, so that a busy producer cannot
+ * starve the others. Returns -1 once the producer has gone.
+ */
+static int drain(struct ingest *in, struct ingest_source *s)
+{
+	ssize_t n;
+
+	n = read(s->fd, s->buf + s->len, sizeof(s->buf) - s->len);
+	if (n < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+	if (!n)
+		return -1;
+
+	in->stats.reads++;
+	s->len += n;
+	parse(in, s);
+	return 0;
+}
+
+static void *ingest_run(void *arg)
+{
+	struct epoll_event events[INGEST_EVENTS];
+	struct ingest *in = arg;
+	struct ingest_source *s;
+	int n;
+	int i;
+
+	for (;;) {
+		n = epoll_wait(in->epfd, events, INGEST_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			s = events[i].data.ptr;
+			if (!s)
+				return NULL;
+			if (s->kind == SOURCE_LISTEN)
+				accept_producers(in, s);
+			else if (drain(in, s))
+				source_put(in, s);
+		}
+	}
+	return NULL;
+}
+
+int ingest_start(struct ingest *in)
+{
+	if (pthread_create(&in->thread, NULL, ingest_run, in))
+		return -1;
+	in->started = 1;
+	return 0;
+}
+
+void ingest_stop(struct ingest *in)
+{
+	uint64_t one = 1;
+
+	if (!in->started)
+		return;
+
+	if (write(in->stop_fd, &one, sizeof(one)) != sizeof(one))
+		return;
+	pthread_join(in->thread, NULL);
+	in->started = 0;
+}
+
+void ingest_report(const struct ingest *in)
+{
+	const struct ingest_stats *st = &in->stats;
+
+	printf("Ingest: %lu readings in %lu reads (%.1f per read), "
+	       "%lu dropped, %lu lost\n", st->frames, st->reads,
+	       st->reads ? (double)st->frames / st->reads : 0.0,
+	       st->dropped, st->lost);
+	if (st->skipped || st->refused)
+		printf("  %lu bytes skipped to resync, %lu producers "
+		       "refused\n", st->skipped, st->refused);
+}
+
+void ingest_destroy(struct ingest *in)
+{
+	size_t i;
+
+	ingest_stop(in);
+	if (!in->sources)
+		return;
+
+	for (i = 0; i < INGEST_MAX_SOURCES; i++)
+		if (in->sources[i].fd >= 0)
+			source_put(in, &in->sources[i]);
+	close(in->stop_fd);
+	close(in->epfd);
+	free(in->sources);
+	in->sources = NULL;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mpsc_queue.h"
+
+/*
+ * One reading as sensors and PLC gateways send it, over a Unix stream
+ * socket or a FIFO, back to back with nothing in between. Producers are
+ * local, fields are in host byte order. A stream that loses its place is
+ * scanned forward a byte at a time until the next magic.
+ */
+#define INGEST_MAGIC		0x5457	/* "WT" */
+
+struct ingest_frame {
+	uint16_t magic;		/* INGEST_MAGIC */
+	uint16_t tank;
+	int16_t temp;		/* Fahrenheit */
+	uint16_t ph;		/* 0 - 14 */
+	uint8_t acid_flow;	/* 0 - 10 */
+	uint8_t sod_hydrox_flow;
+	uint16_t seq;		/* per producer, one up per frame */
+	uint32_t timestamp;	/* producer's own, handed back in decisions */
+};
+
+/*
+ * Takes a reading for a tank, 0 when it did or -1 when it cannot, for
+ * an unknown tank or a full queue. The reading is then counted as
+ * dropped. Runs on the ingest thread and must not block.
+ */
+typedef int (*ingest_route_fn)(void *arg, uint32_t tank,
+			       const struct tank_reading *reading);
+
+/* Producers connected at once, listeners and FIFOs included */
+#define INGEST_MAX_SOURCES	256
+
+/* Bytes read per wake-up of one source, a multiple of the frame size */
+#define INGEST_RX_SIZE		(128 * sizeof(struct ingest_frame))
+
+struct ingest_stats {
+	unsigned long frames;	/* parsed, routed or dropped */
+	unsigned long dropped;	/* refused by the route */
+	unsigned long lost;	/* missing from a producer's sequence */
+	unsigned long skipped;	/* bytes scanned past to find a magic */
+	unsigned long reads;
+	unsigned long accepted;	/* socket producers that connected */
+	unsigned long refused;	/* turned away, every source in use */
+};
+
+struct ingest_source;
+
+/*
+ * Event loop on a thread of its own: epoll over every listening socket,
+ * connection and FIFO, frames parsed in place in a per-source buffer
+ * allocated once at init, readings handed to route as they come.
+ */
+struct ingest {
+	int epfd;
+	int stop_fd;		/* eventfd, wakes the loop to stop */
+	pthread_t thread;
+	int started;
+	struct ingest_source *sources;
+	struct ingest_source *free_sources;
+	ingest_route_fn route;
+	void *arg;
+	uint64_t deadline_ns;	/* after receipt, 0 for none */
+	/* Only written by the ingest thread, read once it has stopped */
+	struct ingest_stats stats;
+};
+
+/* Returns 0 or -1 with errno set */
+int ingest_init(struct ingest *in, ingest_route_fn route, void *arg,
+		uint64_t deadline_ns);
+
+/*
+ * Listens for producers on the Unix stream socket path, replacing
+ * whatever is there. Returns 0 or -1 with errno set.
+ */
+int ingest_listen(struct ingest *in, const char *path);
+
+/* Reads from the FIFO path, created if missing. Returns 0 or -1. */
+int ingest_add_fifo(struct ingest *in, const char *path);
+
+/* Starts the ingest thread, returns 0 or -1 */
+int ingest_start(struct ingest *in);
+
+/*
+ * Stops the ingest thread; what producers wrote but it has not read yet
+ * is left unread.
+ */
+void ingest_stop(struct ingest *in);
+
+void ingest_report(const struct ingest *in);
+
+/* Closes every source and removes the listening sockets */
+void ingest_destroy(struct ingest *in);
+
+#endif /* INGEST_H */
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <water_treatment_ta.h>
+
+#include "bench.h"
+#include "loadgen.h"
+#include "tank_daemon.h"
+
+/* Per tank queue, enough to keep a worker's batches full */
+#define LOADGEN_QUEUE_SIZE	256
+
+struct loadgen {
+	struct tank_daemon daemon;
+	pthread_barrier_t start;
+	size_t tanks;
+	size_t readings;
+	size_t producers;
+	uint64_t deadline_ns;	/* after capture, 0 for none */
+	uint64_t *latency;	/* indexed by reading id, UINT64_MAX if shed */
+	unsigned long failed;
+	unsigned long shed;
+	unsigned long full;	/* pushes retried because a queue was full */
+};
+
+struct producer {
+	struct loadgen *lg;
+	pthread_t thread;
+	size_t first;
+	size_t count;
+};
+
+static void on_decision(void *arg, uint32_t tank_id,
+			const struct tank_reading *reading,
+			const struct wt_decision *decision, TEEC_Result res)
+{
+	struct loadgen *lg = arg;
+
+	(void)tank_id;
+	if (!decision && res == TEEC_ERROR_CANCEL) {
+		lg->latency[reading->id] = UINT64_MAX;
+		__atomic_add_fetch(&lg->shed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	lg->latency[reading->id] = bench_now_ns() - reading->submit_ns;
+	if (!decision)
+		__atomic_add_fetch(&lg->failed, 1, __ATOMIC_RELAXED);
+}
+
+/* xorshift32, good enough to vary the samples */
+static uint32_t next_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void *producer_run(void *arg)
+{
+	struct producer *p = arg;
+	struct loadgen *lg = p->lg;
+	struct tank_reading r;
+	uint32_t rnd = 0x9e3779b9u ^ p->first;
+	unsigned long full = 0;
+	uint32_t tank;
+	size_t i;
+
+	pthread_barrier_wait(&lg->start);
+
+	for (i = p->first; i < p->first + p->count; i++) {
+		/* Mostly in range, about one in sixteen past a device limit */
+		r.sample.temp = 60 + next_rand(&rnd) % 20;
+		r.sample.ph = next_rand(&rnd) % 15;
+		r.sample.acid_flow = next_rand(&rnd) % 2;
+		r.sample.sod_hydrox_flow = next_rand(&rnd) % 2;
+		if (!(next_rand(&rnd) & 15))
+			r.sample.temp = 200;
+		r.sample.timestamp = i;
+		r.id = i;
+
+		tank = i % lg->tanks;
+		r.submit_ns = bench_now_ns();
+		/* The sensor read it now, retries only make it older */
+		r.capture_ns = r.submit_ns;
+		r.deadline_ns = lg->deadline_ns ?
+				r.capture_ns + lg->deadline_ns : 0;
+		while (tank_daemon_submit(&lg->daemon, tank, &r)) {
+			full++;
+			sched_yield();
+			r.submit_ns = bench_now_ns();
+		}
+	}
+
+	__atomic_add_fetch(&lg->full, full, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+int loadgen_run(size_t tanks, size_t readings, size_t producers,
+		size_t batch_max, uint64_t deadline_ns, enum tank_shed shed)
+{
+	struct loadgen lg = {
+		.tanks = tanks,
+		.readings = readings,
+		.producers = producers,
+		.deadline_ns = deadline_ns,
+	};
+	struct tank_shed_stats stats;
+	struct producer *prod;
+	uint64_t elapsed;
+	uint64_t t0;
+	size_t served;
+	size_t per;
+	size_t i;
+
+	if (!tanks || !readings || !producers)
+		return -1;
+
+	lg.latency = calloc(readings, sizeof(*lg.latency));
+	prod = calloc(producers, sizeof(*prod));
+	if (!lg.latency || !prod)
+		err(1, "calloc");
+
+	printf("Load generator: %zu tanks, %zu readings from %zu producers, "
+	       "up to %zu per invoke\n", tanks, readings, producers, batch_max);
+
+	if (deadline_ns)
+		printf("  deadline %.3f ms after capture, %s\n",
+		       deadline_ns / 1e6,
+		       shed == TANK_SHED_NEWEST ? "newest reading wins" :
+		       shed == TANK_SHED_LATE ? "late readings shed" :
+						"nothing shed");
+
+	if (tank_daemon_start(&lg.daemon, 0, tanks, LOADGEN_QUEUE_SIZE,
+			      batch_max, shed, on_decision, &lg) != TEEC_SUCCESS) {
+		free(prod);
+		free(lg.latency);
+		return -1;
+	}
+
+	pthread_barrier_init(&lg.start, NULL, producers + 1);
+	per = (readings + producers - 1) / producers;
+	for (i = 0; i < producers; i++) {
+		prod[i].lg = &lg;
+		prod[i].first = i * per < readings ? i * per : readings;
+		prod[i].count = readings - prod[i].first < per ?
+				readings - prod[i].first : per;
+		if (pthread_create(&prod[i].thread, NULL, producer_run,
+				   &prod[i]))
+			err(1, "pthread_create");
+	}
+
+	pthread_barrier_wait(&lg.start);
+	t0 = bench_now_ns();
+	for (i = 0; i < producers; i++)
+		pthread_join(prod[i].thread, NULL);
+	/* Only returns once every queued reading has its decision */
+	tank_daemon_stop(&lg.daemon);
+	elapsed = bench_now_ns() - t0;
+
+	tank_daemon_report(&lg.daemon);
+	printf("%.0f readings/s, %lu submits retried on a full queue\n",
+	       readings / (elapsed / 1e9), lg.full);
+
+	/* Shed readings have no latency, keep the served ones */
+	served = 0;
+	for (i = 0; i < readings; i++)
+		if (lg.latency[i] != UINT64_MAX)
+			lg.latency[served++] = lg.latency[i];
+	if (served)
+		bench_report("  submit->decision", lg.latency, served);
+
+	if (shed != TANK_SHED_NONE) {
+		tank_daemon_shed_stats(&lg.daemon, &stats);
+		printf("  %zu served, %lu shed; staleness at decision "
+		       "mean %.1f us, max %.1f us\n", served, lg.shed,
+		       stats.served ? stats.stale_sum_ns / 1e3 / stats.served :
+				      0.0,
+		       stats.stale_max_ns / 1e3);
+	}
+
+	tank_daemon_destroy(&lg.daemon);
+	pthread_barrier_destroy(&lg.start);
+	free(prod);
+	free(lg.latency);
+	return lg.failed ? -1 : 0;
+}
@@ -26,7 +26,10 @@
  */
 
 #include <err.h>
+#include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -36,6 +39,22 @@
 /* For the UUID (found in the TA's h-file(s)) */
 #include <water_treatment_ta.h>
 
+#include "bench.h"
+#include "channels.h"
+#include "control_sched.h"
+#include "dedup_cache.h"
+#include "events.h"
+#include "host_log.h"
+#include "ingest.h"
+#include "loadgen.h"
+#include "metrics.h"
+#include "phase_trace.h"
+#include "plant_sim.h"
+#include "trace_replay.h"
+#include "session_pool.h"
+#include "tank_control.h"
+#include "tank_daemon.h"
+
 /*Water Treatment Sensor State Variables*/
 /* Initial values */
 int temp_val = 70;		//Fahrenheit
@@ -85,220 +104,358 @@ void set_acid_flow(int val)
 	acid_flow = val;
 };
 
-/* TEE resources */
-struct test_ctx {
-	TEEC_Context ctx;
-	TEEC_Session sess;
-};
-
-void prepare_tee_session(struct test_ctx *ctx)
-{
-	TEEC_UUID uuid = TA_WATER_TREATMENT_UUID;
-	uint32_t origin;
-	TEEC_Result res;
+/* Sessions shared by every pump command */
+static struct session_pool pool;
 
-	/* Initialize a context connecting us to the TEE */
-	res = TEEC_InitializeContext(NULL, &ctx->ctx);
-	if (res != TEEC_SUCCESS)
-		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+/* Replies to repeated pump commands, NULL unless enabled with -c */
+static struct dedup_cache cache;
+static struct dedup_cache *decision_cache;
 
-	/* Open a session with the TA */
-	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
-			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
-	if (res != TEEC_SUCCESS)
-		errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x",
-			res, origin);
-}
+/////////////////////////////////////
+// WATER TREATMENT USERLAND FUNCTIONS
 
-void terminate_tee_session(struct test_ctx *ctx)
+/* The current readings, in the encoding the session speaks */
+static void pack_readings(struct test_ctx *ctx, TEEC_Operation *op)
 {
-	TEEC_CloseSession(&ctx->sess);
-	TEEC_FinalizeContext(&ctx->ctx);
-}
+	int32_t in[4];
 
-/////////////////////////////////////
-// WATER TREATMENT USERLAND FUNCTIONS
+	in[0] = get_temp_val();
+	in[1] = get_ph_val();
+	in[2] = get_sod_hydrox_flow();
+	in[3] = get_acid_flow();
+	pump_op_pack(ctx, op, in);
+}
 
-TEEC_Result turn_sodiumhydroxide_on(struct test_ctx *ctx)
+TEEC_Result turn_sodiumhydroxide_on(struct test_ctx *ctx, uint32_t *err_origin)
 {
 	TEEC_Operation op;
 	uint32_t origin;
+	uint32_t valve;
 	TEEC_Result res;
+	int ok;
 
-	memset(&op, 0, sizeof(op));
-
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_VALUE_INOUT,
-					 TEEC_VALUE_INOUT, TEEC_VALUE_INOUT);
-	op.params[0].value.a = get_temp_val();
-	op.params[1].value.a = get_ph_val();
-	op.params[2].value.a = get_sod_hydrox_flow();
-	op.params[3].value.a = get_acid_flow();
+	pack_readings(ctx, &op);
+	phase_mark(PHASE_MARSHAL);
 
 	/*
 	* TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON is the actual function in the TA to be
 	* called.
 	*/
-	printf("Invoking TA to turn sodium hydroxide pump on.\n");
-	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON, &op,
-				&origin);
+	hlog(HLOG_INFO, "Invoking TA to turn sodium hydroxide pump on.\n");
+	phase_mark(PHASE_LOG);
+	res = dedup_invoke(decision_cache, pool.tank_id, &ctx->sess,
+			   TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON, &op, &origin);
+	phase_mark(PHASE_INVOKE);
+	phase_reply(TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON, &op, res);
 	if (res != TEEC_SUCCESS){
-		errx(1, "TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
 			res, origin);
+		*err_origin = origin;
+		return res;
 	}
-	if (op.params[0].value.a == 0 && op.params[1].value.a == 0 && op.params[2].value.a == 0){
-		printf("Sodium hydroxide pump value is now %d\n", op.params[3].value.a);
+	ok = pump_op_unpack(ctx, TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON, &op, &valve);
+	phase_mark(PHASE_MARSHAL);
+	if (ok){
+		hlog(HLOG_INFO, "Sodium hydroxide pump value is now %u\n", valve);
 	}else{
-		printf("*** FAILURE ***\n");
+		hlog(HLOG_INFO, "*** FAILURE ***\n");
 	}
+	phase_mark(PHASE_LOG);
+	return TEEC_SUCCESS;
 }
 
-TEEC_Result turn_sodiumhydroxide_off(struct test_ctx *ctx)
+TEEC_Result turn_sodiumhydroxide_off(struct test_ctx *ctx, uint32_t *err_origin)
 {
 	TEEC_Operation op;
 	uint32_t origin;
+	uint32_t valve;
 	TEEC_Result res;
+	int ok;
 
-	memset(&op, 0, sizeof(op));
-
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_VALUE_INOUT,
-					 TEEC_VALUE_INOUT, TEEC_VALUE_INOUT);
-	op.params[0].value.a = get_temp_val();
-	op.params[1].value.a = get_ph_val();
-	op.params[2].value.a = get_sod_hydrox_flow();
-	op.params[3].value.a = get_acid_flow();
+	pack_readings(ctx, &op);
+	phase_mark(PHASE_MARSHAL);
 
 	/*
 	* TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON is the actual function in the TA to be
 	* called.
 	*/
-	printf("Invoking TA to turn sodium hydroxide pump off.\n");
-	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF, &op,
-				&origin);
+	hlog(HLOG_INFO, "Invoking TA to turn sodium hydroxide pump off.\n");
+	phase_mark(PHASE_LOG);
+	res = dedup_invoke(decision_cache, pool.tank_id, &ctx->sess,
+			   TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF, &op, &origin);
+	phase_mark(PHASE_INVOKE);
+	phase_reply(TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF, &op, res);
 	if (res != TEEC_SUCCESS){
-		errx(1, "TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
 			res, origin);
+		*err_origin = origin;
+		return res;
 	}
-	if (op.params[0].value.a == 0 && op.params[1].value.a == 0 && op.params[2].value.a == 0){
-		printf("Sodium hydroxide pump value is now %d\n", op.params[3].value.a);
+	ok = pump_op_unpack(ctx, TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF, &op, &valve);
+	phase_mark(PHASE_MARSHAL);
+	if (ok){
+		hlog(HLOG_INFO, "Sodium hydroxide pump value is now %u\n", valve);
 	}else{
-		printf("*** FAILURE ***\n");
+		hlog(HLOG_INFO, "*** FAILURE ***\n");
 	}
+	phase_mark(PHASE_LOG);
+	return TEEC_SUCCESS;
 }
 
-TEEC_Result turn_acid_on(struct test_ctx *ctx)
+TEEC_Result turn_acid_on(struct test_ctx *ctx, uint32_t *err_origin)
 {
 	TEEC_Operation op;
 	uint32_t origin;
+	uint32_t valve;
 	TEEC_Result res;
+	int ok;
 
-	memset(&op, 0, sizeof(op));
-
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_VALUE_INOUT,
-					 TEEC_VALUE_INOUT, TEEC_VALUE_INOUT);
-	op.params[0].value.a = get_temp_val();
-	op.params[1].value.a = get_ph_val();
-	op.params[2].value.a = get_sod_hydrox_flow();
-	op.params[3].value.a = get_acid_flow();
+	pack_readings(ctx, &op);
+	phase_mark(PHASE_MARSHAL);
 
 	/*
 	* TA_WATER_TREATMENT_CMD_ACID_ON is the actual function in the TA to be
 	* called.
 	*/
-	printf("Invoking TA to turn acid pump on.\n");
-	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_ACID_ON, &op,
-				&origin);
+	hlog(HLOG_INFO, "Invoking TA to turn acid pump on.\n");
+	phase_mark(PHASE_LOG);
+	res = dedup_invoke(decision_cache, pool.tank_id, &ctx->sess,
+			   TA_WATER_TREATMENT_CMD_ACID_ON, &op, &origin);
+	phase_mark(PHASE_INVOKE);
+	phase_reply(TA_WATER_TREATMENT_CMD_ACID_ON, &op, res);
 	if (res != TEEC_SUCCESS){
-		errx(1, "TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
 			res, origin);
+		*err_origin = origin;
+		return res;
 	}
-	if (op.params[0].value.a == 0 && op.params[1].value.a == 0 && op.params[3].value.a == 0){
-		printf("Acid pump value is now %d\n", op.params[2].value.a);
+	ok = pump_op_unpack(ctx, TA_WATER_TREATMENT_CMD_ACID_ON, &op, &valve);
+	phase_mark(PHASE_MARSHAL);
+	if (ok){
+		hlog(HLOG_INFO, "Acid pump value is now %u\n", valve);
 	}else{
-		printf("*** FAILURE ***\n");
+		hlog(HLOG_INFO, "*** FAILURE ***\n");
 	}
+	phase_mark(PHASE_LOG);
+	return TEEC_SUCCESS;
 }
 
-TEEC_Result turn_acid_off(struct test_ctx *ctx)
+TEEC_Result turn_acid_off(struct test_ctx *ctx, uint32_t *err_origin)
 {
 	TEEC_Operation op;
 	uint32_t origin;
+	uint32_t valve;
 	TEEC_Result res;
+	int ok;
 
-	memset(&op, 0, sizeof(op));
-
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_VALUE_INOUT,
-					 TEEC_VALUE_INOUT, TEEC_VALUE_INOUT);
-	op.params[0].value.a = get_temp_val();
-	op.params[1].value.a = get_ph_val();
-	op.params[2].value.a = get_sod_hydrox_flow();
-	op.params[3].value.a = get_acid_flow();
+	pack_readings(ctx, &op);
+	phase_mark(PHASE_MARSHAL);
 
 	/*
 	* TA_WATER_TREATMENT_CMD_ACID_OFF is the actual function in the TA to be
 	* called.
 	*/
-	printf("Invoking TA to turn acid pump off.\n");
-	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_ACID_OFF, &op,
-				&origin);
+	hlog(HLOG_INFO, "Invoking TA to turn acid pump off.\n");
+	phase_mark(PHASE_LOG);
+	res = dedup_invoke(decision_cache, pool.tank_id, &ctx->sess,
+			   TA_WATER_TREATMENT_CMD_ACID_OFF, &op, &origin);
+	phase_mark(PHASE_INVOKE);
+	phase_reply(TA_WATER_TREATMENT_CMD_ACID_OFF, &op, res);
 	if (res != TEEC_SUCCESS){
-		errx(1, "TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
 			res, origin);
+		*err_origin = origin;
+		return res;
 	}
-	if (op.params[0].value.a == 0 && op.params[1].value.a == 0 && op.params[3].value.a == 0){
-		printf("Acid pump value is now %d\n", op.params[2].value.a);
+	ok = pump_op_unpack(ctx, TA_WATER_TREATMENT_CMD_ACID_OFF, &op, &valve);
+	phase_mark(PHASE_MARSHAL);
+	if (ok){
+		hlog(HLOG_INFO, "Acid pump value is now %u\n", valve);
 	}else{
-		printf("*** FAILURE ***\n");
+		hlog(HLOG_INFO, "*** FAILURE ***\n");
 	}
+	phase_mark(PHASE_LOG);
+	return TEEC_SUCCESS;
 }
 
-void verify_safe_ph()
+/* A sensor stuck unsafe would otherwise repeat these every period */
+static struct hlog_ratelimit unsafe_alerts = HLOG_RATELIMIT_INIT(10000, 5);
+static struct hlog_ratelimit trend_alerts = HLOG_RATELIMIT_INIT(10000, 5);
+
+/*
+ * The TA judges the reading against its window of recent ones, or against
+ * none but this one when fresh is set.
+ */
+void verify_safe_ph(int fresh)
 {
-	if(get_ph_val() >= 6 && get_ph_val() <= 8){
-		//Safe ph - do nothing
-	}else{
-		printf("***** TAI Alert - Backward Edge Failure *****\n");
-		printf("***** TAI Alert - pH value unsafe. *****\n\n");
+	struct ph_report r;
+	struct test_ctx *tee;
+	uint32_t origin = 0;
+	TEEC_Result res;
+
+	tee = session_pool_acquire(&pool);
+	if (!tee) {
+		warnx("No session with the TA available, pH not verified");
+		return;
 	}
+	res = check_ph(tee, get_ph_val(),
+		       WT_PH_CHECK_RECORD | (fresh ? WT_PH_CHECK_RESET : 0),
+		       &r, &origin);
+	session_pool_release(&pool, tee, res, origin);
+	if (res != TEEC_SUCCESS)
+		return;
+
+	if (r.flags & WT_PH_UNSAFE)
+		hlog_ratelimited(&unsafe_alerts, HLOG_WARN,
+				 "***** TAI Alert - Backward Edge Failure *****\n"
+				 "***** TAI Alert - pH value unsafe. *****\n\n");
+	if (r.flags & (WT_PH_MEAN_UNSAFE | WT_PH_DRIFTING | WT_PH_UNSTABLE))
+		hlog_ratelimited(&trend_alerts, HLOG_WARN,
+				 "***** TAI Alert - pH trend unsafe:%s%s%s *****\n"
+				 "pH over the last %u readings: mean %.2f, "
+				 "min %.2f, max %.2f, %+.2f per reading\n\n",
+				 r.flags & WT_PH_MEAN_UNSAFE ? " mean" : "",
+				 r.flags & WT_PH_DRIFTING ? " drifting" : "",
+				 r.flags & WT_PH_UNSTABLE ? " unstable" : "",
+				 r.count, r.mean / 1e3, r.min / 1e3,
+				 r.max / 1e3, r.rate / 1e3);
 	return;
 }
 
 
 /* Lambda function to pass in different requests to TEE */
 
-int invoke_ta(TEEC_Result (*func)(struct test_ctx *ctx))
+TEEC_Result invoke_ta(TEEC_Result (*func)(struct test_ctx *ctx,
+					  uint32_t *err_origin))
 {
-	struct test_ctx ctx;
-	printf("Prepare session with the TA\n");
-	prepare_tee_session(&ctx);
+	struct test_ctx *ctx;
+	uint32_t origin = 0;
+	TEEC_Result res;
 
-	(*func)(&ctx);
+	phase_begin();
+	ctx = session_pool_acquire(&pool);
+	if (!ctx)
+		errx(1, "No session with the TA available");
+	phase_mark(PHASE_SESSION);
 
-	printf("We're done, close and release TEE resources\n\n\n\n");
-	terminate_tee_session(&ctx);
+	res = (*func)(ctx, &origin);
 
-	return 0;
+	/* A panicked TA gets a fresh session next time round */
+	session_pool_release(&pool, ctx, res, origin);
+	phase_mark(PHASE_SESSION);
+	hlog(HLOG_INFO, "\n\n\n");
+	phase_mark(PHASE_LOG);
+	phase_end();
+
+	return res;
 }
 
-const char* call_function(val){
+TEEC_Result call_function(int val)
+{
 	switch(val)
 	{
 		case 1:
-			invoke_ta(turn_sodiumhydroxide_on);
-			break;
+			return invoke_ta(turn_sodiumhydroxide_on);
 		case 2:
-			invoke_ta(turn_sodiumhydroxide_off);
-			break;
+			return invoke_ta(turn_sodiumhydroxide_off);
 		case 3:
-			invoke_ta(turn_acid_on);
-			break;
+			return invoke_ta(turn_acid_on);
 		case 4:
-			invoke_ta(turn_acid_off);
-			break;
+			return invoke_ta(turn_acid_off);
 		default:
-			break;
+			return TEEC_ERROR_BAD_PARAMETERS;
 	}
 }
 
+/* Producers' paths given with -i and -F */
+#define MAX_INGEST_PATHS	8
+
+/* Per tank queue between the ingest thread and the tank's worker */
+#define SERVE_QUEUE_SIZE	1024
+
+static int route_reading(void *arg, uint32_t tank,
+			 const struct tank_reading *reading)
+{
+	return tank_daemon_submit(arg, tank, reading);
+}
+
+static void on_served(void *arg, uint32_t tank_id,
+		      const struct tank_reading *reading,
+		      const struct wt_decision *decision, TEEC_Result res)
+{
+	(void)arg;
+	(void)res;
+	if (decision && decision->verdict != WT_VERDICT_OK)
+		hlog(HLOG_DEBUG, "Tank %u reading %" PRIu64 " past the device "
+		     "limits\n", tank_id, reading->sample.timestamp);
+}
+
+/*
+ * Serves tanks 0 .. tanks - 1 from the readings producers send to the
+ * given sockets and FIFOs until SIGINT or SIGTERM.
+ */
+static int serve_ingest(size_t tanks, const char *const *socks,
+			size_t n_socks, const char *const *fifos,
+			size_t n_fifos, size_t batch_max, uint64_t deadline_ns,
+			enum tank_shed shed)
+{
+	struct tank_daemon daemon;
+	struct ingest in;
+	sigset_t set;
+	size_t i;
+	int sig;
+
+	/* Every thread started below inherits the mask, only we wait */
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	if (tank_daemon_start(&daemon, 0, tanks, SERVE_QUEUE_SIZE, batch_max,
+			      shed, on_served, NULL) != TEEC_SUCCESS)
+		return -1;
+	if (ingest_init(&in, route_reading, &daemon, deadline_ns)) {
+		warn("ingest_init");
+		goto err_daemon;
+	}
+	for (i = 0; i < n_socks; i++) {
+		if (ingest_listen(&in, socks[i])) {
+			warn("Failed to listen on %s", socks[i]);
+			goto err_ingest;
+		}
+	}
+	for (i = 0; i < n_fifos; i++) {
+		if (ingest_add_fifo(&in, fifos[i])) {
+			warn("Failed to read from %s", fifos[i]);
+			goto err_ingest;
+		}
+	}
+	if (ingest_start(&in)) {
+		warnx("Failed to start the ingest thread");
+		goto err_ingest;
+	}
+
+	hlog(HLOG_INFO, "Serving %zu tanks, %zu sockets and %zu FIFOs, "
+	     "SIGINT to stop\n", tanks, n_socks, n_fifos);
+	sigwait(&set, &sig);
+
+	ingest_stop(&in);
+	tank_daemon_stop(&daemon);
+	hlog_flush();
+	ingest_report(&in);
+	tank_daemon_report(&daemon);
+	ingest_destroy(&in);
+	tank_daemon_destroy(&daemon);
+	return 0;
+
+err_ingest:
+	ingest_destroy(&in);
+err_daemon:
+	tank_daemon_stop(&daemon);
+	tank_daemon_destroy(&daemon);
+	return -1;
+}
+
 struct Test_vals{
 int temp_val;
 int ph_val;
@@ -347,38 +504,403 @@ struct Test_vals2 backward_test_vals[8] = {
 	{70,7,0,1,4,4},
 };
 
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s pool_size] [-n] [-b iterations] [-B batch_size]\n"
+		"          [-R ring_size] [-p period_ms] [-P catchup|skip] [-r prio]\n"
+		"          [-l log_level] [-e] [-t tank_id] [-T max_tanks]\n"
+		"          [-D tanks [-d deadline_ms] [-w]] [-A invokers] [-c entries] [-S] [-f trace [-o decisions] [-x scale]]\n"
+		"          [-m tanks [-H hours] [-x speedup]] [-C]\n"
+		"          [-v host_log_level] [-L log_file] [-X] [-M socket]\n"
+		"          [-i socket] [-F fifo]\n"
+		"  -s N  keep N TA sessions open (default 1)\n"
+		"  -n    open and close a session around every command\n"
+		"  -b N  benchmark N commands with and without session reuse,\n"
+		"        and settling a tank with four commands or one CONTROL\n"
+		"  -B N  with -b, also compare N samples per batched invoke,\n"
+		"        with and without authentication\n"
+		"  -R N  with -b, also stream through an N slot shared ring\n"
+		"  -p MS control loop period in milliseconds (default 3000)\n"
+		"  -P    run missed ticks back to back (catchup, default) or\n"
+		"        drop them (skip)\n"
+		"  -r N  run the control loop SCHED_FIFO at priority N\n"
+		"  -l N  TA secure log level: 0 none, 1 alerts, 2 verbose\n"
+		"  -e    print the TA's event log at the end\n"
+		"  -c N  answer repeated pump commands from an N entry cache\n"
+		"        (with -b, benchmark polling with and without it)\n"
+		"  -S    print the TA's command statistics at the end\n"
+		"  -t N  tank the sessions act for (default 0)\n"
+		"  -T N  with -b, also load the TA from 1 up to N tanks at once\n"
+		"  -A N  with -b, also submit asynchronously to N invoker threads\n"
+		"  -D N  run a worker thread per tank for N tanks under\n"
+		"        synthetic load, -b readings (default 1000 per tank)\n"
+		"        batched up to -B per invoke (default 32)\n"
+		"  -d MS with -D, shed readings not decided within MS\n"
+		"        milliseconds of capture\n"
+		"  -w    with -D, keep only the newest reading per tank when\n"
+		"        the worker falls behind\n"
+		"  -f F  replay the sensor trace F (binary or CSV) instead of\n"
+		"        the built-in tests, -B rows per invoke (default 256)\n"
+		"  -o F  with -f, write the decisions to F\n"
+		"  -x N  with -f, replay N times faster than recorded\n"
+		"        (default 0, as fast as possible)\n"
+		"  -m N  close the loop over N simulated tanks dosed by the\n"
+		"        TA, one reading per -p period of virtual time, -x\n"
+		"        times faster than real time (default 0, flat out)\n"
+		"  -H N  with -m, simulate N hours (default 24)\n"
+		"  -C    list the TA's sensor and actuator channels and run\n"
+		"        the channel tests instead of the built-in tests\n"
+		"  -v N  host log level: 0 errors, 1 warnings and alerts,\n"
+		"        2 progress (default), 3 debug\n"
+		"  -L F  write the host log to F in binary instead\n"
+		"  -X    time every phase of the demo's pump commands and of\n"
+		"        the -D workers' invokes, print percentiles per\n"
+		"        command at the end and on SIGUSR1\n"
+		"  -M F  serve Prometheus text metrics on the Unix socket F\n"
+		"  -i F  take readings from producers connecting to the Unix\n"
+		"        socket F, to the -D tanks (default 1), until SIGINT\n"
+		"  -F F  take readings written to the FIFO F likewise,\n"
+		"        both may be given up to 8 times\n"
+		"-T, -D and -m take at most %d tanks, what the TA's heap holds\n",
+		prog, WT_MAX_TANKS);
+}
+
 /******** MAIN FUNCTION *************************/
-int main (void)
+int main (int argc, char *argv[])
 {
+	size_t pool_size = 1;
+	size_t bench_iterations = 0;
+	size_t batch_size = 0;
+	uint32_t ring_size = 0;
+	double period_ms = 3000;
+	enum ctl_policy policy = CTL_CATCH_UP;
+	int rt_prio = 0;
+	struct control_sched sched;
+	struct test_ctx *tee;
+	long log_level = -1;
+	long host_log_level = HLOG_INFO;
+	const char *log_path = NULL;
+	const char *metrics_path = NULL;
+	const char *socks[MAX_INGEST_PATHS];
+	const char *fifos[MAX_INGEST_PATHS];
+	size_t n_socks = 0;
+	size_t n_fifos = 0;
+	int show_events = 0;
+	int show_stats = 0;
+	int channels = 0;
+	const char *trace_path = NULL;
+	const char *out_path = NULL;
+	double time_scale = 0;
+	int ret = 0;
+	struct wt_stats stats;
+	uint32_t tank_id = 0;
+	size_t max_tanks = 0;
+	size_t daemon_tanks = 0;
+	double deadline_ms = 0;
+	int newest_wins = 0;
+	size_t invokers = 0;
+	size_t cache_size = 0;
+	size_t sim_tanks = 0;
+	double sim_hours = 24;
+	long producers;
+	uint32_t origin = 0;
+	int reuse = 1;
+	TEEC_Result res;
+	int opt;
 
-	printf("\nStarting water treatment TAI demo\n");
+	while ((opt = getopt(argc, argv, "s:nb:B:R:p:P:r:l:v:L:XM:i:F:eSt:T:D:d:wA:c:f:o:x:m:H:C")) != -1) {
+		switch (opt) {
+		case 's':
+			pool_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			reuse = 0;
+			break;
+		case 'b':
+			bench_iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			batch_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			ring_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			period_ms = strtod(optarg, NULL);
+			break;
+		case 'P':
+			if (!strcmp(optarg, "catchup")) {
+				policy = CTL_CATCH_UP;
+			} else if (!strcmp(optarg, "skip")) {
+				policy = CTL_SKIP;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'r':
+			rt_prio = strtol(optarg, NULL, 0);
+			break;
+		case 'l':
+			log_level = strtol(optarg, NULL, 0);
+			break;
+		case 'e':
+			show_events = 1;
+			break;
+		case 'S':
+			show_stats = 1;
+			break;
+		case 't':
+			tank_id = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			max_tanks = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			daemon_tanks = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			deadline_ms = strtod(optarg, NULL);
+			break;
+		case 'w':
+			newest_wins = 1;
+			break;
+		case 'v':
+			host_log_level = strtol(optarg, NULL, 0);
+			break;
+		case 'L':
+			log_path = optarg;
+			break;
+		case 'X':
+			phase_trace_start();
+			break;
+		case 'M':
+			metrics_path = optarg;
+			break;
+		case 'i':
+			if (n_socks == MAX_INGEST_PATHS) {
+				usage(argv[0]);
+				return 1;
+			}
+			socks[n_socks++] = optarg;
+			break;
+		case 'F':
+			if (n_fifos == MAX_INGEST_PATHS) {
+				usage(argv[0]);
+				return 1;
+			}
+			fifos[n_fifos++] = optarg;
+			break;
+		case 'A':
+			invokers = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cache_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			trace_path = optarg;
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'x':
+			time_scale = strtod(optarg, NULL);
+			break;
+		case 'm':
+			sim_tanks = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			sim_hours = strtod(optarg, NULL);
+			break;
+		case 'C':
+			channels = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!pool_size || period_ms <= 0 || time_scale < 0 || sim_hours <= 0 ||
+	    deadline_ms < 0 || host_log_level < HLOG_ERROR ||
+	    host_log_level > HLOG_DEBUG) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (max_tanks > WT_MAX_TANKS || daemon_tanks > WT_MAX_TANKS ||
+	    sim_tanks > WT_MAX_TANKS)
+		errx(1, "The TA holds at most %d tanks at once", WT_MAX_TANKS);
+
+	/* Served from a thread of its own, scrapes never hold up the loop */
+	if (metrics_path && metrics_serve(metrics_path))
+		err(1, "Failed to serve metrics on %s", metrics_path);
+
+	producers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (producers < 1)
+		producers = 1;
+
+	if (sim_tanks)
+		return plant_sim_run(sim_tanks, sim_hours, period_ms / 1000,
+				     time_scale, producers) ? 1 : 0;
+
+	if (n_socks || n_fifos) {
+		if (hlog_start(host_log_level, log_path))
+			err(1, "Failed to start the host log");
+		ret = serve_ingest(daemon_tanks ? daemon_tanks : 1, socks,
+				   n_socks, fifos, n_fifos,
+				   batch_size ? batch_size : 32,
+				   deadline_ms * 1e6,
+				   newest_wins ? TANK_SHED_NEWEST :
+				   deadline_ms ? TANK_SHED_LATE :
+						 TANK_SHED_NONE) ? 1 : 0;
+		phase_trace_dump();
+		return ret;
+	}
+
+	if (daemon_tanks) {
+		ret = loadgen_run(daemon_tanks,
+				  bench_iterations ? bench_iterations :
+						     daemon_tanks * 1000,
+				  producers, batch_size ? batch_size : 32,
+				  deadline_ms * 1e6,
+				  newest_wins ? TANK_SHED_NEWEST :
+				  deadline_ms ? TANK_SHED_LATE :
+						TANK_SHED_NONE) ? 1 : 0;
+		phase_trace_dump();
+		return ret;
+	}
+
+	if (bench_iterations) {
+		if (bench_session_reuse(bench_iterations, pool_size))
+			return 1;
+		if (batch_size && bench_batch(bench_iterations, batch_size))
+			return 1;
+		if (batch_size && bench_auth(bench_iterations, batch_size))
+			return 1;
+		if (ring_size && bench_ring(bench_iterations, ring_size))
+			return 1;
+		if (max_tanks && bench_tanks(bench_iterations, max_tanks))
+			return 1;
+		if (invokers && bench_async(bench_iterations, invokers))
+			return 1;
+		if (cache_size && bench_dedup(bench_iterations, cache_size))
+			return 1;
+		if (bench_control(bench_iterations))
+			return 1;
+		return 0;
+	}
+
+	if (cache_size) {
+		if (dedup_cache_init(&cache, cache_size))
+			errx(1, "Failed to allocate the decision cache");
+		decision_cache = &cache;
+	}
+
+	/* The demo's control path only queues its output */
+	if (hlog_start(host_log_level, log_path))
+		err(1, "Failed to start the host log");
 
-	printf("Forward edge tests\n\n");
+	hlog(HLOG_INFO, "Prepare session with the TA\n");
+	res = session_pool_init(&pool, tank_id, pool_size, reuse);
+	if (res != TEEC_SUCCESS)
+		errx(1, "Failed to set up TA sessions, code 0x%x", res);
+
+	if (log_level >= 0) {
+		tee = session_pool_acquire(&pool);
+		if (!tee)
+			errx(1, "No session with the TA available");
+		res = set_ta_log_level(tee, log_level, NULL, &origin);
+		session_pool_release(&pool, tee, res, origin);
+	}
+
+	if (rt_prio)
+		control_sched_set_realtime(rt_prio);
+
+	/* What follows prints directly, get the log out first */
+	hlog_flush();
+
+	if (channels) {
+		if (channel_tests(&pool))
+			ret = 1;
+		goto out;
+	}
+
+	if (trace_path) {
+		if (trace_replay(&pool, trace_path, out_path, time_scale,
+				 batch_size ? batch_size : 256))
+			ret = 1;
+		goto out;
+	}
+
+	control_sched_init(&sched, period_ms * 1e6, policy);
+
+	hlog(HLOG_INFO, "\nStarting water treatment TAI demo\n");
+
+	hlog(HLOG_INFO, "Forward edge tests\n\n");
 	for (int i = 0; i < 12; i++){
-		printf("Test case %d\n", i+1);
+		hlog(HLOG_INFO, "Test case %d\n", i+1);
 		set_temp_val(forward_test_vals[i].temp_val);
 		set_ph_val(forward_test_vals[i].ph_val);
 		set_acid_flow(forward_test_vals[i].acid_flow);
 		set_sod_hydrox_flow(forward_test_vals[i].sod_hydrox_flow);
 		call_function(forward_test_vals[i].func);
-		sleep(3);
+		control_sched_wait(&sched);
+		phase_trace_poll();
 	}
 
-	printf("Backward edge tests\n\n");
+	/* Catch a TA that died between commands before the next phase */
+	session_pool_health_check(&pool);
+
+	hlog(HLOG_INFO, "Backward edge tests\n\n");
 	for (int i = 0; i < 8; i++){
-		printf("Test case %d\n", i+1);
+		hlog(HLOG_INFO, "Test case %d\n", i+1);
 		set_temp_val(backward_test_vals[i].temp_val);
 		set_ph_val(backward_test_vals[i].ph_val);
 		set_acid_flow(backward_test_vals[i].acid_flow);
 		set_sod_hydrox_flow(backward_test_vals[i].sod_hydrox_flow);
 		call_function(backward_test_vals[i].func);
-		sleep(3);
+		control_sched_wait(&sched);
 		set_ph_val(backward_test_vals[i].adj_ph_val);
-		verify_safe_ph();
-		sleep(3);
+		/* Readings of an earlier run or phase are not this one's */
+		verify_safe_ph(i == 0);
+		control_sched_wait(&sched);
+		phase_trace_poll();
 	}
 
-	printf("\nFinished water treatment TAI demo\n");
+	hlog_flush();
+	control_sched_report(&sched);
+out:
+	hlog_flush();
+	if (show_events) {
+		tee = session_pool_acquire(&pool);
+		if (tee) {
+			res = dump_ta_events(tee, &origin);
+			session_pool_release(&pool, tee, res, origin);
+		}
+	}
+	if (show_stats) {
+		tee = session_pool_acquire(&pool);
+		if (tee) {
+			res = read_ta_stats(tee, &stats, &origin);
+			if (res == TEEC_SUCCESS)
+				print_ta_stats(&stats);
+			session_pool_release(&pool, tee, res, origin);
+		}
+	}
+	if (decision_cache)
+		dedup_cache_report(decision_cache);
+	phase_trace_dump();
+	if (session_pool_reopens(&pool))
+		printf("TA sessions reopened: %lu\n", session_pool_reopens(&pool));
+
+	hlog(HLOG_INFO, "We're done, close and release TEE resources\n");
+	session_pool_destroy(&pool);
+	if (decision_cache)
+		dedup_cache_destroy(decision_cache);
+
+	hlog(HLOG_INFO, "\nFinished water treatment TAI demo\n");
+	hlog_stop();
+	return ret;
 }
 
 // optee_example_water_treatment
\ No newline at end of file
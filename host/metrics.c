@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* For WT_STATS_CMDS and WT_REJECT_* */
+#include <water_treatment_ta.h>
+
+#include "events.h"
+#include "host_log.h"
+#include "metrics.h"
+
+/*
+ * Threads that get a shard of their own; the rest share the last one
+ * and pay for an atomic add.
+ */
+#define METRICS_SHARDS		64
+#define METRICS_COLLECTORS	8
+
+/* How long a client has to send its request and take the reply */
+#define METRICS_CLIENT_MS	100
+
+struct metrics_shard {
+	uint64_t commands[WT_STATS_CMDS][2];	/* [cmd][failed] */
+	uint64_t verdicts[METRIC_VERDICTS];
+	uint64_t counter[METRIC_COUNTERS];
+} __attribute__((aligned(64)));
+
+static struct metrics_shard shards[METRICS_SHARDS];
+static uint32_t shards_used;
+static __thread struct metrics_shard *my_shard;
+static __thread int my_shard_shared;
+
+static uint64_t loop_period_ns;
+/* State + 1, 0 until the TA first reported it */
+static uint32_t valves[METRICS_TANKS][METRIC_VALVES];
+
+static struct {
+	metrics_collect_fn fn;
+	void *arg;
+} collectors[METRICS_COLLECTORS];
+static pthread_mutex_t collect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+	int fd;
+	int running;
+	int stopping;
+	pthread_t thread;
+	struct sockaddr_un addr;
+} srv = { .fd = -1 };
+
+static const char *const counter_names[METRIC_COUNTERS][2] = {
+	[METRIC_SESSION_REOPENS] = { "wt_session_reopens_total",
+				     "TA sessions dropped after a failure" },
+	[METRIC_LOOP_TICKS] = { "wt_loop_ticks_total",
+				"Control loop periods run" },
+	[METRIC_LOOP_MISSES] = { "wt_loop_misses_total",
+				 "Control loop waits entered after their "
+				 "deadline" },
+	[METRIC_LOOP_SKIPPED] = { "wt_loop_skipped_total",
+				  "Control loop periods dropped to realign" },
+	[METRIC_CACHE_HITS] = { "wt_cache_hits_total",
+				"Pump commands answered from the decision "
+				"cache, not invoked" },
+};
+
+static const char *const verdict_names[METRIC_VERDICTS] = {
+	[METRIC_ACCEPTED] = "accepted",
+	[METRIC_DEVICE_LIMITS] = "device_limits",
+	[METRIC_ARGS_OOB] = "args_oob",
+	[METRIC_MISSING] = "missing",
+	[METRIC_REJECTED] = "rejected",
+};
+
+static const char *const valve_names[METRIC_VALVES] = {
+	[METRIC_VALVE_SOD_HYDROX] = "sod_hydrox",
+	[METRIC_VALVE_ACID] = "acid",
+};
+
+static struct metrics_shard *shard(void)
+{
+	uint32_t i;
+
+	if (!my_shard) {
+		i = __atomic_fetch_add(&shards_used, 1, __ATOMIC_RELAXED);
+		if (i >= METRICS_SHARDS - 1) {
+			i = METRICS_SHARDS - 1;
+			my_shard_shared = 1;
+		}
+		my_shard = &shards[i];
+	}
+	return my_shard;
+}
+
+/* Only the owner writes a private shard, a plain store is enough */
+static void shard_add(uint64_t *slot, unsigned long n)
+{
+	if (my_shard_shared)
+		__atomic_add_fetch(slot, n, __ATOMIC_RELAXED);
+	else
+		__atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) +
+				 n, __ATOMIC_RELAXED);
+}
+
+void metrics_count(enum metric_counter c, unsigned long n)
+{
+	shard_add(&shard()->counter[c], n);
+}
+
+void metrics_command(uint32_t cmd, TEEC_Result res)
+{
+	if (cmd < WT_STATS_CMDS)
+		shard_add(&shard()->commands[cmd][res != TEEC_SUCCESS], 1);
+}
+
+void metrics_verdict(enum metric_verdict v, unsigned long n)
+{
+	if (n)
+		shard_add(&shard()->verdicts[v], n);
+}
+
+enum metric_verdict metrics_reject_verdict(uint32_t reject)
+{
+	switch (reject) {
+	case WT_REJECT_NONE:
+		return METRIC_ACCEPTED;
+	case WT_REJECT_DEVICE_LIMITS:
+		return METRIC_DEVICE_LIMITS;
+	case WT_REJECT_ARGS_OOB:
+		return METRIC_ARGS_OOB;
+	case WT_REJECT_MISSING:
+		return METRIC_MISSING;
+	default:
+		return METRIC_REJECTED;
+	}
+}
+
+void metrics_valve(uint32_t tank, enum metric_valve valve, uint32_t state)
+{
+	if (tank < METRICS_TANKS)
+		__atomic_store_n(&valves[tank][valve], state + 1,
+				 __ATOMIC_RELAXED);
+}
+
+void metrics_loop_period(uint64_t ns)
+{
+	__atomic_store_n(&loop_period_ns, ns, __ATOMIC_RELAXED);
+}
+
+int metrics_register(metrics_collect_fn fn, void *arg)
+{
+	int i;
+
+	pthread_mutex_lock(&collect_lock);
+	for (i = 0; i < METRICS_COLLECTORS; i++) {
+		if (!collectors[i].fn) {
+			collectors[i].fn = fn;
+			collectors[i].arg = arg;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&collect_lock);
+	return i < METRICS_COLLECTORS ? i : -1;
+}
+
+void metrics_unregister(int handle)
+{
+	if (handle < 0 || handle >= METRICS_COLLECTORS)
+		return;
+
+	pthread_mutex_lock(&collect_lock);
+	collectors[handle].fn = NULL;
+	pthread_mutex_unlock(&collect_lock);
+}
+
+static uint64_t sum(const uint64_t *slot)
+{
+	size_t off = (const char *)slot - (const char *)&shards[0];
+	uint64_t total = 0;
+	uint32_t n = __atomic_load_n(&shards_used, __ATOMIC_RELAXED);
+	uint32_t i;
+
+	if (n > METRICS_SHARDS)
+		n = METRICS_SHARDS;
+	for (i = 0; i < n; i++)
+		total += __atomic_load_n((const uint64_t *)
+					 ((const char *)&shards[i] + off),
+					 __ATOMIC_RELAXED);
+	return total;
+}
+
+static void write_header(FILE *out, const char *name, const char *help,
+			 const char *type)
+{
+	fprintf(out, "# HELP %s %s.\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_write(FILE *out)
+{
+	uint64_t ok;
+	uint64_t failed;
+	uint64_t period;
+	uint32_t state;
+	uint32_t cmd;
+	uint32_t tank;
+	int i;
+
+	write_header(out, "wt_commands_total",
+		     "Commands the control path invoked on the TA", "counter");
+	for (cmd = 0; cmd < WT_STATS_CMDS; cmd++) {
+		ok = sum(&shards[0].commands[cmd][0]);
+		failed = sum(&shards[0].commands[cmd][1]);
+		if (!ok && !failed)
+			continue;
+		fprintf(out, "wt_commands_total{command=\"%s\",result=\"ok\"} "
+			"%llu\n", ta_cmd_name(cmd), (unsigned long long)ok);
+		fprintf(out, "wt_commands_total{command=\"%s\","
+			"result=\"failed\"} %llu\n", ta_cmd_name(cmd),
+			(unsigned long long)failed);
+	}
+
+	write_header(out, "wt_verdicts_total",
+		     "TA verdicts on commands and batched samples", "counter");
+	for (i = 0; i < METRIC_VERDICTS; i++)
+		fprintf(out, "wt_verdicts_total{verdict=\"%s\"} %llu\n",
+			verdict_names[i],
+			(unsigned long long)sum(&shards[0].verdicts[i]));
+
+	for (i = 0; i < METRIC_COUNTERS; i++) {
+		write_header(out, counter_names[i][0], counter_names[i][1],
+			     "counter");
+		fprintf(out, "%s %llu\n", counter_names[i][0],
+			(unsigned long long)sum(&shards[0].counter[i]));
+	}
+
+	period = __atomic_load_n(&loop_period_ns, __ATOMIC_RELAXED);
+	if (period) {
+		write_header(out, "wt_loop_period_seconds",
+			     "Last measured wake-to-wake interval of the "
+			     "control loop", "gauge");
+		fprintf(out, "wt_loop_period_seconds %.9f\n", period / 1e9);
+	}
+
+	write_header(out, "wt_valve_state",
+		     "Valve state or flow setpoint as last reported by the TA",
+		     "gauge");
+	for (tank = 0; tank < METRICS_TANKS; tank++) {
+		for (i = 0; i < METRIC_VALVES; i++) {
+			state = __atomic_load_n(&valves[tank][i],
+						__ATOMIC_RELAXED);
+			if (state)
+				fprintf(out, "wt_valve_state{tank=\"%u\","
+					"valve=\"%s\"} %u\n", tank,
+					valve_names[i], state - 1);
+		}
+	}
+
+	write_header(out, "wt_host_log_dropped_total",
+		     "Host log records dropped on a full queue", "counter");
+	fprintf(out, "wt_host_log_dropped_total %lu\n", hlog_dropped());
+
+	pthread_mutex_lock(&collect_lock);
+	for (i = 0; i < METRICS_COLLECTORS; i++)
+		if (collectors[i].fn)
+			collectors[i].fn(collectors[i].arg, out);
+	pthread_mutex_unlock(&collect_lock);
+}
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void serve_client(int fd)
+{
+	struct timeval tv = { .tv_usec = METRICS_CLIENT_MS * 1000 };
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	char req[512];
+	char *text = NULL;
+	size_t len = 0;
+	ssize_t n = 0;
+	FILE *out;
+	int http;
+
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* curl --unix-socket sends a request, socat and nc need not */
+	if (poll(&pfd, 1, METRICS_CLIENT_MS) > 0)
+		n = recv(fd, req, sizeof(req), MSG_DONTWAIT);
+	http = n >= 4 && !memcmp(req, "GET ", 4);
+
+	out = open_memstream(&text, &len);
+	if (!out)
+		return;
+	metrics_write(out);
+	if (fclose(out))
+		return;
+
+	if (http) {
+		n = snprintf(req, sizeof(req),
+			     "HTTP/1.0 200 OK\r\n"
+			     "Content-Type: text/plain; version=0.0.4\r\n"
+			     "Content-Length: %zu\r\n\r\n", len);
+		if (send_all(fd, req, n))
+			goto out;
+	}
+	send_all(fd, text, len);
+out:
+	free(text);
+}
+
+static void *serve_run(void *arg)
+{
+	int fd;
+
+	(void)arg;
+
+	for (;;) {
+		fd = accept(srv.fd, NULL, NULL);
+		if (fd < 0) {
+			if (__atomic_load_n(&srv.stopping, __ATOMIC_ACQUIRE))
+				break;
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			hlog(HLOG_ERROR, "metrics: accept: %s\n",
+			     strerror(errno));
+			break;
+		}
+		serve_client(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+int metrics_serve(const char *path)
+{
+	static int registered;
+	int saved;
+
+	if (srv.running)
+		return 0;
+
+	if (strlen(path) >= sizeof(srv.addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(&srv.addr, 0, sizeof(srv.addr));
+	srv.addr.sun_family = AF_UNIX;
+	strcpy(srv.addr.sun_path, path);
+
+	srv.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (srv.fd < 0)
+		return -1;
+	unlink(path);
+	if (bind(srv.fd, (struct sockaddr *)&srv.addr, sizeof(srv.addr)) ||
+	    listen(srv.fd, 8))
+		goto err;
+
+	srv.stopping = 0;
+	if (pthread_create(&srv.thread, NULL, serve_run, NULL)) {
+		errno = EAGAIN;
+		unlink(path);
+		goto err;
+	}
+
+	if (!registered && !atexit(metrics_stop))
+		registered = 1;
+	srv.running = 1;
+	return 0;
+
+err:
+	saved = errno;
+	close(srv.fd);
+	srv.fd = -1;
+	errno = saved;
+	return -1;
+}
+
+void metrics_stop(void)
+{
+	if (!srv.running)
+		return;
+
+	__atomic_store_n(&srv.stopping, 1, __ATOMIC_RELEASE);
+	/* Wakes the accept() */
+	shutdown(srv.fd, SHUT_RDWR);
+	pthread_join(srv.thread, NULL);
+	close(srv.fd);
+	srv.fd = -1;
+	unlink(srv.addr.sun_path);
+	srv.running = 0;
+}
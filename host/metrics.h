@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/*
+ * Runtime state of the host controller, served as Prometheus text on a
+ * Unix socket. Counters live in per-thread shards that only their own
+ * thread writes, the scraper sums them. Gauges are single words, last
+ * writer wins. Nothing here blocks or allocates after a thread's first
+ * count.
+ */
+
+enum metric_counter {
+	METRIC_SESSION_REOPENS,
+	METRIC_LOOP_TICKS,
+	METRIC_LOOP_MISSES,
+	METRIC_LOOP_SKIPPED,
+	METRIC_CACHE_HITS,	/* pump commands answered by the dedup cache */
+	METRIC_COUNTERS
+};
+
+/* What the TA made of a command, one per reply or per sample in a batch */
+enum metric_verdict {
+	METRIC_ACCEPTED,
+	METRIC_DEVICE_LIMITS,	/* WT_REJECT_DEVICE_LIMITS */
+	METRIC_ARGS_OOB,	/* WT_REJECT_ARGS_OOB */
+	METRIC_MISSING,		/* WT_REJECT_MISSING */
+	METRIC_REJECTED,	/* rejected, the encoding says not why */
+	METRIC_VERDICTS
+};
+
+enum metric_valve {
+	METRIC_VALVE_SOD_HYDROX,
+	METRIC_VALVE_ACID,
+	METRIC_VALVES
+};
+
+/* Tanks whose valves are mirrored, higher IDs are not */
+#define METRICS_TANKS		64
+
+void metrics_count(enum metric_counter c, unsigned long n);
+
+/* A command invoked on the TA, res its outcome; not one answered by a cache */
+void metrics_command(uint32_t cmd, TEEC_Result res);
+
+void metrics_verdict(enum metric_verdict v, unsigned long n);
+
+/* The verdict for a WT_REJECT_* code */
+enum metric_verdict metrics_reject_verdict(uint32_t reject);
+
+/* Valve state or flow setpoint of a tank as the TA last reported it */
+void metrics_valve(uint32_t tank, enum metric_valve valve, uint32_t state);
+
+/* Measured wake-to-wake interval of the control loop */
+void metrics_loop_period(uint64_t ns);
+
+/*
+ * Called on the scraping thread to append more samples to a snapshot,
+ * for state the owner can read on demand such as queue depths.
+ */
+typedef void (*metrics_collect_fn)(void *arg, FILE *out);
+
+/* Returns a handle for metrics_unregister(), or -1 when all are taken */
+int metrics_register(metrics_collect_fn fn, void *arg);
+
+/* Once this returns fn is not running and will not be called again */
+void metrics_unregister(int handle);
+
+/*
+ * Listens on the Unix socket path, replacing whatever is there, and
+ * answers every connection with a snapshot from a thread of its own.
+ * A client that sends an HTTP request gets an HTTP reply, one that sends
+ * nothing gets the bare text. Returns 0 or -1 with errno set.
+ */
+int metrics_serve(const char *path);
+
+/* Stops serving and removes the socket */
+void metrics_stop(void);
+
+/* Writes a snapshot to out */
+void metrics_write(FILE *out);
+
+#endif /* METRICS_H */
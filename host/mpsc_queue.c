@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include "mpsc_queue.h"
+
+int mpsc_queue_init(struct mpsc_queue *q, size_t size)
+{
+	size_t n = 1;
+	size_t i;
+
+	while (n < size)
+		n <<= 1;
+
+	q->cells = calloc(n, sizeof(*q->cells));
+	if (!q->cells)
+		return -1;
+	for (i = 0; i < n; i++)
+		q->cells[i].seq = i;
+	q->mask = n - 1;
+	q->head = 0;
+	q->tail = 0;
+	return 0;
+}
+
+void mpsc_queue_destroy(struct mpsc_queue *q)
+{
+	free(q->cells);
+	q->cells = NULL;
+}
+
+int mpsc_queue_push(struct mpsc_queue *q, const struct tank_reading *r)
+{
+	uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	struct mpsc_cell *cell;
+	int64_t diff;
+
+	for (;;) {
+		cell = &q->cells[pos & q->mask];
+		diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+				 pos);
+		if (diff == 0) {
+			/* Free for this lap, claim it */
+			if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1,
+							1, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Consumer has not freed it yet */
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->reading = *r;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+size_t mpsc_queue_pop(struct mpsc_queue *q, struct tank_reading *out,
+		      size_t max)
+{
+	uint64_t pos = q->tail;
+	struct mpsc_cell *cell;
+	size_t n;
+
+	for (n = 0; n < max; n++, pos++) {
+		cell = &q->cells[pos & q->mask];
+		/* Claimed but not yet written counts as empty */
+		if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+		out[n] = cell->reading;
+		/* Hand the cell to the producers' next lap */
+		__atomic_store_n(&cell->seq, pos + q->mask + 1,
+				 __ATOMIC_RELEASE);
+	}
+
+	/* Only the consumer writes it, the store is for mpsc_queue_depth() */
+	__atomic_store_n(&q->tail, pos, __ATOMIC_RELAXED);
+	return n;
+}
+
+int mpsc_queue_ready(struct mpsc_queue *q)
+{
+	struct mpsc_cell *cell = &q->cells[q->tail & q->mask];
+
+	return __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == q->tail + 1;
+}
+
+size_t mpsc_queue_depth(struct mpsc_queue *q)
+{
+	uint64_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	uint64_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+	return head > tail ? head - tail : 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* For struct wt_sample */
+#include <water_treatment_ta.h>
+
+/* One sensor reading waiting for its tank's worker */
+struct tank_reading {
+	struct wt_sample sample;
+	uint64_t capture_ns;	/* bench_now_ns() when it was taken */
+	uint64_t deadline_ns;	/* decision useless after this, 0 for never */
+	uint64_t submit_ns;	/* bench_now_ns() when it was queued */
+	uint32_t id;		/* caller's tag, handed back with the decision */
+};
+
+struct mpsc_cell {
+	uint64_t seq;
+	struct tank_reading reading;
+};
+
+/*
+ * Bounded queue that any number of threads push into and exactly one
+ * thread pops from, without locks. Every cell carries a sequence number
+ * telling producers whether it is free for the lap they are on and the
+ * consumer whether it has been published yet, so a producer only ever
+ * contends with other producers on the head counter.
+ */
+struct mpsc_queue {
+	uint64_t head __attribute__((aligned(64)));	/* next push */
+	uint64_t tail __attribute__((aligned(64)));	/* next pop */
+	struct mpsc_cell *cells;
+	uint64_t mask;
+};
+
+/* size is rounded up to a power of two */
+int mpsc_queue_init(struct mpsc_queue *q, size_t size);
+void mpsc_queue_destroy(struct mpsc_queue *q);
+
+/* Returns 0, or -1 when the queue is full */
+int mpsc_queue_push(struct mpsc_queue *q, const struct tank_reading *r);
+
+/* Consumer only: moves up to max readings to out, returns how many */
+size_t mpsc_queue_pop(struct mpsc_queue *q, struct tank_reading *out,
+		      size_t max);
+
+/* Consumer only: nonzero when a pop would return something */
+int mpsc_queue_ready(struct mpsc_queue *q);
+
+/* Any thread: readings claimed but not yet popped, a snapshot */
+size_t mpsc_queue_depth(struct mpsc_queue *q);
+
+#endif /* MPSC_QUEUE_H */
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* For WT_TRACE_PARAM and the command IDs */
+#include <water_treatment_ta.h>
+
+#include "bench.h"
+#include "events.h"
+#include "phase_trace.h"
+
+/* Command IDs traced, same range as the TA's own statistics */
+#define PHASE_CMDS		WT_STATS_CMDS
+
+struct phase_span {
+	uint64_t start_ns;
+	uint64_t last_ns;
+	uint64_t ns[PHASES];
+	uint32_t marked;	/* bit per phase with a time */
+	uint32_t cmd;
+	int active;
+};
+
+static struct phase_hist *hists[PHASE_CMDS];	/* [PHASES] each */
+static int enabled;
+static volatile sig_atomic_t dump_requested;
+static __thread struct phase_span span;
+
+static const char *const phase_names[PHASES] = {
+	[PHASE_SESSION] = "session",
+	[PHASE_MARSHAL] = "marshal",
+	[PHASE_LOG] = "log",
+	[PHASE_INVOKE] = "invoke",
+	[PHASE_TA] = "ta(ms)",
+	[PHASE_SWITCH] = "switch",
+	[PHASE_TOTAL] = "total",
+};
+
+static uint32_t hist_index(uint64_t v)
+{
+	uint32_t shift;
+
+	if (v < 2 * PHASE_HIST_HALF)
+		return v;
+
+	/* Keep the top PHASE_HIST_SUB_BITS bits */
+	shift = 63 - __builtin_clzll(v) - (PHASE_HIST_SUB_BITS - 1);
+	if (shift > PHASE_HIST_MAX_SHIFT)
+		return PHASE_HIST_BUCKETS - 1;
+	return (shift + 1) * PHASE_HIST_HALF +
+	       (uint32_t)(v >> shift) - PHASE_HIST_HALF;
+}
+
+static uint64_t hist_upper(uint32_t i)
+{
+	uint32_t shift;
+	uint64_t top;
+
+	if (i < 2 * PHASE_HIST_HALF)
+		return i;
+	shift = i / PHASE_HIST_HALF - 1;
+	top = i % PHASE_HIST_HALF + PHASE_HIST_HALF;
+	return ((top + 1) << shift) - 1;
+}
+
+void phase_hist_add(struct phase_hist *h, uint64_t ns)
+{
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&h->bucket[hist_index(ns)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&h->max, &max, ns, 1,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+uint64_t phase_hist_quantile(const struct phase_hist *h, double q)
+{
+	uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+	uint64_t want = count * q;
+	uint64_t seen = 0;
+	uint32_t i;
+
+	if (!count)
+		return 0;
+
+	for (i = 0; i < PHASE_HIST_BUCKETS; i++) {
+		seen += __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED);
+		if (seen > want)
+			break;
+	}
+	if (i == PHASE_HIST_BUCKETS)
+		i--;
+	/* Never report more than was seen */
+	return hist_upper(i) < h->max ? hist_upper(i) : h->max;
+}
+
+static void on_sigusr1(int sig)
+{
+	(void)sig;
+	dump_requested = 1;
+}
+
+void phase_trace_start(void)
+{
+	struct sigaction sa;
+	uint32_t cmd;
+
+	for (cmd = 0; cmd < PHASE_CMDS; cmd++) {
+		hists[cmd] = calloc(PHASES, sizeof(*hists[cmd]));
+		if (!hists[cmd])
+			return;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_sigusr1;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	__atomic_store_n(&enabled, 1, __ATOMIC_RELEASE);
+}
+
+int phase_trace_enabled(void)
+{
+	return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+void phase_begin(void)
+{
+	if (!phase_trace_enabled())
+		return;
+
+	memset(&span, 0, sizeof(span));
+	span.cmd = PHASE_CMDS;
+	span.start_ns = bench_now_ns();
+	span.last_ns = span.start_ns;
+	span.active = 1;
+}
+
+void phase_mark(enum phase phase)
+{
+	uint64_t now;
+
+	if (!span.active)
+		return;
+
+	now = bench_now_ns();
+	span.ns[phase] += now - span.last_ns;
+	span.marked |= 1u << phase;
+	span.last_ns = now;
+}
+
+void phase_reply(uint32_t cmd, const TEEC_Operation *op, TEEC_Result res)
+{
+	uint64_t ta_ns;
+
+	if (!span.active)
+		return;
+
+	span.cmd = cmd;
+	/* A failed invoke or a cached reply has no TA times */
+	if (res != TEEC_SUCCESS ||
+	    TEEC_PARAM_TYPE_GET(op->paramTypes, WT_TRACE_PARAM) !=
+	    TEEC_VALUE_OUTPUT ||
+	    !op->params[WT_TRACE_PARAM].value.a)
+		return;
+
+	ta_ns = (uint64_t)(op->params[WT_TRACE_PARAM].value.b -
+			   op->params[WT_TRACE_PARAM].value.a) * 1000000;
+	span.ns[PHASE_TA] = ta_ns;
+	span.marked |= 1u << PHASE_TA;
+}
+
+void phase_end(void)
+{
+	struct phase_hist *h;
+	int p;
+
+	if (!span.active)
+		return;
+	span.active = 0;
+	if (span.cmd >= PHASE_CMDS)
+		return;
+
+	span.ns[PHASE_TOTAL] = bench_now_ns() - span.start_ns;
+	span.marked |= 1u << PHASE_TOTAL;
+	if ((span.marked & (1u << PHASE_TA)) &&
+	    (span.marked & (1u << PHASE_INVOKE)) &&
+	    span.ns[PHASE_TA] >= PHASE_TA_MIN_NS) {
+		span.ns[PHASE_SWITCH] = span.ns[PHASE_INVOKE] >
+					span.ns[PHASE_TA] ?
+					span.ns[PHASE_INVOKE] -
+					span.ns[PHASE_TA] : 0;
+		span.marked |= 1u << PHASE_SWITCH;
+	}
+
+	h = hists[span.cmd];
+	for (p = 0; p < PHASES; p++)
+		if (span.marked & (1u << p))
+			phase_hist_add(&h[p], span.ns[p]);
+}
+
+void phase_trace_dump(void)
+{
+	const struct phase_hist *h;
+	uint32_t cmd;
+	int p;
+
+	if (!phase_trace_enabled())
+		return;
+
+	printf("Command phases (us); ta(ms) is counted by the TA in whole "
+	       "milliseconds,\nswitch only for commands with %llu ms of "
+	       "it or more\n", PHASE_TA_MIN_NS / 1000000);
+	printf("  %-14s %-8s %10s %10s %10s %10s %10s\n", "command", "phase",
+	       "count", "p50", "p99", "p99.9", "max");
+	for (cmd = 0; cmd < PHASE_CMDS; cmd++) {
+		h = hists[cmd];
+		if (!h[PHASE_TOTAL].count)
+			continue;
+		for (p = 0; p < PHASES; p++) {
+			if (!h[p].count)
+				continue;
+			printf("  %-14s %-8s %10lu %10.1f %10.1f %10.1f "
+			       "%10.1f\n", ta_cmd_name(cmd), phase_names[p],
+			       (unsigned long)h[p].count,
+			       phase_hist_quantile(&h[p], 0.5) / 1e3,
+			       phase_hist_quantile(&h[p], 0.99) / 1e3,
+			       phase_hist_quantile(&h[p], 0.999) / 1e3,
+			       h[p].max / 1e3);
+		}
+	}
+}
+
+void phase_trace_poll(void)
+{
+	if (!dump_requested)
+		return;
+	dump_requested = 0;
+	phase_trace_dump();
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PHASE_TRACE_H
+#define PHASE_TRACE_H
+
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/*
+ * Where the time of a command goes. A span covers one command from
+ * session acquire to release. Each phase_mark() charges the time since
+ * the previous mark to one phase. The TA phase comes from the trace slot
+ * of the reply, see WT_TRACE_PARAM, in whole milliseconds: a command
+ * that took microseconds shows 0 or 1 ms. SWITCH is the rest of INVOKE:
+ * world switch, driver and marshalling by the client library. It is only
+ * derived from spans whose TA time is PHASE_TA_MIN_NS or more, where a
+ * millisecond either way is a small part of it; commands shorter than
+ * that have no SWITCH at all.
+ */
+enum phase {
+	PHASE_SESSION,		/* acquire and release of a pooled session */
+	PHASE_MARSHAL,		/* packing the op and reading the reply */
+	PHASE_LOG,		/* host log calls */
+	PHASE_INVOKE,		/* TEEC_InvokeCommand(), TA included */
+	PHASE_TA,		/* TA entry to exit, millisecond resolution */
+	PHASE_SWITCH,		/* INVOKE less TA, long commands only */
+	PHASE_TOTAL,
+	PHASES
+};
+
+/* Shortest TA time SWITCH is derived from, ten ticks of its clock */
+#define PHASE_TA_MIN_NS		10000000ULL
+
+/*
+ * Log-linear histogram in the manner of HdrHistogram: exact below 64 ns,
+ * above that 32 buckets per power of two, about 3% precision, up to 2^37
+ * ns. Values past the range land in the last bucket.
+ */
+#define PHASE_HIST_SUB_BITS	6
+#define PHASE_HIST_HALF		(1 << (PHASE_HIST_SUB_BITS - 1))
+#define PHASE_HIST_MAX_SHIFT	31
+#define PHASE_HIST_BUCKETS	((PHASE_HIST_MAX_SHIFT + 2) * PHASE_HIST_HALF)
+
+struct phase_hist {
+	uint64_t count;
+	uint64_t max;
+	uint64_t bucket[PHASE_HIST_BUCKETS];
+};
+
+/* Records are thread safe */
+void phase_hist_add(struct phase_hist *h, uint64_t ns);
+
+/* Upper bound of the bucket holding the q-th quantile, 0 if empty */
+uint64_t phase_hist_quantile(const struct phase_hist *h, double q);
+
+/*
+ * Turns tracing on and installs a SIGUSR1 handler asking for a dump,
+ * which phase_trace_poll() then prints. Until then the calls below do
+ * nothing.
+ */
+void phase_trace_start(void);
+int phase_trace_enabled(void);
+
+/* Span of the calling thread */
+void phase_begin(void);
+void phase_mark(enum phase phase);
+
+/*
+ * Takes the TA times from the trace slot of op, if it asked for one and
+ * the TA answered, and names the command the span is recorded under.
+ */
+void phase_reply(uint32_t cmd, const TEEC_Operation *op, TEEC_Result res);
+
+/* Records the span's phases under its command */
+void phase_end(void);
+
+/* p50/p99/p99.9/max of every phase of every command seen */
+void phase_trace_dump(void);
+
+/* Dumps if SIGUSR1 came in since the last call */
+void phase_trace_poll(void);
+
+#endif /* PHASE_TRACE_H */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+
+#include "plant_model.h"
+
+#define PLANT_VOLUME		1000.0	/* litres */
+#define PLANT_RESIDENCE		1200.0	/* seconds, volume / feed flow */
+#define PLANT_DOSE_RATE		0.02	/* mol/s of reagent per flow unit */
+#define PLANT_BUFFER		2e-3	/* weak acid buffer, mol/L */
+#define PLANT_BUFFER_KA		1e-7	/* its dissociation constant */
+#define PLANT_KW		1e-14
+#define PLANT_TEMP_TAU		7200.0	/* seconds to follow the ambient */
+#define PLANT_FEED_SLEW		(1.0 / 600)	/* feed pH change per second */
+#define PLANT_DAY		86400.0
+
+/* xorshift32, as in the load generator */
+static uint32_t next_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static double rand_range(uint32_t *state, double lo, double hi)
+{
+	return lo + (hi - lo) * (next_rand(state) / 4294967296.0);
+}
+
+/*
+ * Charge balance of the tank as a function of pH: zero at the tank's pH,
+ * decreasing as the pH rises.
+ */
+static double charge(double excess_base, double ph)
+{
+	double h = pow(10, -ph);
+
+	return excess_base + h - PLANT_KW / h -
+	       PLANT_BUFFER * PLANT_BUFFER_KA / (PLANT_BUFFER_KA + h);
+}
+
+static double solve_ph(double excess_base)
+{
+	double lo = 0, hi = 14, mid;
+	int i;
+
+	/* 0.001 pH, the sensor resolution, takes 14 halvings */
+	for (i = 0; i < 20; i++) {
+		mid = (lo + hi) / 2;
+		if (charge(excess_base, mid) > 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return (lo + hi) / 2;
+}
+
+/* Excess base of buffered water at pH ph, the inverse of solve_ph() */
+static double excess_base_at(double ph)
+{
+	return -charge(0, ph);
+}
+
+void plant_init(struct plant *p, uint32_t seed)
+{
+	p->rnd = seed * 2654435761u | 1;
+	p->t = 0;
+	p->ambient = rand_range(&p->rnd, 45, 85);
+	p->temp = p->ambient;
+	p->feed_ph = rand_range(&p->rnd, 2, 12);
+	p->feed_target = p->feed_ph;
+	p->next_change = rand_range(&p->rnd, 0, 3600);
+	p->ph = rand_range(&p->rnd, 3, 11);
+	p->excess_base = excess_base_at(p->ph);
+}
+
+void plant_step(struct plant *p, double dt, uint32_t sod_hydrox,
+		uint32_t acid)
+{
+	double ambient;
+	double mix;
+
+	/* The feed drifts between off-spec batches every hour or so */
+	if (p->t >= p->next_change) {
+		p->feed_target = rand_range(&p->rnd, 2, 12);
+		p->next_change = p->t + rand_range(&p->rnd, 1800, 5400);
+	}
+	if (p->feed_ph < p->feed_target)
+		p->feed_ph = fmin(p->feed_ph + PLANT_FEED_SLEW * dt,
+				  p->feed_target);
+	else
+		p->feed_ph = fmax(p->feed_ph - PLANT_FEED_SLEW * dt,
+				  p->feed_target);
+
+	mix = fmin(dt / PLANT_RESIDENCE, 1);
+	p->excess_base += (excess_base_at(p->feed_ph) - p->excess_base) * mix;
+	p->excess_base += PLANT_DOSE_RATE * dt *
+			  ((double)sod_hydrox - (double)acid) / PLANT_VOLUME;
+	p->ph = solve_ph(p->excess_base);
+
+	/* Day/night swing of the site, the tank lags behind it */
+	ambient = p->ambient + 10 * sin(2 * M_PI * p->t / PLANT_DAY);
+	p->temp += (ambient - p->temp) * fmin(dt / PLANT_TEMP_TAU, 1);
+
+	p->t += dt;
+}
+
+uint32_t plant_milli_ph(const struct plant *p)
+{
+	return (uint32_t)lround(p->ph * 1000);
+}
+
+int32_t plant_temp(const struct plant *p)
+{
+	return (int32_t)lround(p->temp);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PLANT_MODEL_H
+#define PLANT_MODEL_H
+
+#include <stdint.h>
+
+/*
+ * Deterministic model of one neutralisation tank: a continuously fed,
+ * well mixed volume of weakly buffered water, dosed with sodium
+ * hydroxide and acid at the flows the TA sets. Everything follows from
+ * the seed and the flows, so the same seed and the same controller give
+ * the same run no matter how fast or on which thread it is stepped.
+ */
+struct plant {
+	double excess_base;	/* strong base minus strong acid, mol/L */
+	double ph;		/* solved from excess_base after each step */
+	double temp;		/* degrees, same units as the TA's readings */
+
+	double feed_ph;		/* pH of the water flowing in */
+	double feed_target;	/* where feed_ph is drifting to */
+	double ambient;		/* mean ambient temperature of this site */
+	double t;		/* virtual seconds since plant_init() */
+	double next_change;	/* when feed_target moves next */
+	uint32_t rnd;
+};
+
+void plant_init(struct plant *p, uint32_t seed);
+
+/* Advances the tank dt virtual seconds with the valves at these flows */
+void plant_step(struct plant *p, double dt, uint32_t sod_hydrox,
+		uint32_t acid);
+
+/* What the tank's sensors read: milli-pH and whole degrees */
+uint32_t plant_milli_ph(const struct plant *p);
+int32_t plant_temp(const struct plant *p);
+
+#endif /* PLANT_MODEL_H */
@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <water_treatment_ta.h>
+
+#include "bench.h"
+#include "plant_model.h"
+#include "plant_sim.h"
+#include "session_pool.h"
+#include "tank_control.h"
+
+/* Tight band the loop aims for, the safe band is WT_PH_SAFE_MIN/MAX */
+#define SIM_TIGHT_BAND		0.5
+/* Ticks after the start a tank is given to settle before it is judged */
+#define SIM_SETTLE_TICKS	600
+
+struct sim_tank {
+	struct plant plant;
+	struct session_pool pool;
+	uint32_t sod_hydrox;	/* flows the TA last set */
+	uint32_t acid;
+
+	unsigned long judged;	/* ticks past the settling time */
+	unsigned long in_safe;	/* of those, within the safe band */
+	unsigned long in_tight;
+	double abs_err;		/* sum of |pH - 7| over them */
+	double max_err;
+	unsigned long changes;	/* ticks a flow setpoint changed */
+};
+
+struct sim_worker {
+	struct plant_sim *sim;
+	pthread_t thread;
+	size_t first;
+	size_t count;
+
+	unsigned long decisions;
+	unsigned long missed;		/* decisions after their period */
+	unsigned long rejected;		/* readings past the device limits */
+	unsigned long failed;		/* invokes that failed */
+	uint64_t worst_late_ns;
+};
+
+struct plant_sim {
+	struct sim_tank *tanks;
+	size_t ticks;
+	double period_s;
+	uint64_t real_period_ns;	/* 0 when not paced */
+	pthread_barrier_t start;
+	uint64_t start_ns;		/* period n ends n + 1 periods later */
+};
+
+/* Absolute sleep on the shared grid, like control_sched_wait() */
+static void sim_sleep_until(uint64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static void sim_decide(struct sim_worker *w, struct sim_tank *t)
+{
+	struct dose_reply reply;
+	struct test_ctx *tee;
+	uint32_t origin = 0;
+	TEEC_Result res;
+
+	tee = session_pool_acquire(&t->pool);
+	if (!tee) {
+		/* Valves stay where they were until the session is back */
+		w->failed++;
+		return;
+	}
+	res = dose_tank(tee, plant_temp(&t->plant),
+			plant_milli_ph(&t->plant), &reply, &origin);
+	session_pool_release(&t->pool, tee, res, origin);
+
+	if (res != TEEC_SUCCESS) {
+		w->failed++;
+		return;
+	}
+	if (reply.reason == WT_CONTROL_DEVICE_LIMITS)
+		w->rejected++;
+	if (reply.sod_hydrox != t->sod_hydrox || reply.acid != t->acid)
+		t->changes++;
+	t->sod_hydrox = reply.sod_hydrox;
+	t->acid = reply.acid;
+}
+
+static void sim_judge(struct sim_tank *t)
+{
+	double err = fabs(t->plant.ph - 7);
+
+	t->judged++;
+	t->in_safe += t->plant.ph >= WT_PH_SAFE_MIN &&
+		      t->plant.ph <= WT_PH_SAFE_MAX;
+	t->in_tight += err <= SIM_TIGHT_BAND;
+	t->abs_err += err;
+	if (err > t->max_err)
+		t->max_err = err;
+}
+
+static void *sim_worker_run(void *arg)
+{
+	struct sim_worker *w = arg;
+	struct plant_sim *sim = w->sim;
+	uint64_t deadline = 0;
+	uint64_t now;
+	size_t tick;
+	size_t i;
+
+	pthread_barrier_wait(&sim->start);
+
+	for (tick = 0; tick < sim->ticks; tick++) {
+		for (i = w->first; i < w->first + w->count; i++) {
+			sim_decide(w, &sim->tanks[i]);
+			w->decisions++;
+		}
+
+		if (sim->real_period_ns) {
+			deadline = sim->start_ns +
+				   (tick + 1) * sim->real_period_ns;
+			now = bench_now_ns();
+			if (now > deadline) {
+				/* The whole period's decisions were late */
+				w->missed += w->count;
+				if (now - deadline > w->worst_late_ns)
+					w->worst_late_ns = now - deadline;
+			}
+		}
+
+		for (i = w->first; i < w->first + w->count; i++) {
+			struct sim_tank *t = &sim->tanks[i];
+
+			plant_step(&t->plant, sim->period_s, t->sod_hydrox,
+				   t->acid);
+			if (tick >= SIM_SETTLE_TICKS)
+				sim_judge(t);
+		}
+
+		/* Late periods run back to back, virtual time never skips */
+		if (sim->real_period_ns)
+			sim_sleep_until(deadline);
+	}
+
+	return NULL;
+}
+
+static void sim_report(struct plant_sim *sim, size_t tanks,
+		       const struct sim_worker *workers, size_t nworkers,
+		       uint64_t elapsed)
+{
+	unsigned long decisions = 0, missed = 0, rejected = 0, failed = 0;
+	unsigned long judged = 0, in_safe = 0, in_tight = 0, changes = 0;
+	uint64_t worst_late = 0;
+	double abs_err = 0, max_err = 0, worst_safe = 1;
+	double virtual_s = sim->ticks * sim->period_s;
+	uint64_t digest = 1469598103934665603ULL;
+	size_t i;
+
+	for (i = 0; i < nworkers; i++) {
+		decisions += workers[i].decisions;
+		missed += workers[i].missed;
+		rejected += workers[i].rejected;
+		failed += workers[i].failed;
+		if (workers[i].worst_late_ns > worst_late)
+			worst_late = workers[i].worst_late_ns;
+	}
+
+	for (i = 0; i < tanks; i++) {
+		struct sim_tank *t = &sim->tanks[i];
+
+		judged += t->judged;
+		in_safe += t->in_safe;
+		in_tight += t->in_tight;
+		abs_err += t->abs_err;
+		changes += t->changes;
+		if (t->max_err > max_err)
+			max_err = t->max_err;
+		if (t->judged && t->in_safe / (double)t->judged < worst_safe)
+			worst_safe = t->in_safe / (double)t->judged;
+
+		/* FNV-1a over the final readings, equal for equal runs */
+		digest = (digest ^ plant_milli_ph(&t->plant)) *
+			 1099511628211ULL;
+		digest = (digest ^ (t->sod_hydrox | t->acid << 8)) *
+			 1099511628211ULL;
+	}
+
+	printf("%.1f virtual hours in %.2fs, %.0fx real time\n",
+	       virtual_s / 3600, elapsed / 1e9, virtual_s / (elapsed / 1e9));
+	printf("  %lu decisions, %.0f decisions/s, %lu failed, "
+	       "%lu past device limits\n", decisions,
+	       decisions / (elapsed / 1e9), failed, rejected);
+	if (sim->real_period_ns)
+		printf("  %lu missed deadlines (%.2f%%), worst %.3fms late\n",
+		       missed, decisions ? 100.0 * missed / decisions : 0,
+		       worst_late / 1e6);
+	if (judged)
+		printf("  pH in %d-%d %.2f%% of the time (worst tank %.2f%%), "
+		       "within %.1f of 7 %.2f%%\n"
+		       "  mean |pH - 7| %.3f, max %.2f, "
+		       "%.1f setpoint changes per tank per hour\n",
+		       WT_PH_SAFE_MIN, WT_PH_SAFE_MAX,
+		       100.0 * in_safe / judged, 100 * worst_safe,
+		       SIM_TIGHT_BAND, 100.0 * in_tight / judged,
+		       abs_err / judged, max_err,
+		       changes / (double)tanks / (virtual_s / 3600));
+	printf("  final state digest %016" PRIx64 "\n", digest);
+}
+
+int plant_sim_run(size_t tanks, double hours, double period_s,
+		  double speedup, size_t workers)
+{
+	struct plant_sim sim = { 0 };
+	struct sim_worker *w;
+	uint64_t elapsed;
+	size_t opened = 0;
+	size_t per;
+	size_t i;
+	int ret = -1;
+
+	if (!tanks || !workers || hours <= 0 || period_s <= 0 || speedup < 0)
+		return -1;
+	if (workers > tanks)
+		workers = tanks;
+
+	sim.ticks = hours * 3600 / period_s;
+	sim.period_s = period_s;
+	if (speedup)
+		sim.real_period_ns = period_s * 1e9 / speedup;
+
+	sim.tanks = calloc(tanks, sizeof(*sim.tanks));
+	w = calloc(workers, sizeof(*w));
+	if (!sim.tanks || !w)
+		err(1, "calloc");
+
+	printf("Plant simulation: %zu tanks, %.1f hours in %.1fs periods, "
+	       "%zu workers, ", tanks, hours, period_s, workers);
+	if (speedup)
+		printf("%.0fx real time\n", speedup);
+	else
+		printf("as fast as possible\n");
+
+	for (opened = 0; opened < tanks; opened++) {
+		plant_init(&sim.tanks[opened].plant, opened);
+		if (session_pool_init(&sim.tanks[opened].pool, opened, 1, 1) !=
+		    TEEC_SUCCESS) {
+			warnx("Failed to open a session for tank %zu", opened);
+			goto out;
+		}
+	}
+
+	pthread_barrier_init(&sim.start, NULL, workers + 1);
+	per = (tanks + workers - 1) / workers;
+	for (i = 0; i < workers; i++) {
+		w[i].sim = &sim;
+		w[i].first = i * per < tanks ? i * per : tanks;
+		w[i].count = tanks - w[i].first < per ?
+			     tanks - w[i].first : per;
+	}
+
+	for (i = 0; i < workers; i++)
+		if (pthread_create(&w[i].thread, NULL, sim_worker_run, &w[i]))
+			err(1, "pthread_create");
+
+	/* Set before anyone passes the barrier, so all share one grid */
+	sim.start_ns = bench_now_ns();
+	pthread_barrier_wait(&sim.start);
+	for (i = 0; i < workers; i++)
+		pthread_join(w[i].thread, NULL);
+	elapsed = bench_now_ns() - sim.start_ns;
+	pthread_barrier_destroy(&sim.start);
+
+	sim_report(&sim, tanks, w, workers, elapsed);
+	ret = 0;
+	for (i = 0; i < workers; i++)
+		if (w[i].failed)
+			ret = -1;
+out:
+	for (i = 0; i < opened; i++)
+		session_pool_destroy(&sim.tanks[i].pool);
+	free(w);
+	free(sim.tanks);
+	return ret;
+}
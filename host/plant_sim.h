@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PLANT_SIM_H
+#define PLANT_SIM_H
+
+#include <stddef.h>
+
+/*
+ * Closes the loop between simulated tanks and the TA: every control
+ * period each of tanks plant models is read, the reading goes to the TA
+ * as a TA_WATER_TREATMENT_CMD_DOSE on that tank's own session and the
+ * flows it answers with drive the model through the next period.
+ *
+ * hours of virtual time are run on workers threads. With speedup 0 they
+ * go as fast as the TA answers; otherwise each period lasts period_s /
+ * speedup seconds of real time and a decision that lands after the end
+ * of its period counts as a missed deadline. Reports decisions per
+ * second, missed deadlines and how well the pH was held.
+ */
+int plant_sim_run(size_t tanks, double hours, double period_s,
+		  double speedup, size_t workers);
+
+#endif /* PLANT_SIM_H */
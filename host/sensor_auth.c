@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <time.h>
+
+#include "sensor_auth.h"
+
+void sensor_signer_init(struct sensor_signer *s, const void *key,
+			size_t key_len, uint32_t tank)
+{
+	struct timespec ts;
+
+	hmac_sha256_key(&s->key, key, key_len);
+	s->tank = tank;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	s->seq = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sensor_sign_batch(struct sensor_signer *s, struct wt_auth_batch *batch,
+		       uint32_t count)
+{
+	struct sha256 sha = s->key.inner;
+
+	batch->seq = ++s->seq;
+	batch->tank = s->tank;
+	batch->count = count;
+
+	sha256_update(&sha, batch, offsetof(struct wt_auth_batch, mac));
+	sha256_update(&sha, batch->samples, count * sizeof(struct wt_sample));
+	hmac_sha256_final(&s->key, &sha, batch->mac);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SENSOR_AUTH_H
+#define SENSOR_AUTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* For struct wt_auth_batch */
+#include <water_treatment_ta.h>
+
+#include "sha256.h"
+
+/*
+ * The sensor end of TA_WATER_TREATMENT_CMD_AUTH_BATCH: signs batches for
+ * one tank with HMAC-SHA256 under a shared key and numbers them.
+ */
+struct sensor_signer {
+	struct hmac_sha256 key;
+	uint32_t tank;
+	uint64_t seq;		/* of the last batch signed */
+};
+
+/*
+ * The TA remembers the last seq it accepted for the tank across sessions,
+ * so a signer that starts over must not start from 1. Numbering from the
+ * wall clock in nanoseconds keeps every batch of a new signer above those
+ * of the one before it, with no counter to store.
+ */
+void sensor_signer_init(struct sensor_signer *s, const void *key,
+			size_t key_len, uint32_t tank);
+
+/*
+ * Fills in seq, tank, count and mac of a batch whose count samples are
+ * already in batch->samples.
+ */
+void sensor_sign_batch(struct sensor_signer *s, struct wt_auth_batch *batch,
+		       uint32_t count);
+
+#endif /* SENSOR_AUTH_H */
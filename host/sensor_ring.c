@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "phase_trace.h"
+#include "sensor_ring.h"
+
+TEEC_Result sensor_ring_init(struct sensor_ring *ring, TEEC_Context *ctx,
+			     uint32_t size)
+{
+	uint32_t slots = 1;
+	TEEC_Result res;
+
+	if (!size || size > (1u << 20))
+		return TEEC_ERROR_BAD_PARAMETERS;
+	while (slots < size)
+		slots <<= 1;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->shm.size = WT_RING_BYTES(slots);
+	ring->shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	res = TEEC_AllocateSharedMemory(ctx, &ring->shm);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_AllocateSharedMemory failed with code 0x%x", res);
+		return res;
+	}
+
+	memset(ring->shm.buffer, 0, ring->shm.size);
+	ring->hdr = ring->shm.buffer;
+	ring->hdr->size = slots;
+	ring->samples = (struct wt_sample *)(ring->hdr + 1);
+	ring->decisions = (struct wt_decision *)(ring->samples + slots);
+	ring->mask = slots - 1;
+
+	return TEEC_SUCCESS;
+}
+
+void sensor_ring_destroy(struct sensor_ring *ring)
+{
+	if (!ring->hdr)
+		return;
+
+	TEEC_ReleaseSharedMemory(&ring->shm);
+	ring->hdr = NULL;
+}
+
+int sensor_ring_push(struct sensor_ring *ring, const struct wt_sample *s)
+{
+	uint32_t head = ring->hdr->head;
+	uint32_t tail = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail > ring->mask)
+		return -1;
+
+	ring->samples[head & ring->mask] = *s;
+	/* Publish the sample before the TA can see the new head */
+	__atomic_store_n(&ring->hdr->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+TEEC_Result sensor_ring_drain(struct sensor_ring *ring, TEEC_Session *sess,
+			      uint32_t *first, uint32_t *count,
+			      uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+	uint32_t tail = ring->hdr->tail;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_VALUE_OUTPUT,
+					 TEEC_NONE,
+					 phase_trace_enabled() ?
+					 TEEC_VALUE_OUTPUT : TEEC_NONE);
+	op.params[0].memref.parent = &ring->shm;
+	phase_mark(PHASE_MARSHAL);
+
+	res = TEEC_InvokeCommand(sess, TA_WATER_TREATMENT_CMD_DRAIN, &op,
+				 &origin);
+	phase_mark(PHASE_INVOKE);
+	phase_reply(TA_WATER_TREATMENT_CMD_DRAIN, &op, res);
+	metrics_command(TA_WATER_TREATMENT_CMD_DRAIN, res);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	ring->drains++;
+	ring->drained += op.params[1].value.a;
+	metrics_verdict(METRIC_ACCEPTED,
+			op.params[1].value.a - op.params[1].value.b);
+	metrics_verdict(METRIC_DEVICE_LIMITS, op.params[1].value.b);
+	if (first)
+		*first = tail;
+	if (count)
+		*count = op.params[1].value.a;
+
+	return TEEC_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SENSOR_RING_H
+#define SENSOR_RING_H
+
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* For struct wt_ring and friends */
+#include <water_treatment_ta.h>
+
+/*
+ * Host side of the shared struct wt_ring. The sensor loop pushes samples
+ * straight into shared memory and only talks to the TA when it drains,
+ * so one world switch carries everything pushed since the last drain.
+ * Pushing and draining must happen from the same thread.
+ */
+struct sensor_ring {
+	TEEC_SharedMemory shm;
+	struct wt_ring *hdr;
+	struct wt_sample *samples;
+	struct wt_decision *decisions;
+	uint32_t mask;
+	unsigned long drains;	/* DRAIN invokes */
+	unsigned long drained;	/* samples evaluated by those invokes */
+};
+
+/* size is rounded up to a power of two */
+TEEC_Result sensor_ring_init(struct sensor_ring *ring, TEEC_Context *ctx,
+			     uint32_t size);
+void sensor_ring_destroy(struct sensor_ring *ring);
+
+/* Returns 0, or -1 when the ring is full and needs draining first */
+int sensor_ring_push(struct sensor_ring *ring, const struct wt_sample *s);
+
+/*
+ * Has the TA evaluate every pushed sample. On success *first is the ring
+ * index of the first one evaluated and *count how many there were, their
+ * decisions stay readable through sensor_ring_decision() until the next
+ * push overwrites the slot.
+ */
+TEEC_Result sensor_ring_drain(struct sensor_ring *ring, TEEC_Session *sess,
+			      uint32_t *first, uint32_t *count,
+			      uint32_t *err_origin);
+
+static inline const struct wt_decision *
+sensor_ring_decision(const struct sensor_ring *ring, uint32_t index)
+{
+	return &ring->decisions[index & ring->mask];
+}
+
+#endif /* SENSOR_RING_H */
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* For the UUID (found in the TA's h-file(s)) */
+#include <water_treatment_ta.h>
+
+#include "metrics.h"
+#include "session_pool.h"
+
+static TEEC_Result slot_open(struct session_pool *pool,
+			     struct pool_slot *slot)
+{
+	TEEC_UUID uuid = TA_WATER_TREATMENT_UUID;
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	/* Initialize a context connecting us to the TEE */
+	res = TEEC_InitializeContext(NULL, &slot->tee.ctx);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InitializeContext failed with code 0x%x", res);
+		return res;
+	}
+
+	/*
+	 * Open a session with the TA, on behalf of one tank, offering the
+	 * packed pump command encoding. An older TA refuses the offer, it
+	 * gets the plain open it knows instead.
+	 */
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INOUT,
+					 TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = pool->tank_id;
+	op.params[1].value.a = WT_PARAMS_VERSION;
+	if (pool->mode) {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INOUT,
+						 TEEC_VALUE_INPUT, TEEC_NONE);
+		op.params[2].value.a = pool->mode;
+	}
+
+	res = TEEC_OpenSession(&slot->tee.ctx, &slot->tee.sess, &uuid,
+			       TEEC_LOGIN_PUBLIC, NULL, &op, &origin);
+	if (res == TEEC_SUCCESS) {
+		slot->tee.param_version = op.params[1].value.a;
+	} else if (res == TEEC_ERROR_BAD_PARAMETERS &&
+		   origin == TEEC_ORIGIN_TRUSTED_APP && !pool->mode) {
+		/* Never drop the mode, that would open the tank unsigned */
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE,
+						 TEEC_NONE, TEEC_NONE);
+		res = TEEC_OpenSession(&slot->tee.ctx, &slot->tee.sess, &uuid,
+				       TEEC_LOGIN_PUBLIC, NULL, &op, &origin);
+		slot->tee.param_version = WT_PARAMS_LEGACY;
+	}
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_Opensession failed with code 0x%x origin 0x%x",
+		      res, origin);
+		TEEC_FinalizeContext(&slot->tee.ctx);
+		return res;
+	}
+
+	slot->tee.tank_id = pool->tank_id;
+	slot->tee.seq = 0;
+	slot->open = 1;
+	slot->invokes = 0;
+	return TEEC_SUCCESS;
+}
+
+static void slot_close(struct pool_slot *slot)
+{
+	if (!slot->open)
+		return;
+
+	TEEC_CloseSession(&slot->tee.sess);
+	TEEC_FinalizeContext(&slot->tee.ctx);
+	slot->open = 0;
+}
+
+/*
+ * A session is only worth keeping if both the TA instance and the path to
+ * it are still alive. TEEC_ERROR_TARGET_DEAD is what the driver reports
+ * once the TA has panicked, after that every command on the session fails.
+ */
+static int session_is_broken(TEEC_Result res, uint32_t origin)
+{
+	if (res == TEEC_SUCCESS || res == TEEC_ERROR_CANCEL)
+		return 0;
+	if (res == TEEC_ERROR_TARGET_DEAD)
+		return 1;
+	return origin == TEEC_ORIGIN_COMMS || origin == TEEC_ORIGIN_TEE;
+}
+
+TEEC_Result session_pool_init(struct session_pool *pool, uint32_t tank_id,
+			      size_t size, int reuse)
+{
+	return session_pool_init_mode(pool, tank_id, size, reuse, 0);
+}
+
+TEEC_Result session_pool_init_mode(struct session_pool *pool,
+				   uint32_t tank_id, size_t size, int reuse,
+				   uint32_t mode)
+{
+	TEEC_Result res;
+	size_t n;
+
+	if (!size)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->slots = calloc(size, sizeof(*pool->slots));
+	if (!pool->slots)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	pool->size = size;
+	pool->tank_id = tank_id;
+	pool->mode = mode;
+	pool->reuse = reuse;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->free_cond, NULL);
+
+	if (!reuse)
+		return TEEC_SUCCESS;
+
+	/* Pay the TA load and session setup once, up front */
+	for (n = 0; n < size; n++) {
+		res = slot_open(pool, &pool->slots[n]);
+		if (res != TEEC_SUCCESS) {
+			session_pool_destroy(pool);
+			return res;
+		}
+	}
+
+	return TEEC_SUCCESS;
+}
+
+void session_pool_destroy(struct session_pool *pool)
+{
+	size_t n;
+
+	if (!pool->slots)
+		return;
+
+	for (n = 0; n < pool->size; n++)
+		slot_close(&pool->slots[n]);
+
+	pthread_cond_destroy(&pool->free_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->slots);
+	pool->slots = NULL;
+	pool->size = 0;
+}
+
+static struct test_ctx *pool_acquire(struct session_pool *pool, int wait,
+				     int *busy)
+{
+	struct pool_slot *slot = NULL;
+	size_t n;
+
+	if (busy)
+		*busy = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		/* Prefer a slot that already has a live session */
+		for (n = 0; n < pool->size; n++) {
+			if (pool->slots[n].in_use)
+				continue;
+			if (pool->slots[n].open) {
+				slot = &pool->slots[n];
+				break;
+			}
+			if (!slot)
+				slot = &pool->slots[n];
+		}
+		if (slot)
+			break;
+		if (!wait) {
+			pthread_mutex_unlock(&pool->lock);
+			*busy = 1;
+			return NULL;
+		}
+		pthread_cond_wait(&pool->free_cond, &pool->lock);
+	}
+	slot->in_use = 1;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (!slot->open && slot_open(pool, slot) != TEEC_SUCCESS) {
+		pthread_mutex_lock(&pool->lock);
+		slot->in_use = 0;
+		pthread_cond_signal(&pool->free_cond);
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+
+	slot->invokes++;
+	return &slot->tee;
+}
+
+struct test_ctx *session_pool_acquire(struct session_pool *pool)
+{
+	return pool_acquire(pool, 1, NULL);
+}
+
+struct test_ctx *session_pool_try_acquire(struct session_pool *pool,
+					  int *busy)
+{
+	return pool_acquire(pool, 0, busy);
+}
+
+void session_pool_release(struct session_pool *pool, struct test_ctx *tee,
+			  TEEC_Result res, uint32_t origin)
+{
+	struct pool_slot *slot = (struct pool_slot *)tee;
+
+	if (!pool->reuse) {
+		slot_close(slot);
+	} else if (session_is_broken(res, origin)) {
+		warnx("TA session lost (0x%x origin 0x%x), reopening on next use",
+		      res, origin);
+		slot_close(slot);
+		slot->reopens++;
+		metrics_count(METRIC_SESSION_REOPENS, 1);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	slot->in_use = 0;
+	pthread_cond_signal(&pool->free_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+size_t session_pool_health_check(struct session_pool *pool)
+{
+	struct pool_slot *slot;
+	uint32_t origin;
+	TEEC_Result res;
+	size_t reopened = 0;
+	size_t n;
+
+	for (n = 0; n < pool->size; n++) {
+		slot = &pool->slots[n];
+
+		pthread_mutex_lock(&pool->lock);
+		if (slot->in_use || !slot->open) {
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+		slot->in_use = 1;
+		pthread_mutex_unlock(&pool->lock);
+
+		res = TEEC_InvokeCommand(&slot->tee.sess,
+					 TA_WATER_TREATMENT_CMD_PING, NULL,
+					 &origin);
+		if (res != TEEC_SUCCESS) {
+			slot_close(slot);
+			slot->reopens++;
+			metrics_count(METRIC_SESSION_REOPENS, 1);
+			if (slot_open(pool, slot) == TEEC_SUCCESS)
+				reopened++;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		slot->in_use = 0;
+		pthread_cond_signal(&pool->free_cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return reopened;
+}
+
+unsigned long session_pool_reopens(struct session_pool *pool)
+{
+	unsigned long total = 0;
+	size_t n;
+
+	pthread_mutex_lock(&pool->lock);
+	for (n = 0; n < pool->size; n++)
+		total += pool->slots[n].reopens;
+	pthread_mutex_unlock(&pool->lock);
+
+	return total;
+}
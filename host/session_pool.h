@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* TEE resources */
+struct test_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	uint32_t tank_id;
+	uint32_t param_version;	/* WT_PARAMS_* the TA agreed to */
+	uint32_t seq;		/* last packed pump command sent */
+};
+
+/* One pooled connection to the TA */
+struct pool_slot {
+	struct test_ctx tee;
+	int open;		/* ctx/sess are valid */
+	int in_use;		/* handed out by session_pool_acquire() */
+	unsigned long invokes;	/* commands run on the current session */
+	unsigned long reopens;	/* sessions dropped after a failure */
+};
+
+/*
+ * Long-lived set of TA sessions. With reuse enabled a slot keeps its
+ * session open across commands and is only reopened once the TA has
+ * died underneath it. With reuse disabled every acquire/release pair
+ * opens and closes the context and session, like the original demo did.
+ */
+struct session_pool {
+	struct pool_slot *slots;
+	size_t size;
+	uint32_t tank_id;	/* tank every session is opened for */
+	uint32_t mode;		/* WT_SESSION_* flags asked at every open */
+	int reuse;
+	pthread_mutex_t lock;
+	pthread_cond_t free_cond;
+};
+
+TEEC_Result session_pool_init(struct session_pool *pool, uint32_t tank_id,
+			      size_t size, int reuse);
+
+/*
+ * As session_pool_init(), opening every session with the WT_SESSION_*
+ * flags in mode. A TA that does not know them fails every open.
+ */
+TEEC_Result session_pool_init_mode(struct session_pool *pool,
+				   uint32_t tank_id, size_t size, int reuse,
+				   uint32_t mode);
+void session_pool_destroy(struct session_pool *pool);
+
+/* Blocks until a slot is free; returns NULL if no session can be opened */
+struct test_ctx *session_pool_acquire(struct session_pool *pool);
+
+/*
+ * As session_pool_acquire() but never waits: with every slot in use it
+ * returns NULL and sets *busy, with a session that cannot be opened it
+ * returns NULL and clears it.
+ */
+struct test_ctx *session_pool_try_acquire(struct session_pool *pool,
+					  int *busy);
+
+/*
+ * Hands a slot back. res/origin are the outcome of the last command run
+ * on it, a dead TA or broken transport closes the session so that the
+ * next acquire reopens it.
+ */
+void session_pool_release(struct session_pool *pool, struct test_ctx *tee,
+			  TEEC_Result res, uint32_t origin);
+
+/* Pings every idle session and reopens the ones that do not answer */
+size_t session_pool_health_check(struct session_pool *pool);
+
+unsigned long session_pool_reopens(struct session_pool *pool);
+
+#endif /* SESSION_POOL_H */
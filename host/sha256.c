@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "sha256.h"
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t ror32(uint32_t x, unsigned int n)
+{
+	return x >> n | x << (32 - n);
+}
+
+static void sha256_block(uint32_t h[8], const uint8_t *p)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, k, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+		       (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+	for (; i < 64; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+		       (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^
+			w[i - 15] >> 3) +
+		       (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^
+			w[i - 2] >> 10);
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3];
+	e = h[4]; f = h[5]; g = h[6]; k = h[7];
+	for (i = 0; i < 64; i++) {
+		t1 = k + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) +
+		     ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) +
+		     ((a & b) ^ (a & c) ^ (b & c));
+		k = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void sha256_init(struct sha256 *s)
+{
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(s->h, iv, sizeof(iv));
+	s->len = 0;
+}
+
+void sha256_update(struct sha256 *s, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t fill = s->len % SHA256_BLOCK;
+	size_t n;
+
+	s->len += len;
+	if (fill) {
+		n = SHA256_BLOCK - fill < len ? SHA256_BLOCK - fill : len;
+		memcpy(s->buf + fill, p, n);
+		p += n;
+		len -= n;
+		if (fill + n < SHA256_BLOCK)
+			return;
+		sha256_block(s->h, s->buf);
+	}
+	for (; len >= SHA256_BLOCK; p += SHA256_BLOCK, len -= SHA256_BLOCK)
+		sha256_block(s->h, p);
+	memcpy(s->buf, p, len);
+}
+
+void sha256_final(struct sha256 *s, uint8_t out[SHA256_DIGEST])
+{
+	uint64_t bits = s->len * 8;
+	size_t fill = s->len % SHA256_BLOCK;
+	int i;
+
+	s->buf[fill++] = 0x80;
+	if (fill > SHA256_BLOCK - 8) {
+		memset(s->buf + fill, 0, SHA256_BLOCK - fill);
+		sha256_block(s->h, s->buf);
+		fill = 0;
+	}
+	memset(s->buf + fill, 0, SHA256_BLOCK - 8 - fill);
+	for (i = 0; i < 8; i++)
+		s->buf[SHA256_BLOCK - 1 - i] = bits >> (8 * i);
+	sha256_block(s->h, s->buf);
+
+	for (i = 0; i < 8; i++) {
+		out[4 * i] = s->h[i] >> 24;
+		out[4 * i + 1] = s->h[i] >> 16;
+		out[4 * i + 2] = s->h[i] >> 8;
+		out[4 * i + 3] = s->h[i];
+	}
+}
+
+void hmac_sha256_key(struct hmac_sha256 *k, const void *key, size_t key_len)
+{
+	uint8_t block[SHA256_BLOCK] = { 0 };
+	struct sha256 s;
+	int i;
+
+	if (key_len > SHA256_BLOCK) {
+		sha256_init(&s);
+		sha256_update(&s, key, key_len);
+		sha256_final(&s, block);
+	} else {
+		memcpy(block, key, key_len);
+	}
+
+	for (i = 0; i < SHA256_BLOCK; i++)
+		block[i] ^= 0x36;
+	sha256_init(&k->inner);
+	sha256_update(&k->inner, block, SHA256_BLOCK);
+
+	for (i = 0; i < SHA256_BLOCK; i++)
+		block[i] ^= 0x36 ^ 0x5c;
+	sha256_init(&k->outer);
+	sha256_update(&k->outer, block, SHA256_BLOCK);
+	memset(block, 0, sizeof(block));
+}
+
+void hmac_sha256_final(const struct hmac_sha256 *k, struct sha256 *s,
+		       uint8_t mac[SHA256_DIGEST])
+{
+	uint8_t digest[SHA256_DIGEST];
+
+	sha256_final(s, digest);
+	*s = k->outer;
+	sha256_update(s, digest, sizeof(digest));
+	sha256_final(s, mac);
+}
+
+void hmac_sha256(const struct hmac_sha256 *k, const void *data, size_t len,
+		 uint8_t mac[SHA256_DIGEST])
+{
+	struct sha256 s = k->inner;
+
+	sha256_update(&s, data, len);
+	hmac_sha256_final(k, &s, mac);
+}
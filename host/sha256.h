@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A small SHA-256 and HMAC-SHA256 of our own. The REE side links no
+ * crypto library, it signs sensor batches with this, and the in-process
+ * TEE stand-in builds its HMAC operations on it as well. On real hardware
+ * the TA checks the MACs with the TEE's implementation.
+ */
+#define SHA256_BLOCK	64
+#define SHA256_DIGEST	32
+
+struct sha256 {
+	uint32_t h[8];
+	uint64_t len;		/* bytes hashed so far */
+	uint8_t buf[SHA256_BLOCK];
+};
+
+void sha256_init(struct sha256 *s);
+void sha256_update(struct sha256 *s, const void *data, size_t len);
+void sha256_final(struct sha256 *s, uint8_t out[SHA256_DIGEST]);
+
+/*
+ * HMAC key schedule: the hash states after the key XOR ipad and opad
+ * blocks, so every MAC after that costs no extra compressions for them.
+ */
+struct hmac_sha256 {
+	struct sha256 inner;
+	struct sha256 outer;
+};
+
+void hmac_sha256_key(struct hmac_sha256 *k, const void *key, size_t key_len);
+
+/* A MAC is s = k->inner, any number of sha256_update(s), then this */
+void hmac_sha256_final(const struct hmac_sha256 *k, struct sha256 *s,
+		       uint8_t mac[SHA256_DIGEST]);
+
+/* The MAC of len bytes at data in one go */
+void hmac_sha256(const struct hmac_sha256 *k, const void *data, size_t len,
+		 uint8_t mac[SHA256_DIGEST]);
+
+#endif /* SHA256_H */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "phase_trace.h"
+#include "tank_control.h"
+
+/* Past the field on either side is past the device limits too */
+static uint32_t sat_u8(int32_t v)
+{
+	return v < 0 || v > 0xff ? 0xff : (uint32_t)v;
+}
+
+static int32_t sat_s16(int32_t v)
+{
+	return v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v;
+}
+
+void pump_op_pack(struct test_ctx *ctx, TEEC_Operation *op,
+		  const int32_t in[4])
+{
+	int k;
+
+	memset(op, 0, sizeof(*op));
+
+	if (ctx->param_version < WT_PARAMS_PACKED) {
+		op->paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+						  TEEC_VALUE_INOUT,
+						  TEEC_VALUE_INOUT,
+						  TEEC_VALUE_INOUT);
+		for (k = 0; k < 4; k++)
+			op->params[k].value.a = in[k];
+		return;
+	}
+
+	op->paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_VALUE_INOUT,
+					  TEEC_NONE,
+					  phase_trace_enabled() ?
+					  TEEC_VALUE_OUTPUT : TEEC_NONE);
+	op->params[0].value.a = WT_PACK_READINGS(sat_s16(in[0]), sat_u8(in[1]),
+						 WT_PARAMS_PACKED);
+	op->params[0].value.b = WT_PACK_FLOWS(sat_u8(in[2]), sat_u8(in[3]));
+	op->params[1].value.a = ++ctx->seq;
+	op->params[1].value.b = ctx->tank_id;
+}
+
+int pump_op_unpack(struct test_ctx *ctx, uint32_t cmd,
+		   const TEEC_Operation *op, uint32_t *valve)
+{
+	int acid = cmd == TA_WATER_TREATMENT_CMD_ACID_ON ||
+		   cmd == TA_WATER_TREATMENT_CMD_ACID_OFF;
+	int out;
+	int k;
+
+	if (ctx->param_version >= WT_PARAMS_PACKED) {
+		if (op->params[1].value.a != ctx->seq)
+			return 0;
+		metrics_verdict(metrics_reject_verdict(op->params[0].value.a),
+				1);
+		if (op->params[0].value.a != WT_REJECT_NONE)
+			return 0;
+		*valve = op->params[1].value.b;
+		goto accepted;
+	}
+
+	/* Accepted when everything but the state slot came back 0 */
+	out = acid ? 2 : 3;
+	for (k = 0; k < 4; k++) {
+		if (k != out && op->params[k].value.a) {
+			metrics_verdict(METRIC_REJECTED, 1);
+			return 0;
+		}
+	}
+	*valve = op->params[out].value.a;
+	metrics_verdict(METRIC_ACCEPTED, 1);
+accepted:
+	metrics_valve(ctx->tank_id, acid ? METRIC_VALVE_ACID :
+			 METRIC_VALVE_SOD_HYDROX, *valve);
+	return 1;
+}
+
+/* Both valves and the verdict of a CONTROL or DOSE reply */
+static void mirror_reply(struct test_ctx *ctx, uint32_t reason,
+			 uint32_t sod_hydrox, uint32_t acid)
+{
+	if (reason == WT_CONTROL_DEVICE_LIMITS) {
+		metrics_verdict(METRIC_DEVICE_LIMITS, 1);
+		return;
+	}
+	metrics_verdict(METRIC_ACCEPTED, 1);
+	metrics_valve(ctx->tank_id, METRIC_VALVE_SOD_HYDROX, sod_hydrox);
+	metrics_valve(ctx->tank_id, METRIC_VALVE_ACID, acid);
+}
+
+TEEC_Result control_tank(struct test_ctx *ctx, int32_t temp, int32_t ph,
+			 int32_t acid_flow, int32_t sod_hydrox_flow,
+			 struct control_reply *reply, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT);
+	op.params[0].value.a = temp;
+	op.params[0].value.b = ph;
+	op.params[1].value.a = acid_flow;
+	op.params[1].value.b = sod_hydrox_flow;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_CONTROL,
+				 &op, &origin);
+	metrics_command(TA_WATER_TREATMENT_CMD_CONTROL, res);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	reply->sod_hydrox = op.params[2].value.a;
+	reply->acid = op.params[2].value.b;
+	reply->reason = op.params[3].value.a;
+	reply->actions = op.params[3].value.b;
+	mirror_reply(ctx, reply->reason, reply->sod_hydrox, reply->acid);
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result check_ph(struct test_ctx *ctx, uint32_t ph, uint32_t flags,
+		     struct ph_report *report, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_VALUE_OUTPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT);
+	op.params[0].value.a = ph;
+	op.params[0].value.b = flags;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_PH_CHECK,
+				 &op, &origin);
+	metrics_command(TA_WATER_TREATMENT_CMD_PH_CHECK, res);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	report->flags = op.params[0].value.a;
+	report->rate = (int32_t)op.params[0].value.b;
+	report->mean = (int32_t)op.params[1].value.a;
+	report->variance = op.params[1].value.b;
+	report->min = (int32_t)op.params[2].value.a;
+	report->max = (int32_t)op.params[2].value.b;
+	report->count = op.params[3].value.a;
+	report->latest = (int32_t)op.params[3].value.b;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result dose_tank(struct test_ctx *ctx, int32_t temp, uint32_t milli_ph,
+		      struct dose_reply *reply, uint32_t *err_origin)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_NONE);
+	op.params[0].value.a = temp;
+	op.params[0].value.b = milli_ph;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_WATER_TREATMENT_CMD_DOSE,
+				 &op, &origin);
+	metrics_command(TA_WATER_TREATMENT_CMD_DOSE, res);
+	if (res != TEEC_SUCCESS) {
+		warnx("TEEC_InvokeCommand failed with code 0x%x origin 0x%x",
+		      res, origin);
+		if (err_origin)
+			*err_origin = origin;
+		return res;
+	}
+
+	reply->sod_hydrox = op.params[1].value.a;
+	reply->acid = op.params[1].value.b;
+	reply->reason = op.params[2].value.a;
+	reply->demand = (int32_t)op.params[2].value.b;
+	mirror_reply(ctx, reply->reason, reply->sod_hydrox, reply->acid);
+	return TEEC_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TANK_CONTROL_H
+#define TANK_CONTROL_H
+
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* For WT_CONTROL_* */
+#include <water_treatment_ta.h>
+
+#include "session_pool.h"
+
+/*
+ * Fills op for a pump command on the readings in in[], laid out as
+ * params[0..3] of the legacy encoding, in whichever encoding the session
+ * negotiated. The packed one takes the session's next sequence number,
+ * and asks for the TA's times while phase tracing is on.
+ */
+void pump_op_pack(struct test_ctx *ctx, TEEC_Operation *op,
+		  const int32_t in[4]);
+
+/*
+ * Reads the reply to a pump command cmd packed by pump_op_pack(). Returns
+ * nonzero if the TA accepted the command, *valve is then the new state.
+ */
+int pump_op_unpack(struct test_ctx *ctx, uint32_t cmd,
+		   const TEEC_Operation *op, uint32_t *valve);
+
+struct control_reply {
+	uint32_t sod_hydrox;	/* valve states after the command */
+	uint32_t acid;
+	uint32_t reason;	/* WT_CONTROL_* */
+	uint32_t actions;	/* WT_ACTION() bits of the rules applied */
+};
+
+/*
+ * Has the TA settle both valves of the session's tank for one set of
+ * readings with a single TA_WATER_TREATMENT_CMD_CONTROL invoke.
+ */
+TEEC_Result control_tank(struct test_ctx *ctx, int32_t temp, int32_t ph,
+			 int32_t acid_flow, int32_t sod_hydrox_flow,
+			 struct control_reply *reply, uint32_t *err_origin);
+
+/* TA_WATER_TREATMENT_CMD_PH_CHECK reply, pH values in milli-pH */
+struct ph_report {
+	uint32_t flags;		/* WT_PH_* */
+	int32_t rate;		/* change per reading across the window */
+	int32_t mean;
+	uint32_t variance;	/* milli-pH squared */
+	int32_t min;
+	int32_t max;
+	uint32_t count;		/* readings in the window */
+	int32_t latest;
+};
+
+/*
+ * Has the TA judge the pH of the session's tank over its recent readings,
+ * after what the WT_PH_CHECK_* flags ask: emptying them, adding ph.
+ */
+TEEC_Result check_ph(struct test_ctx *ctx, uint32_t ph, uint32_t flags,
+		     struct ph_report *report, uint32_t *err_origin);
+
+struct dose_reply {
+	uint32_t sod_hydrox;	/* flow setpoints after the command, 0..10 */
+	uint32_t acid;
+	uint32_t reason;	/* WT_CONTROL_* */
+	int32_t demand;		/* PI output, milli flow units */
+};
+
+/*
+ * Runs the TA's PI dosing loop for the session's tank on one reading,
+ * milli_ph in thousandths of a pH, with TA_WATER_TREATMENT_CMD_DOSE.
+ */
+TEEC_Result dose_tank(struct test_ctx *ctx, int32_t temp, uint32_t milli_ph,
+		      struct dose_reply *reply, uint32_t *err_origin);
+
+#endif /* TANK_CONTROL_H */
@@ -0,0 +1,555 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <water_treatment_ta.h>
+
+#include "bench.h"
+#include "metrics.h"
+#include "phase_trace.h"
+#include "sensor_ring.h"
+#include "tank_daemon.h"
+
+/* Plenty for ring_evaluate(), and a few thousand of them still fit */
+#define WORKER_STACK_SIZE	(256 * 1024)
+
+static void worker_wake(struct daemon_worker *w)
+{
+	/* Order the caller's push or stop flag before reading sleeping */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&w->sleeping, __ATOMIC_RELAXED) &&
+	    __atomic_exchange_n(&w->sleeping, 0, __ATOMIC_SEQ_CST))
+		sem_post(&w->wake);
+}
+
+static void worker_sleep(struct daemon_worker *w)
+{
+	__atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	/*
+	 * Something may have arrived before sleeping was visible. If no
+	 * producer has cleared the flag since, nobody will post either.
+	 */
+	if (mpsc_queue_ready(&w->queue) ||
+	    __atomic_load_n(&w->latest_full, __ATOMIC_RELAXED) ||
+	    __atomic_load_n(&w->daemon->stopping, __ATOMIC_RELAXED)) {
+		if (__atomic_exchange_n(&w->sleeping, 0, __ATOMIC_SEQ_CST))
+			return;
+	}
+
+	while (sem_wait(&w->wake) && errno == EINTR)
+		;
+}
+
+static void latest_lock(struct daemon_worker *w)
+{
+	while (__atomic_exchange_n(&w->latest_lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&w->latest_lock, __ATOMIC_RELAXED))
+			;
+}
+
+static void latest_unlock(struct daemon_worker *w)
+{
+	__atomic_store_n(&w->latest_lock, 0, __ATOMIC_RELEASE);
+}
+
+static void shed_one(struct daemon_worker *w, const struct tank_reading *r)
+{
+	w->daemon->on_decision(w->daemon->arg, w->tank_id, r, NULL,
+			       TEEC_ERROR_CANCEL);
+}
+
+/*
+ * TANK_SHED_NEWEST: empties the queue and the overflow slot and leaves
+ * the newest reading in batch[0]. Returns 0 if there was none.
+ */
+static size_t pop_newest(struct daemon_worker *w, struct tank_reading *batch,
+			 size_t max)
+{
+	struct tank_reading newest;
+	size_t have = 0;
+	size_t n;
+	size_t i;
+
+	while ((n = mpsc_queue_pop(&w->queue, batch, max))) {
+		for (i = 0; i < n; i++) {
+			if (have && batch[i].capture_ns < newest.capture_ns) {
+				shed_one(w, &batch[i]);
+			} else {
+				if (have)
+					shed_one(w, &newest);
+				newest = batch[i];
+			}
+			w->shed.coalesced += have;
+			have = 1;
+		}
+	}
+
+	latest_lock(w);
+	if (w->latest_full) {
+		/* Went there because the queue was full, so it is newer */
+		if (have) {
+			shed_one(w, &newest);
+			w->shed.coalesced++;
+		}
+		newest = w->latest;
+		w->latest_full = 0;
+		have = 1;
+	}
+	latest_unlock(w);
+
+	if (have)
+		batch[0] = newest;
+	return have;
+}
+
+/* Drops readings an invoke started now would not answer in time */
+static size_t shed_late(struct daemon_worker *w, struct tank_reading *batch,
+			size_t n)
+{
+	uint64_t horizon = bench_now_ns() + w->service_ns;
+	size_t kept = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (batch[i].deadline_ns && batch[i].deadline_ns < horizon) {
+			w->shed.late++;
+			shed_one(w, &batch[i]);
+		} else {
+			batch[kept++] = batch[i];
+		}
+	}
+	return kept;
+}
+
+static void account_staleness(struct daemon_worker *w,
+			      const struct tank_reading *r, uint64_t now)
+{
+	uint64_t stale = now - (r->capture_ns ? r->capture_ns : r->submit_ns);
+	uint64_t us = stale / 1000;
+	int k = 0;
+
+	while (us > 1 && k < TANK_STALE_BUCKETS - 1) {
+		us >>= 1;
+		k++;
+	}
+	w->shed.stale_hist[k]++;
+	w->shed.served++;
+	w->shed.stale_sum_ns += stale;
+	if (stale > w->shed.stale_max_ns)
+		w->shed.stale_max_ns = stale;
+}
+
+/*
+ * Evaluates n samples through the worker's ring in the memory it shares
+ * with tee's context, set up on first use: pushing them costs no
+ * marshalling, one DRAIN takes them all.
+ */
+static TEEC_Result ring_evaluate(struct sensor_ring *ring,
+				 struct test_ctx *tee, size_t ring_size,
+				 const struct wt_sample *samples, size_t n,
+				 struct wt_decision *decisions,
+				 size_t *rejected, uint32_t *origin)
+{
+	TEEC_Result res;
+	uint32_t first;
+	uint32_t count;
+	size_t i;
+
+	if (!ring->hdr) {
+		res = sensor_ring_init(ring, &tee->ctx, ring_size);
+		if (res != TEEC_SUCCESS)
+			return res;
+	}
+
+	/* Every drain empties the ring, a batch always fits */
+	for (i = 0; i < n; i++)
+		if (sensor_ring_push(ring, &samples[i]))
+			return TEEC_ERROR_SHORT_BUFFER;
+
+	res = sensor_ring_drain(ring, &tee->sess, &first, &count, origin);
+	if (res != TEEC_SUCCESS)
+		return res;
+	if (count != n) {
+		warnx("TA drained %u of %zu samples", count, n);
+		return TEEC_ERROR_GENERIC;
+	}
+
+	*rejected = 0;
+	for (i = 0; i < n; i++) {
+		decisions[i] = *sensor_ring_decision(ring, first + i);
+		*rejected += decisions[i].verdict != WT_VERDICT_OK;
+	}
+	return TEEC_SUCCESS;
+}
+
+static void *worker_run(void *arg)
+{
+	struct daemon_worker *w = arg;
+	struct tank_daemon *d = w->daemon;
+	struct tank_reading *batch;
+	struct wt_sample *samples;
+	struct wt_decision *decisions;
+	struct sensor_ring ring = { .hdr = NULL };
+	struct test_ctx *tee;
+	uint32_t origin;
+	TEEC_Result res;
+	size_t rejected;
+	uint64_t t0;
+	uint64_t now;
+	size_t n;
+	size_t i;
+
+	batch = calloc(d->batch_max, sizeof(*batch));
+	samples = calloc(d->batch_max, sizeof(*samples));
+	decisions = calloc(d->batch_max, sizeof(*decisions));
+	if (!batch || !samples || !decisions)
+		err(1, "calloc");
+
+	for (;;) {
+		if (d->shed == TANK_SHED_NEWEST)
+			n = pop_newest(w, batch, d->batch_max);
+		else
+			n = mpsc_queue_pop(&w->queue, batch, d->batch_max);
+		if (!n) {
+			if (__atomic_load_n(&d->stopping, __ATOMIC_ACQUIRE))
+				break;
+			worker_sleep(w);
+			continue;
+		}
+
+		if (d->shed != TANK_SHED_NONE) {
+			n = shed_late(w, batch, n);
+			if (!n)
+				continue;
+		}
+
+		for (i = 0; i < n; i++)
+			samples[i] = batch[i].sample;
+
+		origin = 0;
+		rejected = 0;
+		t0 = bench_now_ns();
+		phase_begin();
+		tee = session_pool_acquire(&w->pool);
+		phase_mark(PHASE_SESSION);
+		if (tee) {
+			res = ring_evaluate(&ring, tee, d->batch_max, samples,
+					    n, decisions, &rejected, &origin);
+			/*
+			 * What the failed drain left in the ring is stale,
+			 * and releasing may close the context it lives in.
+			 */
+			if (res != TEEC_SUCCESS)
+				sensor_ring_destroy(&ring);
+			session_pool_release(&w->pool, tee, res, origin);
+			phase_mark(PHASE_SESSION);
+		} else {
+			res = TEEC_ERROR_COMMUNICATION;
+		}
+		phase_end();
+
+		now = bench_now_ns();
+		w->service_ns += ((int64_t)(now - t0) - (int64_t)w->service_ns) / 8;
+
+		w->invokes++;
+		if (res != TEEC_SUCCESS) {
+			w->errors += n;
+		} else {
+			w->decisions += n;
+			w->rejected += rejected;
+			for (i = 0; i < n; i++)
+				account_staleness(w, &batch[i], now);
+		}
+
+		for (i = 0; i < n; i++)
+			d->on_decision(d->arg, w->tank_id, &batch[i],
+				       res == TEEC_SUCCESS ? &decisions[i] : NULL,
+				       res);
+	}
+
+	if (ring.hdr) {
+		/* The session, and so the context, stays open till destroy */
+		sensor_ring_destroy(&ring);
+	}
+	free(decisions);
+	free(samples);
+	free(batch);
+	return NULL;
+}
+
+/* Queue depth per tank for the metrics endpoint */
+static void collect_depths(void *arg, FILE *out)
+{
+	struct tank_daemon *d = arg;
+	struct daemon_worker *w;
+	size_t i;
+
+	fprintf(out, "# HELP wt_queue_depth Readings waiting for a tank's "
+		"worker.\n# TYPE wt_queue_depth gauge\n");
+	for (i = 0; i < d->tanks; i++) {
+		w = &d->workers[i];
+		fprintf(out, "wt_queue_depth{tank=\"%" PRIu32 "\"} %zu\n",
+			w->tank_id, mpsc_queue_depth(&w->queue) +
+			!!__atomic_load_n(&w->latest_full, __ATOMIC_RELAXED));
+	}
+}
+
+TEEC_Result tank_daemon_start(struct tank_daemon *d, uint32_t first_tank,
+			      size_t tanks, size_t queue_size,
+			      size_t batch_max, enum tank_shed shed,
+			      tank_decision_fn on_decision, void *arg)
+{
+	struct daemon_worker *w;
+	pthread_attr_t attr;
+	TEEC_Result res;
+	size_t i;
+
+	d->workers = calloc(tanks, sizeof(*d->workers));
+	if (!d->workers)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	d->tanks = tanks;
+	d->first_tank = first_tank;
+	d->batch_max = batch_max ? batch_max : 1;
+	d->shed = shed;
+	d->on_decision = on_decision;
+	d->arg = arg;
+	d->stopping = 0;
+	d->metrics = -1;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+
+	for (i = 0; i < tanks; i++) {
+		w = &d->workers[i];
+		w->daemon = d;
+		w->tank_id = first_tank + i;
+
+		if (mpsc_queue_init(&w->queue, queue_size)) {
+			res = TEEC_ERROR_OUT_OF_MEMORY;
+			goto err;
+		}
+		res = session_pool_init(&w->pool, w->tank_id, 1, 1);
+		if (res != TEEC_SUCCESS) {
+			mpsc_queue_destroy(&w->queue);
+			goto err;
+		}
+		sem_init(&w->wake, 0, 0);
+
+		if (pthread_create(&w->thread, &attr, worker_run, w)) {
+			warn("pthread_create");
+			sem_destroy(&w->wake);
+			session_pool_destroy(&w->pool);
+			mpsc_queue_destroy(&w->queue);
+			res = TEEC_ERROR_OUT_OF_MEMORY;
+			goto err;
+		}
+		w->started = 1;
+	}
+
+	pthread_attr_destroy(&attr);
+	d->metrics = metrics_register(collect_depths, d);
+	return TEEC_SUCCESS;
+
+err:
+	pthread_attr_destroy(&attr);
+	warnx("Failed to start tank %zu, code 0x%x", first_tank + i, res);
+	tank_daemon_stop(d);
+	tank_daemon_destroy(d);
+	return res;
+}
+
+int tank_daemon_submit(struct tank_daemon *d, uint32_t tank_id,
+		       const struct tank_reading *reading)
+{
+	struct daemon_worker *w;
+	uint32_t index = tank_id - d->first_tank;
+	struct tank_reading old;
+	int had_old;
+
+	if (index >= d->tanks)
+		return -1;
+
+	w = &d->workers[index];
+
+	if (d->shed != TANK_SHED_NONE && reading->deadline_ns &&
+	    bench_now_ns() >= reading->deadline_ns) {
+		__atomic_add_fetch(&w->shed_expired, 1, __ATOMIC_RELAXED);
+		d->on_decision(d->arg, tank_id, reading, NULL,
+			       TEEC_ERROR_CANCEL);
+		return 0;
+	}
+
+	if (mpsc_queue_push(&w->queue, reading)) {
+		if (d->shed != TANK_SHED_NEWEST)
+			return -1;
+
+		latest_lock(w);
+		if (w->latest_full && w->latest.capture_ns > reading->capture_ns) {
+			/* Another submitter got a newer one in first */
+			latest_unlock(w);
+			__atomic_add_fetch(&w->shed_coalesced_in, 1,
+					   __ATOMIC_RELAXED);
+			d->on_decision(d->arg, tank_id, reading, NULL,
+				       TEEC_ERROR_CANCEL);
+			return 0;
+		}
+		old = w->latest;
+		had_old = w->latest_full;
+		w->latest = *reading;
+		w->latest_full = 1;
+		latest_unlock(w);
+
+		if (had_old) {
+			__atomic_add_fetch(&w->shed_coalesced_in, 1,
+					   __ATOMIC_RELAXED);
+			d->on_decision(d->arg, tank_id, &old, NULL,
+				       TEEC_ERROR_CANCEL);
+		}
+	}
+	worker_wake(w);
+	return 0;
+}
+
+void tank_daemon_stop(struct tank_daemon *d)
+{
+	struct daemon_worker *w;
+	size_t i;
+
+	if (!d->workers)
+		return;
+
+	metrics_unregister(d->metrics);
+	d->metrics = -1;
+	__atomic_store_n(&d->stopping, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < d->tanks; i++)
+		if (d->workers[i].started)
+			worker_wake(&d->workers[i]);
+
+	for (i = 0; i < d->tanks; i++) {
+		w = &d->workers[i];
+		if (!w->started)
+			continue;
+		pthread_join(w->thread, NULL);
+		w->reopens = session_pool_reopens(&w->pool);
+		sem_destroy(&w->wake);
+		session_pool_destroy(&w->pool);
+		mpsc_queue_destroy(&w->queue);
+		w->started = 0;
+	}
+}
+
+/* Upper end of the staleness bucket holding the p-th fraction */
+static uint64_t stale_percentile_us(const struct tank_shed_stats *s, double p)
+{
+	unsigned long want = s->served * p;
+	unsigned long seen = 0;
+	int k;
+
+	for (k = 0; k < TANK_STALE_BUCKETS; k++) {
+		seen += s->stale_hist[k];
+		if (seen > want)
+			break;
+	}
+	return 2ULL << k;
+}
+
+void tank_daemon_report(struct tank_daemon *d)
+{
+	unsigned long invokes = 0;
+	unsigned long decisions = 0;
+	unsigned long rejected = 0;
+	unsigned long errors = 0;
+	unsigned long reopens = 0;
+	struct tank_shed_stats shed;
+	size_t i;
+
+	for (i = 0; i < d->tanks; i++) {
+		invokes += d->workers[i].invokes;
+		decisions += d->workers[i].decisions;
+		rejected += d->workers[i].rejected;
+		errors += d->workers[i].errors;
+		reopens += d->workers[i].reopens;
+	}
+
+	printf("Tank daemon: %zu tanks, %lu decisions in %lu invokes "
+	       "(%.1f per invoke), %lu rejected, %lu failed, %lu reopens\n",
+	       d->tanks, decisions, invokes,
+	       invokes ? (double)(decisions + errors) / invokes : 0.0,
+	       rejected, errors, reopens);
+
+	if (d->shed != TANK_SHED_NONE) {
+		tank_daemon_shed_stats(d, &shed);
+		printf("  shed %lu expired at submit, %lu late, "
+		       "%lu superseded\n", shed.expired, shed.late,
+		       shed.coalesced);
+		if (shed.served)
+			printf("  staleness at decision p50 <%" PRIu64
+			       "us p99 <%" PRIu64 "us\n",
+			       stale_percentile_us(&shed, 0.5),
+			       stale_percentile_us(&shed, 0.99));
+	}
+}
+
+void tank_daemon_shed_stats(struct tank_daemon *d,
+			    struct tank_shed_stats *out)
+{
+	const struct daemon_worker *w;
+	size_t i;
+	int k;
+
+	memset(out, 0, sizeof(*out));
+	for (i = 0; i < d->tanks; i++) {
+		w = &d->workers[i];
+		out->expired += __atomic_load_n(&w->shed_expired,
+						__ATOMIC_RELAXED);
+		out->coalesced += __atomic_load_n(&w->shed_coalesced_in,
+						  __ATOMIC_RELAXED) +
+				  w->shed.coalesced;
+		out->late += w->shed.late;
+		out->served += w->shed.served;
+		out->stale_sum_ns += w->shed.stale_sum_ns;
+		if (w->shed.stale_max_ns > out->stale_max_ns)
+			out->stale_max_ns = w->shed.stale_max_ns;
+		for (k = 0; k < TANK_STALE_BUCKETS; k++)
+			out->stale_hist[k] += w->shed.stale_hist[k];
+	}
+}
+
+void tank_daemon_destroy(struct tank_daemon *d)
+{
+	free(d->workers);
+	d->workers = NULL;
+	d->tanks = 0;
+}
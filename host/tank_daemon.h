@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TANK_DAEMON_H
+#define TANK_DAEMON_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+#include "mpsc_queue.h"
+#include "session_pool.h"
+
+/*
+ * Called on the tank's worker thread for every reading it evaluated.
+ * decision is NULL when the invoke failed, res then says why, or when
+ * the reading was shed, with res TEEC_ERROR_CANCEL. Readings shed at
+ * submit are handed back on the submitting thread.
+ */
+typedef void (*tank_decision_fn)(void *arg, uint32_t tank_id,
+				 const struct tank_reading *reading,
+				 const struct wt_decision *decision,
+				 TEEC_Result res);
+
+/* What a tank's worker does with readings it cannot serve in time */
+enum tank_shed {
+	TANK_SHED_NONE,		/* evaluate everything, however late */
+	TANK_SHED_LATE,		/* drop readings past their deadline */
+	TANK_SHED_NEWEST,	/* that, and only evaluate a tank's newest
+				   reading, older pending ones are dropped */
+};
+
+/* Staleness buckets: k holds capture to decision in [2^k, 2^(k+1)) us */
+#define TANK_STALE_BUCKETS	32
+
+/* Load shedding and staleness counters, summed over the tanks */
+struct tank_shed_stats {
+	unsigned long expired;	/* refused at submit, already too late */
+	unsigned long late;	/* dropped by the worker before invoking */
+	unsigned long coalesced;	/* superseded by a newer reading */
+	unsigned long served;	/* decisions with a staleness below */
+	uint64_t stale_sum_ns;
+	uint64_t stale_max_ns;
+	unsigned long stale_hist[TANK_STALE_BUCKETS];
+};
+
+struct tank_daemon;
+
+/* One tank: its queue, its thread and its session with the TA */
+struct daemon_worker {
+	struct tank_daemon *daemon;
+	pthread_t thread;
+	uint32_t tank_id;
+	struct mpsc_queue queue;
+	struct session_pool pool;
+	sem_t wake;
+	int sleeping;		/* parked on wake, producers must post */
+	int started;
+	/*
+	 * With TANK_SHED_NEWEST a reading that finds the queue full waits
+	 * here instead, replacing whatever older one was waiting.
+	 */
+	struct tank_reading latest;
+	int latest_full;
+	int latest_lock;
+	uint64_t service_ns;	/* moving average of one invoke */
+	/* Written by submitters, atomically */
+	unsigned long shed_expired;
+	unsigned long shed_coalesced_in;
+	/* Only written by the worker, read once it has stopped */
+	unsigned long invokes;
+	unsigned long decisions;
+	unsigned long rejected;
+	unsigned long errors;
+	unsigned long reopens;
+	struct tank_shed_stats shed;
+};
+
+/*
+ * Tanks first_tank .. first_tank + tanks - 1, each served by its own
+ * thread. Any thread may submit readings; a worker takes everything
+ * queued for its tank, up to batch_max, into its sensor ring and has the
+ * TA evaluate them with one DRAIN.
+ * Readings with a deadline that an invoke started now would miss are
+ * shed according to the daemon's enum tank_shed.
+ */
+struct tank_daemon {
+	struct daemon_worker *workers;
+	size_t tanks;
+	uint32_t first_tank;
+	size_t batch_max;
+	enum tank_shed shed;
+	tank_decision_fn on_decision;
+	void *arg;
+	int stopping;
+	int metrics;		/* metrics_register() handle */
+};
+
+TEEC_Result tank_daemon_start(struct tank_daemon *d, uint32_t first_tank,
+			      size_t tanks, size_t queue_size,
+			      size_t batch_max, enum tank_shed shed,
+			      tank_decision_fn on_decision, void *arg);
+
+/*
+ * Returns 0, or -1 if the tank is unknown or its queue is full. With
+ * shedding, a reading already past its deadline is counted and dropped
+ * and 0 returned; with TANK_SHED_NEWEST the queue is never full.
+ */
+int tank_daemon_submit(struct tank_daemon *d, uint32_t tank_id,
+		       const struct tank_reading *reading);
+
+/* Evaluates everything already submitted, then joins the workers */
+void tank_daemon_stop(struct tank_daemon *d);
+
+/* Totals across all tanks, call after tank_daemon_stop() */
+void tank_daemon_report(struct tank_daemon *d);
+void tank_daemon_shed_stats(struct tank_daemon *d,
+			    struct tank_shed_stats *out);
+
+void tank_daemon_destroy(struct tank_daemon *d);
+
+#endif /* TANK_DAEMON_H */
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <water_treatment_ta.h>
+
+#include "batch.h"
+#include "bench.h"
+#include "trace_replay.h"
+
+/* Output is buffered this much before each write to the file */
+#define REPLAY_OUT_BUFFER	(1 << 20)
+
+struct trace {
+	const char *path;
+	const uint8_t *map;
+	size_t len;
+	int binary;
+	/* Binary traces */
+	const struct wt_sample *rows;
+	uint64_t nrows;
+	uint64_t next_row;
+	/* CSV traces */
+	size_t pos;
+	unsigned long line;
+	/* Lookahead, valid when have_next */
+	struct wt_sample next;
+	int have_next;
+};
+
+static int trace_open(struct trace *t, const char *path)
+{
+	const struct wt_trace_header *hdr;
+	struct stat st;
+	int fd;
+
+	memset(t, 0, sizeof(*t));
+	t->path = path;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		warn("%s", path);
+		return -1;
+	}
+	if (fstat(fd, &st)) {
+		warn("%s", path);
+		close(fd);
+		return -1;
+	}
+	t->len = st.st_size;
+	if (!t->len) {
+		close(fd);
+		return 0;
+	}
+
+	t->map = mmap(NULL, t->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (t->map == MAP_FAILED) {
+		warn("mmap %s", path);
+		t->map = NULL;
+		return -1;
+	}
+	/* Read once front to back, let the kernel read ahead */
+	madvise((void *)t->map, t->len, MADV_SEQUENTIAL);
+
+	if (t->len < sizeof(*hdr) ||
+	    memcmp(t->map, WT_TRACE_MAGIC, sizeof(hdr->magic)))
+		return 0;
+
+	hdr = (const struct wt_trace_header *)t->map;
+	if (hdr->version != WT_TRACE_VERSION ||
+	    hdr->rows > (t->len - sizeof(*hdr)) / sizeof(struct wt_sample)) {
+		warnx("%s: bad binary trace header", path);
+		return -1;
+	}
+	t->binary = 1;
+	t->rows = (const struct wt_sample *)(hdr + 1);
+	t->nrows = hdr->rows;
+	return 0;
+}
+
+static void trace_close(struct trace *t)
+{
+	if (t->map)
+		munmap((void *)t->map, t->len);
+	t->map = NULL;
+}
+
+/* strtol() wants a terminated string, the mapping is not */
+static int parse_field(struct trace *t, int64_t *val, char sep)
+{
+	const uint8_t *p = t->map + t->pos;
+	const uint8_t *end = t->map + t->len;
+	int neg = 0;
+	int digits = 0;
+	int64_t v = 0;
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = v * 10 + (*p++ - '0');
+		digits++;
+	}
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+
+	if (!digits || digits > 18)
+		return -1;
+	if (sep == '\n' ? p < end && *p != '\n' : p == end || *p != sep)
+		return -1;
+	if (p < end)
+		p++;
+
+	t->pos = p - t->map;
+	*val = neg ? -v : v;
+	return 0;
+}
+
+static void skip_line(struct trace *t)
+{
+	const uint8_t *nl = memchr(t->map + t->pos, '\n', t->len - t->pos);
+
+	t->pos = nl ? (size_t)(nl - t->map) + 1 : t->len;
+}
+
+/* Returns 1 with a row in t->next, 0 at the end, -1 on a malformed row */
+static int trace_read_csv(struct trace *t)
+{
+	int64_t f[5];
+	uint8_t c;
+	int i;
+
+	while (t->pos < t->len) {
+		t->line++;
+		c = t->map[t->pos];
+		if (c == '\n' || c == '\r' || c == '#' ||
+		    (t->line == 1 && !(c == '-' || (c >= '0' && c <= '9')))) {
+			skip_line(t);
+			continue;
+		}
+
+		for (i = 0; i < 5; i++) {
+			if (parse_field(t, &f[i], i < 4 ? ',' : '\n')) {
+				warnx("%s:%lu: malformed row", t->path,
+				      t->line);
+				return -1;
+			}
+		}
+
+		/*
+		 * Anything the sample cannot hold as written is bad input,
+		 * not a reading to truncate into range and replay.
+		 */
+		for (i = 0; i < 5; i++) {
+			if (i ? f[i] < INT32_MIN || f[i] > INT32_MAX :
+				f[i] < 0) {
+				warnx("%s:%lu: malformed row, field %d out of "
+				      "range", t->path, t->line, i + 1);
+				return -1;
+			}
+		}
+		t->next.timestamp = f[0];
+		t->next.temp = f[1];
+		t->next.ph = f[2];
+		t->next.acid_flow = f[3];
+		t->next.sod_hydrox_flow = f[4];
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Fills t->next with the next row, same return values as above */
+static int trace_peek(struct trace *t)
+{
+	int ret;
+
+	if (t->have_next)
+		return 1;
+
+	if (t->binary) {
+		if (t->next_row == t->nrows)
+			return 0;
+		t->next = t->rows[t->next_row++];
+		ret = 1;
+	} else {
+		ret = t->map ? trace_read_csv(t) : 0;
+	}
+
+	t->have_next = ret == 1;
+	return ret;
+}
+
+static int write_decisions(FILE *out, int binary,
+			   const struct wt_decision *d, size_t n)
+{
+	size_t i;
+
+	if (binary)
+		return fwrite(d, sizeof(*d), n, out) == n ? 0 : -1;
+
+	for (i = 0; i < n; i++)
+		if (fprintf(out, "%" PRIu64 ",%u,%u\n", d[i].timestamp,
+			    d[i].verdict, d[i].actions) < 0)
+			return -1;
+	return 0;
+}
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* When a row is due, rows stamped before the first one are due at once */
+static uint64_t row_due_ns(uint64_t start_ns, uint64_t first_ts,
+			   uint64_t ts, double time_scale)
+{
+	if (ts < first_ts)
+		return start_ns;
+	return start_ns + (uint64_t)((ts - first_ts) * 1e6 / time_scale);
+}
+
+static void sleep_until_ns(uint64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+int trace_replay(struct session_pool *pool, const char *path,
+		 const char *out_path, double time_scale, size_t batch_size)
+{
+	struct wt_sample *samples = NULL;
+	struct wt_decision *decisions = NULL;
+	struct test_ctx *tee;
+	struct trace t;
+	struct timespec now;
+	FILE *out = NULL;
+	uint64_t first_ts = 0;
+	uint64_t start_ns;
+	uint64_t due_ns;
+	uint64_t lag_ns;
+	uint64_t max_lag_ns = 0;
+	uint64_t elapsed;
+	unsigned long rows = 0;
+	unsigned long invokes = 0;
+	unsigned long rejected = 0;
+	size_t batch_rejected;
+	uint32_t origin;
+	TEEC_Result res = TEEC_SUCCESS;
+	size_t n;
+	int ret = -1;
+	int more;
+
+	if (!batch_size)
+		batch_size = 1;
+	if (trace_open(&t, path))
+		return -1;
+
+	samples = calloc(batch_size, sizeof(*samples));
+	decisions = calloc(batch_size, sizeof(*decisions));
+	if (!samples || !decisions)
+		err(1, "calloc");
+
+	if (out_path) {
+		out = fopen(out_path, "w");
+		if (!out) {
+			warn("%s", out_path);
+			goto out;
+		}
+		setvbuf(out, NULL, _IOFBF, REPLAY_OUT_BUFFER);
+		if (!t.binary)
+			fprintf(out, "timestamp,verdict,actions\n");
+	}
+
+	printf("Replaying %s trace %s%s\n", t.binary ? "binary" : "CSV", path,
+	       time_scale > 0 ? "" : " as fast as possible");
+
+	start_ns = bench_now_ns();
+	more = trace_peek(&t);
+	if (more > 0)
+		first_ts = t.next.timestamp;
+
+	while (more > 0) {
+		n = 0;
+		if (time_scale > 0) {
+			/* Wait for the first row, then take all that are due */
+			due_ns = row_due_ns(start_ns, first_ts,
+					    t.next.timestamp, time_scale);
+			sleep_until_ns(due_ns);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			lag_ns = ts_to_ns(&now) - due_ns;
+			if (lag_ns > max_lag_ns)
+				max_lag_ns = lag_ns;
+		}
+
+		do {
+			if (time_scale > 0 && n &&
+			    row_due_ns(start_ns, first_ts, t.next.timestamp,
+				       time_scale) > ts_to_ns(&now))
+				break;
+			samples[n++] = t.next;
+			t.have_next = 0;
+			more = trace_peek(&t);
+		} while (more > 0 && n < batch_size);
+
+		if (more < 0)
+			break;
+
+		origin = 0;
+		tee = session_pool_acquire(pool);
+		if (!tee) {
+			warnx("No session with the TA available");
+			goto out;
+		}
+		res = evaluate_batch(tee, samples, n, decisions,
+				     &batch_rejected, &origin);
+		session_pool_release(pool, tee, res, origin);
+		if (res != TEEC_SUCCESS)
+			goto out;
+
+		invokes++;
+		rows += n;
+		rejected += batch_rejected;
+
+		if (out && write_decisions(out, t.binary, decisions, n)) {
+			warn("%s", out_path);
+			goto out;
+		}
+	}
+	if (more < 0)
+		goto out;
+
+	elapsed = bench_now_ns() - start_ns;
+	printf("Replayed %lu rows in %lu invokes, %.3f s, %.0f rows/s, "
+	       "%lu rejected\n", rows, invokes, elapsed / 1e9,
+	       elapsed ? rows / (elapsed / 1e9) : 0.0, rejected);
+	if (time_scale > 0)
+		printf("Time scale %g, worst lag behind the trace %.3f ms\n",
+		       time_scale, max_lag_ns / 1e6);
+	ret = 0;
+
+out:
+	if (out && fclose(out) && !ret) {
+		warn("%s", out_path);
+		ret = -1;
+	}
+	free(decisions);
+	free(samples);
+	trace_close(&t);
+	return ret;
+}
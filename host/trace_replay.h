@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "session_pool.h"
+
+/*
+ * Sensor traces come in two formats, told apart by the first bytes.
+ *
+ * Binary: struct wt_trace_header followed by rows struct wt_sample
+ * records in host byte order.
+ *
+ * CSV: one "timestamp,temp,ph,acid_flow,sod_hydrox_flow" row per line.
+ * Blank lines, lines starting with '#' and a header line are skipped.
+ *
+ * Timestamps are milliseconds and must not go backwards when replaying
+ * at a time scale.
+ */
+#define WT_TRACE_MAGIC		"WTTR"
+#define WT_TRACE_VERSION	1
+
+struct wt_trace_header {
+	char magic[4];		/* WT_TRACE_MAGIC */
+	uint32_t version;	/* WT_TRACE_VERSION */
+	uint64_t rows;
+};
+
+/*
+ * Streams every row of the trace at path through EVALUATE_BATCH on the
+ * pool's sessions, batch_size rows per invoke at most. With time_scale 0
+ * rows go as fast as the TA takes them, otherwise each row is sent once
+ * (timestamp - first timestamp) / time_scale has passed, so 2 replays
+ * twice as fast as recorded.
+ *
+ * If out_path is not NULL the decisions are written there, as struct
+ * wt_decision records for a binary trace and as
+ * "timestamp,verdict,actions" lines for a CSV one.
+ */
+int trace_replay(struct session_pool *pool, const char *path,
+		 const char *out_path, double time_scale, size_t batch_size);
+
+#endif /* TRACE_REPLAY_H */
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Stand-in for the subset of the GlobalPlatform TEE Internal Core API
+ * that the water treatment TA uses, so the TA can be compiled into a
+ * normal Linux process by the TEE stand-in.
+ */
+#ifndef TEE_INTERNAL_API_H
+#define TEE_INTERNAL_API_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <trace.h>
+
+#ifndef __maybe_unused
+#define __maybe_unused		__attribute__((unused))
+#endif
+
+typedef uint32_t TEE_Result;
+
+typedef struct {
+	uint32_t timeLow;
+	uint16_t timeMid;
+	uint16_t timeHiAndVersion;
+	uint8_t clockSeqAndNode[8];
+} TEE_UUID;
+
+typedef union {
+	struct {
+		void *buffer;
+		size_t size;
+	} memref;
+	struct {
+		uint32_t a;
+		uint32_t b;
+	} value;
+} TEE_Param;
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t millis;
+} TEE_Time;
+
+#define TEE_PARAM_TYPE_NONE		0
+#define TEE_PARAM_TYPE_VALUE_INPUT	1
+#define TEE_PARAM_TYPE_VALUE_OUTPUT	2
+#define TEE_PARAM_TYPE_VALUE_INOUT	3
+#define TEE_PARAM_TYPE_MEMREF_INPUT	5
+#define TEE_PARAM_TYPE_MEMREF_OUTPUT	6
+#define TEE_PARAM_TYPE_MEMREF_INOUT	7
+
+#define TEE_PARAM_TYPES(t0, t1, t2, t3) \
+	((t0) | ((t1) << 4) | ((t2) << 8) | ((t3) << 12))
+
+#define TEE_PARAM_TYPE_GET(t, i) ((((uint32_t)(t)) >> ((i) * 4)) & 0xF)
+
+#define TEE_SUCCESS			0x00000000
+#define TEE_ERROR_GENERIC		0xFFFF0000
+#define TEE_ERROR_ACCESS_DENIED		0xFFFF0001
+#define TEE_ERROR_CANCEL		0xFFFF0002
+#define TEE_ERROR_ACCESS_CONFLICT	0xFFFF0003
+#define TEE_ERROR_EXCESS_DATA		0xFFFF0004
+#define TEE_ERROR_BAD_FORMAT		0xFFFF0005
+#define TEE_ERROR_BAD_PARAMETERS	0xFFFF0006
+#define TEE_ERROR_BAD_STATE		0xFFFF0007
+#define TEE_ERROR_ITEM_NOT_FOUND	0xFFFF0008
+#define TEE_ERROR_NOT_IMPLEMENTED	0xFFFF0009
+#define TEE_ERROR_NOT_SUPPORTED		0xFFFF000A
+#define TEE_ERROR_NO_DATA		0xFFFF000B
+#define TEE_ERROR_OUT_OF_MEMORY		0xFFFF000C
+#define TEE_ERROR_BUSY			0xFFFF000D
+#define TEE_ERROR_COMMUNICATION		0xFFFF000E
+#define TEE_ERROR_SECURITY		0xFFFF000F
+#define TEE_ERROR_SHORT_BUFFER		0xFFFF0010
+#define TEE_ERROR_OVERFLOW		0xFFFF300F
+#define TEE_ERROR_MAC_INVALID		0xFFFF3071
+#define TEE_ERROR_TARGET_DEAD		0xFFFF3024
+
+/* Hints for TEE_Malloc() */
+#define TEE_MALLOC_FILL_ZERO		0x00000000
+#define TEE_USER_MEM_HINT_NO_FILL_ZERO	0x80000000
+
+void *TEE_Malloc(size_t size, uint32_t hint);
+void TEE_Free(void *buffer);
+void *TEE_MemMove(void *dest, const void *src, size_t size);
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2, size_t size);
+void TEE_MemFill(void *buff, uint32_t x, size_t size);
+
+void TEE_GenerateRandom(void *randomBuffer, size_t randomBufferLen);
+
+void TEE_GetSystemTime(TEE_Time *time);
+void TEE_GetREETime(TEE_Time *time);
+
+void TEE_Panic(TEE_Result panicCode) __attribute__((noreturn));
+
+/* Cryptographic operations, only HMAC-SHA256 */
+typedef struct __TEE_OperationHandle *TEE_OperationHandle;
+typedef struct __TEE_ObjectHandle *TEE_ObjectHandle;
+typedef uint32_t TEE_ObjectType;
+
+#define TEE_HANDLE_NULL			0
+
+#define TEE_ALG_HMAC_SHA256		0x30000004
+#define TEE_MODE_MAC			4
+#define TEE_TYPE_HMAC_SHA256		0xA0000004
+#define TEE_ATTR_SECRET_VALUE		0xC0000000
+
+typedef struct {
+	uint32_t attributeID;
+	union {
+		struct {
+			void *buffer;
+			size_t length;
+		} ref;
+		struct {
+			uint32_t a;
+			uint32_t b;
+		} value;
+	} content;
+} TEE_Attribute;
+
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+				       uint32_t maxObjectSize,
+				       TEE_ObjectHandle *object);
+void TEE_FreeTransientObject(TEE_ObjectHandle object);
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			  const void *buffer, size_t length);
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+				       const TEE_Attribute *attrs,
+				       uint32_t attrCount);
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+				 uint32_t algorithm, uint32_t mode,
+				 uint32_t maxKeySize);
+void TEE_FreeOperation(TEE_OperationHandle operation);
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			       TEE_ObjectHandle key);
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV, size_t IVLen);
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+		   size_t chunkSize);
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       void *mac, size_t *macLen);
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       const void *mac, size_t macLen);
+
+bool TEE_GetCancellationFlag(void);
+bool TEE_UnmaskCancellation(void);
+bool TEE_MaskCancellation(void);
+
+/* Entry points every TA implements */
+TEE_Result TA_CreateEntryPoint(void);
+void TA_DestroyEntryPoint(void);
+TEE_Result TA_OpenSessionEntryPoint(uint32_t paramTypes,
+				    TEE_Param params[4],
+				    void **sessionContext);
+void TA_CloseSessionEntryPoint(void *sessionContext);
+TEE_Result TA_InvokeCommandEntryPoint(void *sessionContext,
+				      uint32_t commandID,
+				      uint32_t paramTypes,
+				      TEE_Param params[4]);
+
+#endif /* TEE_INTERNAL_API_H */
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * OP-TEE style TA trace macros. Messages above CFG_TEE_TA_LOG_LEVEL are
+ * compiled out, the rest go to stderr with the usual level prefix.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifndef CFG_TEE_TA_LOG_LEVEL
+#define CFG_TEE_TA_LOG_LEVEL	1
+#endif
+
+#define TRACE_ERROR	1
+#define TRACE_INFO	2
+#define TRACE_DEBUG	3
+#define TRACE_FLOW	4
+
+void trace_printf(const char *func, int line, int level, const char *fmt,
+		  ...) __attribute__((format(printf, 4, 5)));
+
+#define trace_printf_helper(level, ...) \
+	do { \
+		if ((level) <= CFG_TEE_TA_LOG_LEVEL) \
+			trace_printf(__func__, __LINE__, (level), \
+				     __VA_ARGS__); \
+	} while (0)
+
+#define EMSG(...)	trace_printf_helper(TRACE_ERROR, __VA_ARGS__)
+#define IMSG(...)	trace_printf_helper(TRACE_INFO, __VA_ARGS__)
+#define DMSG(...)	trace_printf_helper(TRACE_DEBUG, __VA_ARGS__)
+#define FMSG(...)	trace_printf_helper(TRACE_FLOW, __VA_ARGS__)
+
+#endif /* TRACE_H */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The TEE Internal Core API functions the TA calls, implemented on top of
+ * libc for the in-process stand-in.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+
+#include <tee_internal_api.h>
+
+#include "standin_priv.h"
+
+static __thread bool cancel_masked = true;
+
+void *TEE_Malloc(size_t size, uint32_t hint)
+{
+	if (hint & TEE_USER_MEM_HINT_NO_FILL_ZERO)
+		return malloc(size ? size : 1);
+	return calloc(1, size ? size : 1);
+}
+
+void TEE_Free(void *buffer)
+{
+	free(buffer);
+}
+
+void *TEE_MemMove(void *dest, const void *src, size_t size)
+{
+	return memmove(dest, src, size);
+}
+
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2, size_t size)
+{
+	return memcmp(buffer1, buffer2, size);
+}
+
+void TEE_MemFill(void *buff, uint32_t x, size_t size)
+{
+	memset(buff, x, size);
+}
+
+void TEE_GenerateRandom(void *randomBuffer, size_t randomBufferLen)
+{
+	uint8_t *p = randomBuffer;
+	ssize_t n;
+
+	while (randomBufferLen) {
+		n = getrandom(p, randomBufferLen, 0);
+		if (n < 0)
+			standin_panic(TEE_ERROR_GENERIC);
+		p += n;
+		randomBufferLen -= n;
+	}
+}
+
+static void get_time(clockid_t clock, TEE_Time *time)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	time->seconds = ts.tv_sec;
+	time->millis = ts.tv_nsec / 1000000;
+}
+
+void TEE_GetSystemTime(TEE_Time *time)
+{
+	get_time(CLOCK_MONOTONIC, time);
+}
+
+void TEE_GetREETime(TEE_Time *time)
+{
+	get_time(CLOCK_REALTIME, time);
+}
+
+void TEE_Panic(TEE_Result panicCode)
+{
+	standin_panic(panicCode);
+}
+
+bool TEE_GetCancellationFlag(void)
+{
+	return !cancel_masked && standin_cancel_requested();
+}
+
+bool TEE_UnmaskCancellation(void)
+{
+	bool was_masked = cancel_masked;
+
+	cancel_masked = false;
+	return was_masked;
+}
+
+bool TEE_MaskCancellation(void)
+{
+	bool was_masked = cancel_masked;
+
+	cancel_masked = true;
+	return was_masked;
+}
+
+void trace_printf(const char *func, int line, int level, const char *fmt,
+		  ...)
+{
+	static const char prefix[] = "EIDF";
+	va_list ap;
+
+	fprintf(stderr, "%c/TA: %s:%d ", prefix[(level - 1) & 3], func, line);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
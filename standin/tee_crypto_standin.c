@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The TEE Internal Core API cryptographic operations the TA uses, for
+ * the in-process stand-in: HMAC-SHA256 and nothing else, on the same
+ * host/sha256.c the sensor side signs with. Misuse panics the TA the way
+ * a real TEE would.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <tee_internal_api.h>
+
+#include "sha256.h"
+#include "standin_priv.h"
+
+struct __TEE_ObjectHandle {
+	TEE_ObjectType type;
+	uint32_t max_bits;
+	size_t key_len;
+	uint8_t *key;		/* NULL until populated */
+};
+
+struct __TEE_OperationHandle {
+	uint32_t algorithm;
+	bool keyed;
+	bool started;		/* between TEE_MACInit() and a final */
+	struct hmac_sha256 key;
+	struct sha256 mac;	/* the MAC in progress */
+};
+
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+				       uint32_t maxObjectSize,
+				       TEE_ObjectHandle *object)
+{
+	TEE_ObjectHandle o;
+
+	*object = TEE_HANDLE_NULL;
+	if (objectType != TEE_TYPE_HMAC_SHA256)
+		return TEE_ERROR_NOT_SUPPORTED;
+	/* GP allows 192 to 1024 bit HMAC-SHA256 keys */
+	if (maxObjectSize < 192 || maxObjectSize > 1024 || maxObjectSize % 8)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	o = calloc(1, sizeof(*o));
+	if (!o)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	o->type = objectType;
+	o->max_bits = maxObjectSize;
+	*object = o;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeTransientObject(TEE_ObjectHandle object)
+{
+	if (!object)
+		return;
+	if (object->key) {
+		memset(object->key, 0, object->key_len);
+		free(object->key);
+	}
+	free(object);
+}
+
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			  const void *buffer, size_t length)
+{
+	attr->attributeID = attributeID;
+	attr->content.ref.buffer = (void *)buffer;
+	attr->content.ref.length = length;
+}
+
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+				       const TEE_Attribute *attrs,
+				       uint32_t attrCount)
+{
+	size_t len;
+
+	if (!object || object->key || attrCount != 1 ||
+	    attrs[0].attributeID != TEE_ATTR_SECRET_VALUE)
+		standin_panic(TEE_ERROR_BAD_PARAMETERS);
+
+	len = attrs[0].content.ref.length;
+	if (len * 8 > object->max_bits)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	object->key = malloc(len ? len : 1);
+	if (!object->key)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memcpy(object->key, attrs[0].content.ref.buffer, len);
+	object->key_len = len;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+				 uint32_t algorithm, uint32_t mode,
+				 uint32_t maxKeySize)
+{
+	TEE_OperationHandle op;
+
+	*operation = TEE_HANDLE_NULL;
+	if (algorithm != TEE_ALG_HMAC_SHA256 || mode != TEE_MODE_MAC)
+		return TEE_ERROR_NOT_SUPPORTED;
+	if (maxKeySize < 192 || maxKeySize > 1024 || maxKeySize % 8)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	op = calloc(1, sizeof(*op));
+	if (!op)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	op->algorithm = algorithm;
+	*operation = op;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeOperation(TEE_OperationHandle operation)
+{
+	if (!operation)
+		return;
+	memset(operation, 0, sizeof(*operation));
+	free(operation);
+}
+
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			       TEE_ObjectHandle key)
+{
+	if (!operation || !key || !key->key || operation->started)
+		standin_panic(TEE_ERROR_BAD_PARAMETERS);
+
+	/* The operation keeps its own copy, the object can go */
+	hmac_sha256_key(&operation->key, key->key, key->key_len);
+	operation->keyed = true;
+	return TEE_SUCCESS;
+}
+
+void TEE_MACInit(TEE_OperationHandle operation, const void *IV, size_t IVLen)
+{
+	(void)IV;
+	(void)IVLen;
+
+	if (!operation || !operation->keyed)
+		standin_panic(TEE_ERROR_BAD_STATE);
+	operation->mac = operation->key.inner;
+	operation->started = true;
+}
+
+void TEE_MACUpdate(TEE_OperationHandle operation, const void *chunk,
+		   size_t chunkSize)
+{
+	if (!operation || !operation->started)
+		standin_panic(TEE_ERROR_BAD_STATE);
+	sha256_update(&operation->mac, chunk, chunkSize);
+}
+
+TEE_Result TEE_MACComputeFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       void *mac, size_t *macLen)
+{
+	uint8_t out[SHA256_DIGEST];
+
+	if (!operation || !operation->started)
+		standin_panic(TEE_ERROR_BAD_STATE);
+	if (*macLen < SHA256_DIGEST) {
+		*macLen = SHA256_DIGEST;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	sha256_update(&operation->mac, message, messageLen);
+	hmac_sha256_final(&operation->key, &operation->mac, out);
+	operation->started = false;
+
+	memcpy(mac, out, SHA256_DIGEST);
+	*macLen = SHA256_DIGEST;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_MACCompareFinal(TEE_OperationHandle operation,
+			       const void *message, size_t messageLen,
+			       const void *mac, size_t macLen)
+{
+	uint8_t out[SHA256_DIGEST];
+	size_t len = sizeof(out);
+	const uint8_t *expected = mac;
+	uint8_t diff = 0;
+	size_t i;
+
+	TEE_MACComputeFinal(operation, message, messageLen, out, &len);
+
+	if (macLen != SHA256_DIGEST)
+		return TEE_ERROR_MAC_INVALID;
+	/* Constant time, like the real thing */
+	for (i = 0; i < SHA256_DIGEST; i++)
+		diff |= out[i] ^ expected[i];
+	return diff ? TEE_ERROR_MAC_INVALID : TEE_SUCCESS;
+}
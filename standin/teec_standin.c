@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * TEE Client API stand-in that runs the water treatment TA inside the
+ * calling process. It lets the host be built, benchmarked and tested on a
+ * plain Linux machine with no OP-TEE driver or TA dev kit.
+ *
+ * The TA is linked in directly, so there is one copy of its file-scope
+ * data. All sessions therefore share a single TA instance whatever
+ * TA_FLAGS says, and entries into the TA are serialised the way OP-TEE
+ * serialises calls into one instance. A TEE_Panic() kills the instance:
+ * every open session then fails with TEEC_ERROR_TARGET_DEAD and the next
+ * session open creates a fresh instance. Its file-scope data is still what
+ * the dead one left, so TA_CreateEntryPoint() resets all of it.
+ *
+ * TEE_STANDIN_SWITCH_NS in the environment adds a busy wait of that many
+ * nanoseconds to every session open and invoke, as a stand-in for the
+ * world switch cost of real hardware.
+ */
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <tee_client_api.h>
+#include <tee_internal_api.h>
+#include <user_ta_header.h>
+#include <user_ta_header_defines.h>
+
+#include "standin_priv.h"
+
+struct standin_session {
+	void *sess_ctx;
+	unsigned long instance;	/* generation the session was opened on */
+};
+
+static const TEEC_UUID ta_uuid = TA_UUID;
+
+static pthread_mutex_t ta_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ta_alive;
+static unsigned long ta_instance;
+static unsigned int ta_sessions;
+static uint32_t next_session_id = 1;
+
+static pthread_once_t switch_once = PTHREAD_ONCE_INIT;
+static uint64_t switch_ns;
+
+static __thread jmp_buf *panic_jmp;
+static __thread volatile uint32_t *cancel_flag;
+
+enum ta_entry {
+	ENTRY_CREATE,
+	ENTRY_OPEN,
+	ENTRY_INVOKE,
+	ENTRY_CLOSE,
+	ENTRY_DESTROY,
+};
+
+struct ta_call {
+	enum ta_entry entry;
+	uint32_t cmd;
+	uint32_t param_types;
+	TEE_Param *params;
+	void **sess_ctx;
+};
+
+void standin_panic(uint32_t code)
+{
+	fprintf(stderr, "E/TA: panicked with code 0x%x\n", code);
+	if (!panic_jmp)
+		abort();
+	longjmp(*panic_jmp, 1);
+}
+
+bool standin_cancel_requested(void)
+{
+	return cancel_flag && __atomic_load_n(cancel_flag, __ATOMIC_RELAXED);
+}
+
+static void read_switch_cost(void)
+{
+	const char *env = getenv("TEE_STANDIN_SWITCH_NS");
+
+	if (env)
+		switch_ns = strtoull(env, NULL, 0);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void world_switch(void)
+{
+	uint64_t end;
+
+	pthread_once(&switch_once, read_switch_cost);
+	if (!switch_ns)
+		return;
+
+	end = now_ns() + switch_ns;
+	while (now_ns() < end)
+		;
+}
+
+/* Enters the TA with ta_lock held, turning a panic into TARGET_DEAD */
+static TEE_Result call_ta(struct ta_call *c)
+{
+	jmp_buf jb;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (setjmp(jb)) {
+		panic_jmp = NULL;
+		ta_alive = 0;
+		ta_instance++;
+		ta_sessions = 0;
+		return TEE_ERROR_TARGET_DEAD;
+	}
+	panic_jmp = &jb;
+	TEE_MaskCancellation();
+
+	switch (c->entry) {
+	case ENTRY_CREATE:
+		res = TA_CreateEntryPoint();
+		break;
+	case ENTRY_OPEN:
+		res = TA_OpenSessionEntryPoint(c->param_types, c->params,
+					       c->sess_ctx);
+		break;
+	case ENTRY_INVOKE:
+		res = TA_InvokeCommandEntryPoint(*c->sess_ctx, c->cmd,
+						 c->param_types, c->params);
+		break;
+	case ENTRY_CLOSE:
+		TA_CloseSessionEntryPoint(*c->sess_ctx);
+		break;
+	case ENTRY_DESTROY:
+		TA_DestroyEntryPoint();
+		break;
+	}
+
+	panic_jmp = NULL;
+	return res;
+}
+
+/* Maps the client parameters onto what the TA sees */
+static TEEC_Result params_to_ta(TEEC_Operation *op, TEE_Param *params,
+				uint32_t *types)
+{
+	TEEC_SharedMemory *shm;
+	uint32_t t;
+	uint32_t ta_t;
+	int i;
+
+	memset(params, 0, 4 * sizeof(*params));
+	*types = 0;
+	if (!op)
+		return TEEC_SUCCESS;
+
+	for (i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		t = TEEC_PARAM_TYPE_GET(op->paramTypes, i);
+		switch (t) {
+		case TEEC_NONE:
+			ta_t = TEE_PARAM_TYPE_NONE;
+			break;
+		case TEEC_VALUE_INPUT:
+		case TEEC_VALUE_OUTPUT:
+		case TEEC_VALUE_INOUT:
+			ta_t = t;
+			params[i].value.a = op->params[i].value.a;
+			params[i].value.b = op->params[i].value.b;
+			break;
+		case TEEC_MEMREF_TEMP_INPUT:
+		case TEEC_MEMREF_TEMP_OUTPUT:
+		case TEEC_MEMREF_TEMP_INOUT:
+			ta_t = t;
+			params[i].memref.buffer = op->params[i].tmpref.buffer;
+			params[i].memref.size = op->params[i].tmpref.size;
+			break;
+		case TEEC_MEMREF_WHOLE:
+			shm = op->params[i].memref.parent;
+			if (!shm || !(shm->flags & (TEEC_MEM_INPUT |
+						    TEEC_MEM_OUTPUT)))
+				return TEEC_ERROR_BAD_PARAMETERS;
+			if (!(shm->flags & TEEC_MEM_OUTPUT))
+				ta_t = TEE_PARAM_TYPE_MEMREF_INPUT;
+			else if (!(shm->flags & TEEC_MEM_INPUT))
+				ta_t = TEE_PARAM_TYPE_MEMREF_OUTPUT;
+			else
+				ta_t = TEE_PARAM_TYPE_MEMREF_INOUT;
+			params[i].memref.buffer = shm->buffer;
+			params[i].memref.size = shm->size;
+			break;
+		case TEEC_MEMREF_PARTIAL_INPUT:
+		case TEEC_MEMREF_PARTIAL_OUTPUT:
+		case TEEC_MEMREF_PARTIAL_INOUT:
+			shm = op->params[i].memref.parent;
+			if (!shm ||
+			    op->params[i].memref.offset > shm->size ||
+			    op->params[i].memref.size >
+			    shm->size - op->params[i].memref.offset)
+				return TEEC_ERROR_BAD_PARAMETERS;
+			if (((t & TEEC_MEM_INPUT) &&
+			     !(shm->flags & TEEC_MEM_INPUT)) ||
+			    ((t & TEEC_MEM_OUTPUT) &&
+			     !(shm->flags & TEEC_MEM_OUTPUT)))
+				return TEEC_ERROR_BAD_PARAMETERS;
+			ta_t = t - TEEC_MEMREF_PARTIAL_INPUT +
+			       TEE_PARAM_TYPE_MEMREF_INPUT;
+			params[i].memref.buffer = (uint8_t *)shm->buffer +
+						  op->params[i].memref.offset;
+			params[i].memref.size = op->params[i].memref.size;
+			break;
+		default:
+			return TEEC_ERROR_BAD_PARAMETERS;
+		}
+		*types |= ta_t << (i * 4);
+	}
+
+	return TEEC_SUCCESS;
+}
+
+/* Copies outputs and updated buffer sizes back to the client */
+static void params_from_ta(TEEC_Operation *op, const TEE_Param *params)
+{
+	uint32_t t;
+	int i;
+
+	if (!op)
+		return;
+
+	for (i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		t = TEEC_PARAM_TYPE_GET(op->paramTypes, i);
+		switch (t) {
+		case TEEC_VALUE_OUTPUT:
+		case TEEC_VALUE_INOUT:
+			op->params[i].value.a = params[i].value.a;
+			op->params[i].value.b = params[i].value.b;
+			break;
+		case TEEC_MEMREF_TEMP_OUTPUT:
+		case TEEC_MEMREF_TEMP_INOUT:
+			op->params[i].tmpref.size = params[i].memref.size;
+			break;
+		case TEEC_MEMREF_WHOLE:
+		case TEEC_MEMREF_PARTIAL_OUTPUT:
+		case TEEC_MEMREF_PARTIAL_INOUT:
+			op->params[i].memref.size = params[i].memref.size;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Caller holds ta_lock */
+static void instance_put(void)
+{
+	struct ta_call c = { .entry = ENTRY_DESTROY };
+
+	if (--ta_sessions || !ta_alive)
+		return;
+	if (TA_FLAGS & TA_FLAG_INSTANCE_KEEP_ALIVE)
+		return;
+
+	call_ta(&c);
+	ta_alive = 0;
+}
+
+TEEC_Result TEEC_InitializeContext(const char *name, TEEC_Context *context)
+{
+	(void)name;
+
+	if (!context)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	context->fd = 0;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context *context)
+{
+	if (context)
+		context->fd = -1;
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *context, TEEC_Session *session,
+			     const TEEC_UUID *destination,
+			     uint32_t connectionMethod,
+			     const void *connectionData,
+			     TEEC_Operation *operation,
+			     uint32_t *returnOrigin)
+{
+	struct standin_session *s;
+	struct ta_call c = { .entry = ENTRY_CREATE };
+	TEE_Param params[4];
+	uint32_t origin = TEEC_ORIGIN_API;
+	TEEC_Result res;
+
+	(void)connectionMethod;
+	(void)connectionData;
+
+	if (!context || !session || !destination) {
+		res = TEEC_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+	if (memcmp(destination, &ta_uuid, sizeof(ta_uuid))) {
+		origin = TEEC_ORIGIN_TEE;
+		res = TEEC_ERROR_ITEM_NOT_FOUND;
+		goto out;
+	}
+
+	res = params_to_ta(operation, params, &c.param_types);
+	if (res != TEEC_SUCCESS)
+		goto out;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		res = TEEC_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	world_switch();
+	pthread_mutex_lock(&ta_lock);
+
+	origin = TEEC_ORIGIN_TRUSTED_APP;
+	if (!ta_alive) {
+		res = call_ta(&c);
+		if (res != TEE_SUCCESS) {
+			pthread_mutex_unlock(&ta_lock);
+			free(s);
+			goto out;
+		}
+		ta_alive = 1;
+	}
+	ta_sessions++;
+
+	c.entry = ENTRY_OPEN;
+	c.params = params;
+	c.sess_ctx = &s->sess_ctx;
+	res = call_ta(&c);
+	if (res == TEE_ERROR_TARGET_DEAD && !ta_alive) {
+		origin = TEEC_ORIGIN_TEE;
+	} else if (res != TEE_SUCCESS) {
+		instance_put();
+	} else {
+		s->instance = ta_instance;
+		session->session_id = next_session_id++;
+	}
+
+	pthread_mutex_unlock(&ta_lock);
+
+	params_from_ta(operation, params);
+	if (res != TEEC_SUCCESS) {
+		free(s);
+		goto out;
+	}
+
+	session->ctx = context;
+	session->imp = s;
+	origin = TEEC_ORIGIN_TRUSTED_APP;
+out:
+	if (returnOrigin)
+		*returnOrigin = origin;
+	return res;
+}
+
+void TEEC_CloseSession(TEEC_Session *session)
+{
+	struct standin_session *s;
+	struct ta_call c = { .entry = ENTRY_CLOSE };
+
+	if (!session || !session->imp)
+		return;
+	s = session->imp;
+
+	pthread_mutex_lock(&ta_lock);
+	if (ta_alive && s->instance == ta_instance) {
+		c.sess_ctx = &s->sess_ctx;
+		if (call_ta(&c) == TEE_SUCCESS)
+			instance_put();
+	}
+	pthread_mutex_unlock(&ta_lock);
+
+	free(s);
+	session->imp = NULL;
+}
+
+/*
+ * Takes ta_lock, or gives up once the operation is cancelled while it is
+ * still queued behind other invokes, like a request waiting for a busy
+ * single-instance TA.
+ */
+static int lock_ta_cancellable(TEEC_Operation *operation)
+{
+	struct timespec ts;
+
+	if (!operation) {
+		pthread_mutex_lock(&ta_lock);
+		return 0;
+	}
+
+	while (pthread_mutex_trylock(&ta_lock)) {
+		if (__atomic_load_n(&operation->cancelled, __ATOMIC_RELAXED))
+			return -1;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		if (!pthread_mutex_timedlock(&ta_lock, &ts))
+			break;
+	}
+	return 0;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID,
+			       TEEC_Operation *operation,
+			       uint32_t *returnOrigin)
+{
+	struct standin_session *s;
+	struct ta_call c = { .entry = ENTRY_INVOKE, .cmd = commandID };
+	TEE_Param params[4];
+	uint32_t origin = TEEC_ORIGIN_API;
+	TEEC_Result res;
+
+	if (!session || !session->imp) {
+		res = TEEC_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+	s = session->imp;
+
+	res = params_to_ta(operation, params, &c.param_types);
+	if (res != TEEC_SUCCESS)
+		goto out;
+
+	if (operation) {
+		if (operation->cancelled) {
+			origin = TEEC_ORIGIN_COMMS;
+			res = TEEC_ERROR_CANCEL;
+			goto out;
+		}
+		operation->session = session;
+		operation->started = 1;
+	}
+
+	world_switch();
+	if (lock_ta_cancellable(operation)) {
+		origin = TEEC_ORIGIN_COMMS;
+		res = TEEC_ERROR_CANCEL;
+		goto out;
+	}
+
+	if (!ta_alive || s->instance != ta_instance) {
+		pthread_mutex_unlock(&ta_lock);
+		origin = TEEC_ORIGIN_TEE;
+		res = TEEC_ERROR_TARGET_DEAD;
+		goto out;
+	}
+
+	cancel_flag = operation ? &operation->cancelled : NULL;
+	c.params = params;
+	c.sess_ctx = &s->sess_ctx;
+	res = call_ta(&c);
+	cancel_flag = NULL;
+	origin = ta_alive ? TEEC_ORIGIN_TRUSTED_APP : TEEC_ORIGIN_TEE;
+
+	pthread_mutex_unlock(&ta_lock);
+
+	params_from_ta(operation, params);
+out:
+	if (returnOrigin)
+		*returnOrigin = origin;
+	return res;
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *context,
+				      TEEC_SharedMemory *sharedMem)
+{
+	if (!context || !sharedMem || (!sharedMem->buffer && sharedMem->size))
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	sharedMem->buffer_allocated = false;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *context,
+				      TEEC_SharedMemory *sharedMem)
+{
+	if (!context || !sharedMem)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	/* Page aligned like the driver's allocation, and never NULL */
+	if (posix_memalign(&sharedMem->buffer, 4096,
+			   sharedMem->size ? sharedMem->size : 8))
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	sharedMem->buffer_allocated = true;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *sharedMemory)
+{
+	if (!sharedMemory)
+		return;
+
+	if (sharedMemory->buffer_allocated)
+		free(sharedMemory->buffer);
+	sharedMemory->buffer = NULL;
+	sharedMemory->size = 0;
+	sharedMemory->buffer_allocated = false;
+}
+
+void TEEC_RequestCancellation(TEEC_Operation *operation)
+{
+	if (operation)
+		__atomic_store_n(&operation->cancelled, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <water_treatment_ta.h>
+
+#include "channels.h"
+
+static const struct pump_range plant_limits[] = {
+	[WT_SENSOR_TEMP]		= PUMP_RANGE(-40, 160),
+	[WT_SENSOR_PH]			= PUMP_RANGE(0, 14),
+	[WT_SENSOR_ACID_FLOW]		= PUMP_RANGE(0, PUMP_FLOW_MAX),
+	[WT_SENSOR_SOD_HYDROX_FLOW]	= PUMP_RANGE(0, PUMP_FLOW_MAX),
+	[WT_SENSOR_CHLORINE]		= PUMP_RANGE(0, 500),
+	[WT_SENSOR_TURBIDITY]		= PUMP_RANGE(0, 1000),
+	[WT_SENSOR_INFLOW]		= PUMP_RANGE(0, 5000),
+	[WT_SENSOR_CHLORINE_FLOW]	= PUMP_RANGE(0, PUMP_FLOW_MAX),
+	[WT_SENSOR_COAGULANT_FLOW]	= PUMP_RANGE(0, PUMP_FLOW_MAX),
+};
+
+#define TERM(s, lo, hi)	{ .sensor = (s), .range = PUMP_RANGE(lo, hi) }
+
+/* The two dosing valves follow the same rules as the pump commands */
+static const struct channel_actuator plant_actuators[] = {
+	[WT_ACT_SOD_HYDROX] = {
+		.on = {
+			TERM(WT_SENSOR_TEMP, 41, UINT32_MAX),
+			TERM(WT_SENSOR_PH, 0, 4),
+			TERM(WT_SENSOR_ACID_FLOW, 0, 0),
+			TERM(WT_SENSOR_SOD_HYDROX_FLOW, 0, 0),
+		},
+		.on_terms = 4,
+		.off = {
+			TERM(WT_SENSOR_PH, 6, UINT32_MAX),
+			TERM(WT_SENSOR_SOD_HYDROX_FLOW, 1, UINT32_MAX),
+		},
+		.off_terms = 2,
+	},
+	[WT_ACT_ACID] = {
+		.on = {
+			TERM(WT_SENSOR_TEMP, 0, 89),
+			TERM(WT_SENSOR_PH, 10, UINT32_MAX),
+			TERM(WT_SENSOR_ACID_FLOW, 0, 0),
+			TERM(WT_SENSOR_SOD_HYDROX_FLOW, 0, 0),
+		},
+		.on_terms = 4,
+		.off = {
+			TERM(WT_SENSOR_PH, 0, 8),
+			TERM(WT_SENSOR_ACID_FLOW, 1, UINT32_MAX),
+		},
+		.off_terms = 2,
+	},
+	/* Keep 0.5 - 2 mg/L of residual chlorine while water flows */
+	[WT_ACT_CHLORINE] = {
+		.on = {
+			TERM(WT_SENSOR_CHLORINE, 0, 49),
+			TERM(WT_SENSOR_INFLOW, 1, UINT32_MAX),
+			TERM(WT_SENSOR_CHLORINE_FLOW, 0, 0),
+		},
+		.on_terms = 3,
+		.off = {
+			TERM(WT_SENSOR_CHLORINE, 200, UINT32_MAX),
+			TERM(WT_SENSOR_CHLORINE_FLOW, 1, UINT32_MAX),
+		},
+		.off_terms = 2,
+	},
+	/* Coagulate above 5 NTU, stop once below 1 NTU */
+	[WT_ACT_COAGULANT] = {
+		.on = {
+			TERM(WT_SENSOR_TURBIDITY, 50, UINT32_MAX),
+			TERM(WT_SENSOR_INFLOW, 1, UINT32_MAX),
+			TERM(WT_SENSOR_COAGULANT_FLOW, 0, 0),
+		},
+		.on_terms = 3,
+		.off = {
+			TERM(WT_SENSOR_TURBIDITY, 0, 10),
+			TERM(WT_SENSOR_COAGULANT_FLOW, 1, UINT32_MAX),
+		},
+		.off_terms = 2,
+	},
+};
+
+const struct channel_map plant_channels = {
+	.limits = plant_limits,
+	.sensor_count = sizeof(plant_limits) / sizeof(plant_limits[0]),
+	.actuators = plant_actuators,
+	.actuator_count = sizeof(plant_actuators) / sizeof(plant_actuators[0]),
+};
+
+static inline int in_range(const struct pump_range *range, uint32_t v)
+{
+	return v - range->lo <= range->span;
+}
+
+int channel_load(const struct channel_map *m, struct channel_readings *r,
+		 const struct wt_reading *in, uint32_t n)
+{
+	int reject = WT_REJECT_NONE;
+	uint32_t s;
+	uint32_t i;
+
+	for (i = 0; i < CHANNEL_WORDS(WT_SENSORS_MAX); i++)
+		r->present[i] = 0;
+
+	for (i = 0; i < n; i++) {
+		s = in[i].sensor;
+		if (s >= m->sensor_count)
+			return -1;
+		r->value[s] = in[i].value;
+		r->present[s / 64] |= 1ULL << (s % 64);
+		if (!in_range(&m->limits[s], r->value[s]))
+			reject = WT_REJECT_DEVICE_LIMITS;
+	}
+
+	return reject;
+}
+
+uint32_t channel_check(const struct channel_map *m,
+		       const struct channel_readings *r, uint32_t act, int on)
+{
+	const struct channel_actuator *a = &m->actuators[act];
+	const struct channel_term *t = on ? a->on : a->off;
+	uint32_t terms = on ? a->on_terms : a->off_terms;
+	uint32_t reject = WT_REJECT_NONE;
+	uint32_t i;
+
+	for (i = 0; i < terms; i++) {
+		if (!(r->present[t[i].sensor / 64] &
+		      (1ULL << (t[i].sensor % 64))))
+			return WT_REJECT_MISSING;
+		if (!in_range(&t[i].range, r->value[t[i].sensor]))
+			reject = WT_REJECT_ARGS_OOB;
+	}
+
+	return reject;
+}
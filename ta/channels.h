@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+#include <stdint.h>
+
+#include <water_treatment_ta.h>
+
+#include "pump_rules.h"
+
+/* A condition: the reading of sensor lies in range */
+struct channel_term {
+	uint8_t sensor;
+	struct pump_range range;
+};
+
+/* When an actuator may be switched on and off, every term has to hold */
+struct channel_actuator {
+	struct channel_term on[WT_ACT_TERMS];
+	struct channel_term off[WT_ACT_TERMS];
+	uint8_t on_terms;
+	uint8_t off_terms;
+};
+
+struct channel_map {
+	const struct pump_range *limits;	/* per sensor device limits */
+	uint32_t sensor_count;
+	const struct channel_actuator *actuators;
+	uint32_t actuator_count;
+};
+
+/* The channels of the plant this TA controls */
+extern const struct channel_map plant_channels;
+
+#define CHANNEL_WORDS(n)	(((n) + 63) / 64)
+
+/*
+ * The readings of one call, indexed by sensor. Only entries whose bit is
+ * set in present hold a reading, so loading a call costs as much as the
+ * readings it brings, not as much as the sensors the plant has.
+ */
+struct channel_readings {
+	uint64_t present[CHANNEL_WORDS(WT_SENSORS_MAX)];
+	uint32_t value[WT_SENSORS_MAX];
+};
+
+/*
+ * Loads n readings. Returns -1 if one names a sensor the map does not
+ * have, WT_REJECT_DEVICE_LIMITS if one is past its limits, otherwise
+ * WT_REJECT_NONE.
+ */
+int channel_load(const struct channel_map *m, struct channel_readings *r,
+		 const struct wt_reading *in, uint32_t n);
+
+/*
+ * Checks the conditions for switching actuator act on or off against
+ * loaded readings: WT_REJECT_NONE, WT_REJECT_ARGS_OOB or
+ * WT_REJECT_MISSING. act must be below m->actuator_count.
+ */
+uint32_t channel_check(const struct channel_map *m,
+		       const struct channel_readings *r, uint32_t act, int on);
+
+#endif /* CHANNELS_H */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tee_internal_api.h>
+
+#include "event_log.h"
+
+uint32_t wt_log_level = CFG_WT_LOG_LEVEL;
+
+static struct wt_event events[EVENT_LOG_SIZE];
+static uint32_t next_seq;	/* seq of the next event recorded */
+static uint32_t read_seq;	/* seq of the oldest unread event */
+
+void event_log_init(void)
+{
+	TEE_MemFill(events, 0, sizeof(events));
+	next_seq = 0;
+	read_seq = 0;
+	wt_log_level = CFG_WT_LOG_LEVEL;
+}
+
+void event_log_record(uint32_t tank, uint32_t cmd, const uint32_t in[4],
+		      uint32_t reject, uint32_t state)
+{
+	struct wt_event *ev = &events[next_seq % EVENT_LOG_SIZE];
+	TEE_Time t;
+	int k;
+
+	TEE_GetSystemTime(&t);
+	ev->timestamp = (uint64_t)t.seconds * 1000 + t.millis;
+	ev->seq = next_seq++;
+	ev->tank = tank;
+	ev->cmd = cmd;
+	for (k = 0; k < 4; k++)
+		ev->in[k] = in[k];
+	ev->reject = reject;
+	ev->state = state;
+	ev->reserved = 0;
+}
+
+uint32_t event_log_read(struct wt_event *out, uint32_t max, uint32_t *lost)
+{
+	uint32_t n = 0;
+
+	*lost = 0;
+	if (next_seq - read_seq > EVENT_LOG_SIZE) {
+		*lost = next_seq - read_seq - EVENT_LOG_SIZE;
+		read_seq = next_seq - EVENT_LOG_SIZE;
+	}
+
+	while (read_seq != next_seq && n < max) {
+		TEE_MemMove(out + n, &events[read_seq % EVENT_LOG_SIZE],
+			    sizeof(*out));
+		read_seq++;
+		n++;
+	}
+
+	return n;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+
+#include <water_treatment_ta.h>
+
+/* Events kept before the oldest unread one is overwritten */
+#define EVENT_LOG_SIZE		64
+
+#ifndef CFG_WT_LOG_LEVEL
+#define CFG_WT_LOG_LEVEL	WT_LOG_ALERTS
+#endif
+
+/* Current WT_LOG_* level, changed with TA_WATER_TREATMENT_CMD_SET_LOG_LEVEL */
+extern uint32_t wt_log_level;
+
+/* Empties the log and restores the default level */
+void event_log_init(void);
+
+void event_log_record(uint32_t tank, uint32_t cmd, const uint32_t in[4],
+		      uint32_t reject, uint32_t state);
+
+/*
+ * Copies up to max unread events into out, oldest first, and returns how
+ * many. *lost receives the events overwritten since the previous read.
+ */
+uint32_t event_log_read(struct wt_event *out, uint32_t max, uint32_t *lost);
+
+#endif /* EVENT_LOG_H */
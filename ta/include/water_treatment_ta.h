@@ -27,6 +27,7 @@
 #ifndef TA_WATER_TREATMENT_H
 #define TA_WATER_TREATMENT_H
 
+#include <stdint.h>
 
 /*
  * This UUID is generated with uuidgen
@@ -36,10 +37,374 @@
 	{ 0xe0e7e408, 0x1f32, 0x4e7d, \
 		{ 0xac, 0x68, 0x94, 0xc4, 0x4d, 0x89, 0x93, 0x99} }
 
+/*
+ * Sessions are opened either with no parameters, for tank 0, or with
+ * params[0] TEEC_VALUE_INPUT carrying the tank ID in value.a. Sessions
+ * for the same tank share its valve state.
+ *
+ * A host that knows the packed pump command encoding below adds params[1]
+ * TEEC_VALUE_INOUT, value.a the highest WT_PARAMS_* version it speaks.
+ * The TA answers in value.a with the version the session uses. A TA
+ * predating this refuses such an open with TEE_ERROR_BAD_PARAMETERS and
+ * the host opens again without params[1], the session then uses
+ * WT_PARAMS_LEGACY.
+ *
+ * Either may be followed by params[2] TEEC_VALUE_INPUT, WT_SESSION_* flags
+ * in value.a, with params[1] then TEEC_VALUE_INOUT as above. A TA that
+ * does not know the flags refuses the open with TEE_ERROR_BAD_PARAMETERS;
+ * the host must not open again without them.
+ *
+ * One TA instance keeps state for at most WT_MAX_TANKS tanks at once, what
+ * its heap is sized for. An open for one tank more fails with
+ * TEE_ERROR_OUT_OF_MEMORY.
+ */
+#define WT_MAX_TANKS		1024
+
+/*
+ * The tank only takes readings signed by its sensor: while a session
+ * opened with this is open, every session of the tank has the pump
+ * commands, EVALUATE_BATCH, DRAIN, CONTROL, DOSE, ACTUATE and a PH_CHECK
+ * with flags set refused with TEE_ERROR_ACCESS_DENIED, whether it asked
+ * for this or not. Closing the last such session lifts it. AUTH_BATCH then records each sample it
+ * accepts and applies the pump rules that hold for it, in order, as
+ * CONTROL would.
+ */
+#define WT_SESSION_SIGNED_ONLY	(1u << 0)
+#define WT_SESSION_FLAGS	WT_SESSION_SIGNED_ONLY
+
+/*
+ * The pump commands take the temperature, pH, acid flow and sodium
+ * hydroxide flow in params[0..3].value.a, all TEEC_VALUE_INOUT. Besides
+ * the verdict they return the TA's state epoch in params[0].value.b: it
+ * changes whenever any valve moves, so while it stays the same the same
+ * command with the same readings gets the same answer.
+ *
+ * That is WT_PARAMS_LEGACY. Sessions that negotiated WT_PARAMS_PACKED may
+ * instead pack a command into params[0..1], both TEEC_VALUE_INOUT, and
+ * leave params[2..3] TEEC_NONE:
+ * [in]  params[0].value.a: temperature (int16_t) | pH << 16 | version << 24
+ *       params[0].value.b: acid flow | sodium hydroxide flow << 8
+ *       params[1].value.a: sequence number, value.b: tank ID of the session
+ * [out] params[0].value.a: WT_REJECT_*, value.b: state epoch
+ *       params[1].value.a: sequence number, value.b: valve state after
+ * Readings that do not fit their field are sent saturated, which keeps
+ * them past the device limits.
+ */
+#define WT_PARAMS_LEGACY	0
+#define WT_PARAMS_PACKED	1
+#define WT_PARAMS_VERSION	WT_PARAMS_PACKED	/* highest known */
+
+#define WT_PACK_READINGS(temp, ph, version) \
+	((uint32_t)(uint16_t)(temp) | (uint32_t)(ph) << 16 | \
+	 (uint32_t)(version) << 24)
+#define WT_PACK_FLOWS(acid, sod_hydrox) \
+	((uint32_t)(acid) | (uint32_t)(sod_hydrox) << 8)
+
+#define WT_PACKED_TEMP(a)		((int32_t)(int16_t)((a) & 0xffff))
+#define WT_PACKED_PH(a)			(((a) >> 16) & 0xff)
+#define WT_PACKED_VERSION(a)		((a) >> 24)
+#define WT_PACKED_ACID_FLOW(b)		((b) & 0xff)
+#define WT_PACKED_SOD_HYDROX_FLOW(b)	(((b) >> 8) & 0xff)
+
 /* The function IDs implemented in this TA */
 #define TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON	0
 #define TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF	1
 #define TA_WATER_TREATMENT_CMD_ACID_ON	2
 #define TA_WATER_TREATMENT_CMD_ACID_OFF	3
+/* No parameters, no side effects: used by the host to health-check sessions */
+#define TA_WATER_TREATMENT_CMD_PING	4
+/*
+ * Runs the pump rules over many samples in one invoke, no pump state
+ * is changed.
+ * [in]  params[0].memref: struct wt_sample[n]
+ * [out] params[1].memref: struct wt_decision[n]
+ * [out] params[2].value.a: samples evaluated
+ * [out] params[2].value.b: samples rejected for device limits
+ */
+#define TA_WATER_TREATMENT_CMD_EVALUATE_BATCH	5
+/*
+ * Evaluates every sample the host pushed into a shared struct wt_ring
+ * since the last drain and writes the decisions back into the ring.
+ * [inout] params[0].memref: the ring, registered as shared memory
+ * [out]   params[1].value.a: samples drained
+ * [out]   params[1].value.b: samples rejected for device limits
+ */
+#define TA_WATER_TREATMENT_CMD_DRAIN	6
+/*
+ * Moves events out of the TA's event ring, oldest first.
+ * [out] params[0].memref: struct wt_event[]
+ * [out] params[1].value.a: events copied
+ * [out] params[1].value.b: events overwritten before they could be read
+ */
+#define TA_WATER_TREATMENT_CMD_READ_EVENTS	7
+/*
+ * [in]  params[0].value.a: WT_LOG_* level of the secure log
+ * [out] params[1].value.a: previous level
+ */
+#define TA_WATER_TREATMENT_CMD_SET_LOG_LEVEL	8
+/*
+ * Copies the TA's per command counters and timings.
+ * [out] params[0].memref: struct wt_stats
+ */
+#define TA_WATER_TREATMENT_CMD_GET_STATS	9
+/*
+ * Decides both valves of the session's tank from one set of readings:
+ * every pump rule that holds is applied, in the same invoke.
+ * [in]  params[0].value.a: temperature, value.b: pH
+ * [in]  params[1].value.a: acid flow, value.b: sodium hydroxide flow
+ * [out] params[2].value.a: sodium hydroxide valve, value.b: acid valve
+ * [out] params[3].value.a: WT_CONTROL_*, value.b: WT_ACTION() bits applied
+ */
+#define TA_WATER_TREATMENT_CMD_CONTROL		10
+/*
+ * Summarises the pH readings of the session's tank over the TA's sliding
+ * window: every in-limits reading CONTROL, DOSE or a batch saw, plus the
+ * ones added here. The pump commands only act on a reading, they leave it
+ * to this command to say which ones belong in the window.
+ * pH values below are in milli-pH.
+ * [inout] params[0]: in  value.a: pH reading, value.b: WT_PH_CHECK_* flags
+ *                    out value.a: WT_PH_* flags, value.b: rate of change
+ *                                 per reading (int32_t)
+ * [out]   params[1].value.a: mean, value.b: variance (milli-pH squared)
+ * [out]   params[2].value.a: min, value.b: max
+ * [out]   params[3].value.a: readings in the window, value.b: latest
+ */
+#define TA_WATER_TREATMENT_CMD_PH_CHECK		11
+/*
+ * Runs the tank's PI dosing loop on one reading and sets both valves to
+ * its flow setpoints, 0 (closed) up to 10. Only one valve is ever open.
+ * [in]  params[0].value.a: temperature, value.b: pH in milli-pH
+ * [out] params[1].value.a: sodium hydroxide flow, value.b: acid flow
+ * [out] params[2].value.a: WT_CONTROL_*, ACTED if a setpoint changed
+ * [out] params[2].value.b: controller demand, milli flow units (int32_t),
+ *                          positive for sodium hydroxide
+ */
+#define TA_WATER_TREATMENT_CMD_DOSE		12
+/*
+ * EVALUATE_BATCH for samples signed by the sensor. The batch is only
+ * evaluated if its MAC is right and its seq is above the last one the
+ * tank accepted, otherwise the command fails with TEE_ERROR_SECURITY.
+ * [in]  params[0].memref: struct wt_auth_batch and its samples
+ * [out] params[1].memref: struct wt_decision[count]
+ * [out] params[2].value.a: samples evaluated
+ * [out] params[2].value.b: samples rejected for device limits
+ */
+#define TA_WATER_TREATMENT_CMD_AUTH_BATCH	13
+/*
+ * Switches any actuator of the plant's channel table on or off, if every
+ * condition its descriptor sets for that holds. The readings only need
+ * to cover the sensors those conditions look at.
+ * [in]  params[0].value.a: WT_ACT_* actuator, value.b: 1 on, 0 off
+ * [in]  params[1].memref: struct wt_reading[], up to WT_ACT_READINGS_MAX
+ * [out] params[2].value.a: WT_REJECT_*, value.b: state epoch
+ * [out] params[3].value.a: bits 0-31, value.b: bits 32-63 of the tank's
+ *                          actuator bitmask word holding the actuator
+ */
+#define TA_WATER_TREATMENT_CMD_ACTUATE		14
+/*
+ * Copies the plant's channel table.
+ * [out] params[0].memref: struct wt_sensor_info[], indexed by WT_SENSOR_*
+ * [out] params[1].memref: struct wt_actuator_info[], indexed by WT_ACT_*
+ * [out] params[2].value.a: sensors, value.b: actuators
+ */
+#define TA_WATER_TREATMENT_CMD_DESCRIBE		15
+
+/*
+ * Phase tracing: a command that leaves params[3] TEEC_NONE may pass it
+ * as TEEC_VALUE_OUTPUT instead, every command but CONTROL, PH_CHECK,
+ * ACTUATE and the legacy pump encoding. The TA then returns the low 32
+ * bits of TEE_GetSystemTime() in milliseconds at entry in value.a and
+ * at exit in value.b.
+ */
+#define WT_TRACE_PARAM		3
+
+/* One packed sensor record, laid out the same on both sides */
+struct wt_sample {
+	int32_t temp;
+	int32_t ph;
+	int32_t acid_flow;
+	int32_t sod_hydrox_flow;
+	uint64_t timestamp;
+};
+
+/*
+ * A batch of samples as signed by a sensor: mac is HMAC-SHA256 over seq,
+ * tank and count as laid out here followed by the samples. Each batch's
+ * seq must be above the last one accepted for its tank ID, which the TA
+ * keeps for as long as its instance lives, sessions or not. It holds
+ * WT_MAX_TANKS of them; authenticating yet another tank ID fails with
+ * TEE_ERROR_OUT_OF_MEMORY rather than forget one.
+ */
+#define WT_AUTH_MAC_SIZE	32
+#define WT_AUTH_MAX_SAMPLES	1024
+
+struct wt_auth_batch {
+	uint64_t seq;
+	uint32_t tank;
+	uint32_t count;
+	uint8_t mac[WT_AUTH_MAC_SIZE];
+	struct wt_sample samples[];
+};
+
+#define WT_AUTH_BATCH_BYTES(count) \
+	(sizeof(struct wt_auth_batch) + (count) * sizeof(struct wt_sample))
+
+/*
+ * Key the demo sensors sign with. A real deployment would provision a
+ * key per sensor into the TA's secure storage instead.
+ */
+#define WT_AUTH_DEMO_KEY	"water treatment demo sensor key!"
+#define WT_AUTH_DEMO_KEY_SIZE	32
+
+#define WT_VERDICT_OK			0
+#define WT_VERDICT_DEVICE_LIMITS	1
+
+/* Bit set in wt_decision.actions when the rule of command cmd holds */
+#define WT_ACTION(cmd)			(1u << (cmd))
+
+struct wt_decision {
+	uint64_t timestamp;	/* copied from the sample */
+	uint32_t verdict;	/* WT_VERDICT_* */
+	uint32_t actions;	/* WT_ACTION() bits */
+};
+
+/*
+ * Single-producer/single-consumer ring in shared memory. head and tail
+ * are free running, a slot is index & (size - 1). The header is followed
+ * by struct wt_sample samples[size] and then struct wt_decision
+ * decisions[size], decisions[i] answers samples[i].
+ */
+struct wt_ring {
+	uint32_t head;		/* next slot the host fills, written by the host */
+	uint32_t tail;		/* next slot to evaluate, written by the TA */
+	uint32_t size;		/* slot count, a power of two */
+	uint32_t reserved;
+};
+
+/*
+ * Channels of the plant. Sensors and actuators are numbered densely from
+ * 0, the pump commands above only know the first four sensors and the
+ * first two actuators.
+ */
+#define WT_SENSOR_TEMP			0
+#define WT_SENSOR_PH			1
+#define WT_SENSOR_ACID_FLOW		2
+#define WT_SENSOR_SOD_HYDROX_FLOW	3
+#define WT_SENSOR_CHLORINE		4	/* residual, 0.01 mg/L */
+#define WT_SENSOR_TURBIDITY		5	/* 0.1 NTU */
+#define WT_SENSOR_INFLOW		6	/* litres per minute */
+#define WT_SENSOR_CHLORINE_FLOW		7	/* chlorine doser, 0 - 10 */
+#define WT_SENSOR_COAGULANT_FLOW	8	/* coagulant pump, 0 - 10 */
+
+#define WT_ACT_SOD_HYDROX		0
+#define WT_ACT_ACID			1
+#define WT_ACT_CHLORINE			2
+#define WT_ACT_COAGULANT		3
+
+/* Most channels a channel table can have, of each kind */
+#define WT_SENSORS_MAX			128
+#define WT_ACTUATORS_MAX		128
+
+/* Conditions per actuator and direction */
+#define WT_ACT_TERMS			4
+
+/* Most readings one TA_WATER_TREATMENT_CMD_ACTUATE takes */
+#define WT_ACT_READINGS_MAX		16
+
+struct wt_reading {
+	uint32_t sensor;	/* WT_SENSOR_* */
+	int32_t value;
+};
+
+struct wt_sensor_info {
+	int32_t min;		/* device limits, inclusive */
+	int32_t max;
+};
+
+struct wt_actuator_info {
+	uint8_t on_sensors[WT_ACT_TERMS];	/* sensors switching on reads */
+	uint8_t off_sensors[WT_ACT_TERMS];	/* and switching off */
+	uint32_t on_terms;			/* entries used in on_sensors */
+	uint32_t off_terms;
+};
+
+/* What the TA still writes to the secure log, events are always recorded */
+#define WT_LOG_NONE		0
+#define WT_LOG_ALERTS		1	/* TAI alert banners on rejected commands */
+#define WT_LOG_VERBOSE		2	/* plus every command's inputs and result */
+
+/* Why a pump command took no action */
+#define WT_REJECT_NONE		0
+#define WT_REJECT_DEVICE_LIMITS	1
+#define WT_REJECT_ARGS_OOB	2
+#define WT_REJECT_MISSING	3	/* a reading the rule needs was not sent */
+
+/* Why TA_WATER_TREATMENT_CMD_CONTROL left the valves as they are */
+#define WT_CONTROL_ACTED		0	/* at least one rule applied */
+#define WT_CONTROL_HOLD			1	/* readings fine, no rule holds */
+#define WT_CONTROL_DEVICE_LIMITS	2	/* readings past the device limits */
+
+/* pH the backward edge check accepts, inclusive */
+#define WT_PH_SAFE_MIN			6
+#define WT_PH_SAFE_MAX			8
+
+/* What TA_WATER_TREATMENT_CMD_PH_CHECK does before judging the window */
+#define WT_PH_CHECK_RECORD		(1u << 0)	/* add the reading */
+#define WT_PH_CHECK_RESET		(1u << 1)	/* empty it first */
+
+/* Backward edge failures TA_WATER_TREATMENT_CMD_PH_CHECK reports */
+#define WT_PH_UNSAFE			(1u << 0)	/* latest reading */
+#define WT_PH_MEAN_UNSAFE		(1u << 1)	/* window mean */
+#define WT_PH_DRIFTING			(1u << 2)	/* moving away from 7 fast */
+#define WT_PH_UNSTABLE			(1u << 3)	/* swinging more than 1 pH */
+
+/* One pump command as recorded by the TA */
+struct wt_event {
+	uint64_t timestamp;	/* TEE_GetSystemTime(), milliseconds */
+	uint32_t seq;		/* increases by one per event */
+	uint32_t tank;		/* tank ID of the session */
+	uint32_t cmd;
+	int32_t in[4];		/* readings as received in params[0..3],
+				   for ACTUATE actuator, on, reading count */
+	uint32_t reject;	/* WT_REJECT_* */
+	uint32_t state;		/* valve state after the command, for
+				   CONTROL sodium hydroxide | acid << 1,
+				   for DOSE the two flows, acid << 8 */
+	uint32_t reserved;
+};
+
+/* Command IDs below this have their own struct wt_cmd_stats */
+#define WT_STATS_CMDS		16
+
+/*
+ * Time spent inside the TA per invoke, TEE_GetSystemTime() resolution
+ * (milliseconds). Bucket 0 counts invokes under 1 ms, bucket k invokes
+ * of 2^(k-1) up to 2^k - 1 ms, the last bucket also everything longer.
+ */
+#define WT_STATS_BUCKETS	16
+
+/*
+ * Pump commands count invokes. EVALUATE_BATCH and DRAIN count samples in
+ * accepted and device_limits and invokes in the rest.
+ */
+struct wt_cmd_stats {
+	uint64_t accepted;	/* completed, action taken or sample in limits */
+	uint64_t device_limits;	/* rejected, readings past the device limits */
+	uint64_t args_oob;	/* rejected, readings outside the command's rule */
+	uint64_t bad_params;	/* failed with TEE_ERROR_BAD_PARAMETERS */
+	uint64_t errors;	/* failed any other way */
+	uint64_t time_ms[WT_STATS_BUCKETS];
+};
+
+struct wt_stats {
+	uint64_t uptime_ms;	/* since the TA instance was created */
+	uint32_t cmds;		/* WT_STATS_CMDS */
+	uint32_t buckets;	/* WT_STATS_BUCKETS */
+	struct wt_cmd_stats cmd[WT_STATS_CMDS];
+};
+
+#define WT_RING_BYTES(size) \
+	(sizeof(struct wt_ring) + \
+	 (size) * (sizeof(struct wt_sample) + sizeof(struct wt_decision)))
 
 #endif /*TA_WATER_TREATMENT_H*/
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ph_dosing.h"
+#include "pump_rules.h"
+
+#define DOSE_MAX	(PUMP_FLOW_MAX * 1000)	/* milli flow units */
+
+static int32_t clamp(int32_t v, int32_t lo, int32_t hi)
+{
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+void ph_dosing_step(struct ph_dosing *d, int32_t milli_ph,
+		    uint32_t *sod_hydrox, uint32_t *acid)
+{
+	int32_t err = DOSE_SETPOINT - clamp(milli_ph, 0, 14000);
+	int32_t integral = d->integral + err;
+	int32_t u;
+	int32_t dist;
+	int32_t flow;
+
+	if (err <= CFG_WT_DOSE_DEADBAND && err >= -CFG_WT_DOSE_DEADBAND) {
+		u = (CFG_WT_DOSE_KP_Q8 * err +
+		     CFG_WT_DOSE_KI_Q8 * d->integral) / 256;
+		d->demand = clamp(u, -DOSE_MAX, DOSE_MAX);
+		goto out;
+	}
+
+	/* |err| <= 7000, so neither product gets near overflowing */
+	integral = clamp(integral, -DOSE_MAX * 256 / CFG_WT_DOSE_KI_Q8,
+			 DOSE_MAX * 256 / CFG_WT_DOSE_KI_Q8);
+	u = (CFG_WT_DOSE_KP_Q8 * err + CFG_WT_DOSE_KI_Q8 * integral) / 256;
+
+	/* Only integrate when that does not push further into saturation */
+	if ((u > DOSE_MAX && err > 0) || (u < -DOSE_MAX && err < 0))
+		u = (CFG_WT_DOSE_KP_Q8 * err +
+		     CFG_WT_DOSE_KI_Q8 * d->integral) / 256;
+	else
+		d->integral = integral;
+
+	d->demand = clamp(u, -DOSE_MAX, DOSE_MAX);
+
+	/* Round to the valve's whole flow steps, with some hysteresis */
+	dist = d->demand - d->flow * 1000;
+	if (dist > 500 + CFG_WT_DOSE_HYSTERESIS ||
+	    dist < -500 - CFG_WT_DOSE_HYSTERESIS) {
+		flow = (d->demand + (d->demand < 0 ? -500 : 500)) / 1000;
+		/* Acid straight after sodium hydroxide would only waste both */
+		if ((flow < 0 && d->flow > 0) || (flow > 0 && d->flow < 0))
+			flow = 0;
+		d->flow = flow;
+	}
+
+out:
+	*sod_hydrox = d->flow > 0 ? d->flow : 0;
+	*acid = d->flow < 0 ? -d->flow : 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PH_DOSING_H
+#define PH_DOSING_H
+
+#include <stdint.h>
+
+/* pH the dosing loop steers to, milli-pH */
+#define DOSE_SETPOINT		7000
+
+/*
+ * Gains in Q8, flow units per pH: the proportional term gives
+ * KP/256 flow per pH of error, the integral term KI/256 flow per pH of
+ * error accumulated over one tick.
+ */
+#ifndef CFG_WT_DOSE_KP_Q8
+#define CFG_WT_DOSE_KP_Q8	640	/* 2.5 */
+#endif
+#ifndef CFG_WT_DOSE_KI_Q8
+#define CFG_WT_DOSE_KI_Q8	64	/* 0.25 */
+#endif
+
+/*
+ * How far past the halfway point between two flow steps the demand has
+ * to get before the setpoint moves, milli flow units. Keeps a demand that
+ * sits near a step from toggling the valve every tick.
+ */
+#ifndef CFG_WT_DOSE_HYSTERESIS
+#define CFG_WT_DOSE_HYSTERESIS	500
+#endif
+
+/*
+ * Readings within this of the setpoint, milli-pH, leave the valves and
+ * the integral as they are. Holding 7 exactly takes a fractional flow,
+ * which whole flow steps can only give by switching the valve every few
+ * ticks; with the deadband the pH cycles slowly across it instead.
+ */
+#ifndef CFG_WT_DOSE_DEADBAND
+#define CFG_WT_DOSE_DEADBAND	300
+#endif
+
+/*
+ * Fixed-point PI controller for one tank. A positive demand doses sodium
+ * hydroxide, a negative one acid, so only one valve is ever open.
+ */
+struct ph_dosing {
+	int32_t integral;	/* sum of errors, milli-pH ticks */
+	int32_t demand;		/* last output, milli flow units, signed */
+	int32_t flow;		/* current setpoint, same sign convention */
+};
+
+/*
+ * One control tick for a pH reading in milli-pH (0..14000). Returns the
+ * flow setpoints, 0..PUMP_FLOW_MAX each. The integral stops growing while
+ * the output is saturated in the direction of the error (anti-windup).
+ * An open valve is closed before the other one opens, a tick later.
+ */
+void ph_dosing_step(struct ph_dosing *d, int32_t milli_ph,
+		    uint32_t *sod_hydrox, uint32_t *acid);
+
+#endif /* PH_DOSING_H */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <water_treatment_ta.h>
+
+#include "ph_window.h"
+
+#define PH_MASK		(CFG_WT_PH_WINDOW - 1)
+
+/* Moving this fast away from neutral is a trend worth flagging */
+#define PH_DRIFT_RATE		500	/* milli-pH per reading */
+/* Standard deviation above 1 pH */
+#define PH_UNSTABLE_VARIANCE	1000000
+#define PH_UNSTABLE_MIN_COUNT	4
+
+void ph_window_add(struct ph_window *w, int32_t milli_ph)
+{
+	uint32_t seq = w->seq;
+	int32_t old;
+
+	if (seq >= CFG_WT_PH_WINDOW) {
+		/* Retire the reading whose slot this one takes */
+		old = w->v[seq & PH_MASK];
+		w->sum -= old;
+		w->sumsq -= (int64_t)old * old;
+		if (w->min_head != w->min_tail &&
+		    w->minq[w->min_head & PH_MASK] == seq - CFG_WT_PH_WINDOW)
+			w->min_head++;
+		if (w->max_head != w->max_tail &&
+		    w->maxq[w->max_head & PH_MASK] == seq - CFG_WT_PH_WINDOW)
+			w->max_head++;
+	}
+
+	w->v[seq & PH_MASK] = milli_ph;
+	w->sum += milli_ph;
+	w->sumsq += (int64_t)milli_ph * milli_ph;
+
+	while (w->min_tail != w->min_head &&
+	       w->v[w->minq[(w->min_tail - 1) & PH_MASK] & PH_MASK] >= milli_ph)
+		w->min_tail--;
+	w->minq[w->min_tail++ & PH_MASK] = seq;
+
+	while (w->max_tail != w->max_head &&
+	       w->v[w->maxq[(w->max_tail - 1) & PH_MASK] & PH_MASK] <= milli_ph)
+		w->max_tail--;
+	w->maxq[w->max_tail++ & PH_MASK] = seq;
+
+	w->seq = seq + 1;
+}
+
+void ph_window_reset(struct ph_window *w)
+{
+	w->seq = 0;
+	w->sum = 0;
+	w->sumsq = 0;
+	w->min_head = w->min_tail = 0;
+	w->max_head = w->max_tail = 0;
+}
+
+static int ph_safe(int32_t milli_ph)
+{
+	return milli_ph >= WT_PH_SAFE_MIN * 1000 &&
+	       milli_ph <= WT_PH_SAFE_MAX * 1000;
+}
+
+void ph_window_summary(const struct ph_window *w, struct ph_summary *s)
+{
+	uint32_t n = w->seq < CFG_WT_PH_WINDOW ? w->seq : CFG_WT_PH_WINDOW;
+	int32_t oldest;
+
+	s->count = n;
+	s->flags = 0;
+	if (!n) {
+		s->latest = s->mean = s->min = s->max = s->rate = 0;
+		s->variance = 0;
+		return;
+	}
+
+	s->latest = w->v[(w->seq - 1) & PH_MASK];
+	oldest = w->v[(w->seq - n) & PH_MASK];
+	s->mean = w->sum / n;
+	s->variance = (n * w->sumsq - w->sum * w->sum) / ((int64_t)n * n);
+	s->min = w->v[w->minq[w->min_head & PH_MASK] & PH_MASK];
+	s->max = w->v[w->maxq[w->max_head & PH_MASK] & PH_MASK];
+	s->rate = n > 1 ? (s->latest - oldest) / (int32_t)(n - 1) : 0;
+
+	if (!ph_safe(s->latest))
+		s->flags |= WT_PH_UNSAFE;
+	if (!ph_safe(s->mean))
+		s->flags |= WT_PH_MEAN_UNSAFE;
+	/* Heading away from neutral, whether or not it is there yet */
+	if ((s->rate >= PH_DRIFT_RATE && s->latest > 7000) ||
+	    (s->rate <= -PH_DRIFT_RATE && s->latest < 7000))
+		s->flags |= WT_PH_DRIFTING;
+	if (n >= PH_UNSTABLE_MIN_COUNT && s->variance > PH_UNSTABLE_VARIANCE)
+		s->flags |= WT_PH_UNSTABLE;
+}
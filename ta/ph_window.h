@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PH_WINDOW_H
+#define PH_WINDOW_H
+
+#include <stdint.h>
+
+/* Readings kept per tank, a power of two */
+#ifndef CFG_WT_PH_WINDOW
+#define CFG_WT_PH_WINDOW	32
+#endif
+
+/*
+ * The last CFG_WT_PH_WINDOW pH readings of a tank in milli-pH. Sums give
+ * mean and variance, and two monotonic queues of reading numbers give
+ * min and max, so adding a reading costs O(1) (amortized for min/max)
+ * whatever the window size.
+ */
+struct ph_window {
+	int32_t v[CFG_WT_PH_WINDOW];
+	uint32_t seq;			/* readings added so far */
+	int64_t sum;
+	int64_t sumsq;
+	uint32_t minq[CFG_WT_PH_WINDOW];	/* increasing values */
+	uint32_t maxq[CFG_WT_PH_WINDOW];	/* decreasing values */
+	uint32_t min_head, min_tail;
+	uint32_t max_head, max_tail;
+};
+
+struct ph_summary {
+	uint32_t count;
+	int32_t latest;
+	int32_t mean;
+	uint32_t variance;	/* milli-pH squared */
+	int32_t min;
+	int32_t max;
+	int32_t rate;		/* milli-pH per reading across the window */
+	uint32_t flags;		/* WT_PH_* */
+};
+
+void ph_window_add(struct ph_window *w, int32_t milli_ph);
+/* Forgets every reading, as a window that never had one */
+void ph_window_reset(struct ph_window *w);
+void ph_window_summary(const struct ph_window *w, struct ph_summary *s);
+
+#endif /* PH_WINDOW_H */
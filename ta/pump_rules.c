@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <water_treatment_ta.h>
+
+#include "pump_rules.h"
+
+/* Device physical boundaries (min / max), set at compile time */
+static const struct pump_range dev_limits[PUMP_INPUTS] = {
+	[PUMP_IN_TEMP]			= PUMP_RANGE(-40, 160),
+	[PUMP_IN_PH]			= PUMP_RANGE(0, 14),
+	[PUMP_IN_ACID_FLOW]		= PUMP_RANGE(0, PUMP_FLOW_MAX),
+	[PUMP_IN_SOD_HYDROX_FLOW]	= PUMP_RANGE(0, PUMP_FLOW_MAX),
+};
+
+/*
+ * When each command may act. Readings are compared as the unsigned values
+ * received from the REE, so "temp > 40" is [41, UINT32_MAX].
+ */
+const struct pump_rule pump_rules[] = {
+	{
+		.cmd = TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON,
+		.in = {
+			[PUMP_IN_TEMP]			= PUMP_RANGE(41, UINT32_MAX),
+			[PUMP_IN_PH]			= PUMP_RANGE(0, 4),
+			[PUMP_IN_ACID_FLOW]		= PUMP_RANGE(0, 0),
+			[PUMP_IN_SOD_HYDROX_FLOW]	= PUMP_RANGE(0, 0),
+		},
+		.valve = PUMP_VALVE_SOD_HYDROX,
+		.state = 1,
+		.out_param = PUMP_IN_SOD_HYDROX_FLOW,
+	},
+	{
+		.cmd = TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF,
+		.in = {
+			[PUMP_IN_TEMP]			= PUMP_ANY,
+			[PUMP_IN_PH]			= PUMP_RANGE(6, UINT32_MAX),
+			[PUMP_IN_ACID_FLOW]		= PUMP_ANY,
+			[PUMP_IN_SOD_HYDROX_FLOW]	= PUMP_RANGE(1, UINT32_MAX),
+		},
+		.valve = PUMP_VALVE_SOD_HYDROX,
+		.state = 0,
+		.out_param = PUMP_IN_SOD_HYDROX_FLOW,
+	},
+	{
+		.cmd = TA_WATER_TREATMENT_CMD_ACID_ON,
+		.in = {
+			[PUMP_IN_TEMP]			= PUMP_RANGE(0, 89),
+			[PUMP_IN_PH]			= PUMP_RANGE(10, UINT32_MAX),
+			[PUMP_IN_ACID_FLOW]		= PUMP_RANGE(0, 0),
+			[PUMP_IN_SOD_HYDROX_FLOW]	= PUMP_RANGE(0, 0),
+		},
+		.valve = PUMP_VALVE_ACID,
+		.state = 1,
+		.out_param = PUMP_IN_ACID_FLOW,
+	},
+	{
+		.cmd = TA_WATER_TREATMENT_CMD_ACID_OFF,
+		.in = {
+			[PUMP_IN_TEMP]			= PUMP_ANY,
+			[PUMP_IN_PH]			= PUMP_RANGE(0, 8),
+			[PUMP_IN_ACID_FLOW]		= PUMP_RANGE(1, UINT32_MAX),
+			[PUMP_IN_SOD_HYDROX_FLOW]	= PUMP_ANY,
+		},
+		.valve = PUMP_VALVE_ACID,
+		.state = 0,
+		.out_param = PUMP_IN_ACID_FLOW,
+	},
+};
+
+const size_t pump_rule_count = sizeof(pump_rules) / sizeof(pump_rules[0]);
+
+const struct pump_rule *pump_rule_find(uint32_t cmd)
+{
+	size_t r;
+
+	for (r = 0; r < pump_rule_count; r++)
+		if (pump_rules[r].cmd == cmd)
+			return &pump_rules[r];
+	return NULL;
+}
+
+static inline uint32_t in_ranges(const struct pump_range *range,
+				 const uint32_t in[PUMP_INPUTS])
+{
+	uint32_t ok = 1;
+	int k;
+
+	for (k = 0; k < PUMP_INPUTS; k++)
+		ok &= (in[k] - range[k].lo) <= range[k].span;
+	return ok;
+}
+
+uint32_t pump_in_bounds(const uint32_t in[PUMP_INPUTS])
+{
+	return in_ranges(dev_limits, in);
+}
+
+uint32_t pump_rules_eval(const uint32_t in[PUMP_INPUTS])
+{
+	uint32_t mask = 0;
+	size_t r;
+
+	for (r = 0; r < pump_rule_count; r++)
+		mask |= in_ranges(pump_rules[r].in, in) << pump_rules[r].cmd;
+	return mask;
+}
+
+void pump_rules_eval_many(const uint32_t (*in)[PUMP_INPUTS], size_t n,
+			  uint32_t *bounds, uint32_t *masks)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		bounds[i] = pump_in_bounds(in[i]);
+		/* Out of bounds clears the mask without a branch */
+		masks[i] = pump_rules_eval(in[i]) & -bounds[i];
+	}
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef PUMP_RULES_H
+#define PUMP_RULES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Readings in the order the host sends them in params[0..3] */
+enum pump_input {
+	PUMP_IN_TEMP,
+	PUMP_IN_PH,
+	PUMP_IN_ACID_FLOW,
+	PUMP_IN_SOD_HYDROX_FLOW,
+	PUMP_INPUTS
+};
+
+/* Largest flow either valve can be set to */
+#define PUMP_FLOW_MAX		10
+
+enum pump_valve {
+	PUMP_VALVE_SOD_HYDROX,
+	PUMP_VALVE_ACID,
+	PUMP_VALVES
+};
+
+/*
+ * A reading v is inside [lo, lo + span] when (uint32_t)(v - lo) <= span.
+ * That one compare covers both ends of the range, and works the same for
+ * signed limits such as temp_dev_min once both are taken modulo 2^32.
+ */
+struct pump_range {
+	uint32_t lo;
+	uint32_t span;
+};
+
+#define PUMP_RANGE(lo, hi)	{ (uint32_t)(lo), (uint32_t)(hi) - (uint32_t)(lo) }
+#define PUMP_ANY		PUMP_RANGE(0, UINT32_MAX)
+
+/* Command cmd may act when every reading is inside its range */
+struct pump_rule {
+	uint32_t cmd;
+	struct pump_range in[PUMP_INPUTS];
+	enum pump_valve valve;	/* valve the command drives */
+	int state;		/* and the state it drives it to */
+	uint32_t out_param;	/* param slot that reports the new state */
+};
+
+extern const struct pump_rule pump_rules[];
+extern const size_t pump_rule_count;
+
+/* Looks up the rule for a command, NULL if there is none */
+const struct pump_rule *pump_rule_find(uint32_t cmd);
+
+/* 1 when every reading is within the device's physical limits */
+uint32_t pump_in_bounds(const uint32_t in[PUMP_INPUTS]);
+
+/* Bit (1 << rule.cmd) set for every rule whose ranges all hold */
+uint32_t pump_rules_eval(const uint32_t in[PUMP_INPUTS]);
+
+/*
+ * Same as pump_in_bounds()/pump_rules_eval() over n samples laid out as
+ * in[i][PUMP_INPUTS]. bounds[i] is 0 or 1, masks[i] is 0 when out of
+ * bounds.
+ */
+void pump_rules_eval_many(const uint32_t (*in)[PUMP_INPUTS], size_t n,
+			  uint32_t *bounds, uint32_t *masks);
+
+#endif /* PUMP_RULES_H */
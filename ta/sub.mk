@@ -1,5 +1,11 @@
 global-incdirs-y += include
 srcs-y += water_treatment_ta.c
+srcs-y += pump_rules.c
+srcs-y += event_log.c
+srcs-y += ta_stats.c
+srcs-y += ph_window.c
+srcs-y += ph_dosing.c
+srcs-y += channels.c
 
 # To remove a certain compiler flag, add a line like this
 #cflags-template_ta.c-y += -Wno-strict-prototypes
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tee_internal_api.h>
+
+#include "ta_stats.h"
+
+static struct wt_cmd_stats stats[WT_STATS_CMDS];
+static uint64_t start_ms;
+
+uint64_t ta_stats_now_ms(void)
+{
+	TEE_Time t;
+
+	TEE_GetSystemTime(&t);
+	return (uint64_t)t.seconds * 1000 + t.millis;
+}
+
+void ta_stats_init(void)
+{
+	TEE_MemFill(stats, 0, sizeof(stats));
+	start_ms = ta_stats_now_ms();
+}
+
+void ta_stats_count(uint32_t cmd, uint32_t accepted, uint32_t device_limits,
+		    uint32_t args_oob)
+{
+	if (cmd >= WT_STATS_CMDS)
+		return;
+
+	stats[cmd].accepted += accepted;
+	stats[cmd].device_limits += device_limits;
+	stats[cmd].args_oob += args_oob;
+}
+
+static uint32_t time_bucket(uint64_t ms)
+{
+	uint32_t b = 0;
+
+	while (ms && b < WT_STATS_BUCKETS - 1) {
+		ms >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void ta_stats_invoke(uint32_t cmd, TEE_Result res, uint64_t elapsed_ms)
+{
+	struct wt_cmd_stats *s;
+
+	if (cmd >= WT_STATS_CMDS)
+		return;
+	s = &stats[cmd];
+
+	if (res == TEE_ERROR_BAD_PARAMETERS)
+		s->bad_params++;
+	else if (res != TEE_SUCCESS)
+		s->errors++;
+	s->time_ms[time_bucket(elapsed_ms)]++;
+}
+
+void ta_stats_read(struct wt_stats *out)
+{
+	uint64_t uptime_ms = ta_stats_now_ms() - start_ms;
+	uint32_t n = WT_STATS_CMDS;
+	uint32_t buckets = WT_STATS_BUCKETS;
+
+	/* out may be unaligned shared memory */
+	TEE_MemMove(&out->uptime_ms, &uptime_ms, sizeof(uptime_ms));
+	TEE_MemMove(&out->cmds, &n, sizeof(n));
+	TEE_MemMove(&out->buckets, &buckets, sizeof(buckets));
+	TEE_MemMove(out->cmd, stats, sizeof(stats));
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TA_STATS_H
+#define TA_STATS_H
+
+#include <stdint.h>
+
+#include <tee_internal_api.h>
+#include <water_treatment_ta.h>
+
+/* TEE_GetSystemTime() in milliseconds */
+uint64_t ta_stats_now_ms(void);
+
+/*
+ * Clears the counters and marks the start of uptime_ms, called from
+ * TA_CreateEntryPoint()
+ */
+void ta_stats_init(void);
+
+/* Adds a command's outcome, see struct wt_cmd_stats for what is counted */
+void ta_stats_count(uint32_t cmd, uint32_t accepted, uint32_t device_limits,
+		    uint32_t args_oob);
+
+/* Records the result and duration of one invoke of cmd */
+void ta_stats_invoke(uint32_t cmd, TEE_Result res, uint64_t elapsed_ms);
+
+void ta_stats_read(struct wt_stats *out);
+
+#endif /* TA_STATS_H */
@@ -38,16 +38,36 @@
 #define TA_UUID				TA_WATER_TREATMENT_UUID
 
 /*
- * TA properties: multi-instance TA, no specific attribute
+ * TA properties. By default one instance serves every session, so one TA
+ * keeps the state of many tanks and stays loaded between them. Build with
+ * CFG_WT_SHARED_INSTANCE=0 for the original multi-instance TA, where every
+ * session gets an instance of its own.
  * TA_FLAG_EXEC_DDR is meaningless but mandated.
  */
+#ifndef CFG_WT_SHARED_INSTANCE
+#define CFG_WT_SHARED_INSTANCE		1
+#endif
+
+#if CFG_WT_SHARED_INSTANCE
+#define TA_FLAGS			(TA_FLAG_EXEC_DDR | \
+					 TA_FLAG_SINGLE_INSTANCE | \
+					 TA_FLAG_MULTI_SESSION | \
+					 TA_FLAG_INSTANCE_KEEP_ALIVE)
+#else
 #define TA_FLAGS			TA_FLAG_EXEC_DDR
+#endif
 
 /* Provisioned stack size */
 #define TA_STACK_SIZE			(2 * 1024)
 
-/* Provisioned heap size for TEE_Malloc() and friends */
-#define TA_DATA_SIZE			(32 * 1024)
+/*
+ * Provisioned heap size for TEE_Malloc() and friends. A tank takes about
+ * 600 bytes with its first session and allocator overhead, and up to
+ * WT_TANK_HEAP_SIZE once an authenticated sensor has its HMAC operation.
+ */
+#define WT_TANK_HEAP_SIZE		1024
+#define TA_DATA_SIZE			(64 * 1024 + \
+					 WT_MAX_TANKS * WT_TANK_HEAP_SIZE)
 
 /* The gpd.ta.version property */
 #define TA_VERSION	"1.0"
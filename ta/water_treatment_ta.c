@@ -29,80 +29,174 @@
 #include <tee_internal_api_extensions.h>
 #include <water_treatment_ta.h>
 
-/* Static water treatment values */
-/* Device physical boundaries (min / max) */
-int temp_dev_min = -40;
-int temp_dev_max = 160;
-int ph_dev_min = 0;
-int ph_dev_max = 14;
-int acid_flow_dev_min = 0;
-int acid_flow_dev_max = 10;
-int sod_hydrox_flow_dev_min = 0;
-int sod_hydrox_flow_dev_max = 10;
-
-/* State variables for chemical solenoid valves */
-int sod_hydrox_flow_is_on = 0;
-int acid_flow_is_on = 0;
-
-//Getters - there are no setters. Values set at compile time.
-int get_temp_dev_min()
-{
-	return temp_dev_min;
+#include "channels.h"
+#include "event_log.h"
+#include "ph_dosing.h"
+#include "ph_window.h"
+#include "pump_rules.h"
+#include "ta_stats.h"
+
+/*
+ * One per tank with an open session, shared by all sessions for that tank
+ * and reached by every command through its struct ta_session.
+ */
+struct tank_state {
+	uint32_t tank_id;
+	uint32_t refs;			/* sessions open on this tank */
+	uint32_t signed_only;		/* of them WT_SESSION_SIGNED_ONLY */
+	int valve_is_on[PUMP_VALVES];	/* indexed by enum pump_valve */
+	/* Bit per WT_ACT_* actuator, the valves' bits say flow > 0 */
+	uint64_t actuators[CHANNEL_WORDS(WT_ACTUATORS_MAX)];
+	struct ph_window ph;		/* recent in-limits pH readings */
+	struct ph_dosing dose;		/* PI loop state for CMD_DOSE */
+	TEE_OperationHandle mac_op;	/* keyed HMAC, set up on first use */
+	struct tank_auth *auth;		/* NULL until the tank authenticates */
+	struct tank_state *next;
 };
 
-int get_temp_dev_max()
-{
-	return temp_dev_max;
+static struct tank_state *tanks;
+static uint32_t tank_count;	/* on the list, at most WT_MAX_TANKS */
+
+/*
+ * Authentication state per tank ID. A tank's state goes with its last
+ * session, this must not: a batch recorded before a close would replay
+ * after the reopen.
+ */
+struct tank_auth {
+	uint32_t tank_id;
+	uint64_t seq;			/* last AUTH_BATCH seq accepted */
 };
 
-int get_ph_dev_min()
-{
-	return ph_dev_min;
+static struct tank_auth tank_auths[WT_MAX_TANKS];
+static uint32_t tank_auth_count;
+
+/* What sess_ctx points at */
+struct ta_session {
+	struct tank_state *tank;
+	uint32_t param_version;		/* WT_PARAMS_* agreed at open */
+	uint32_t flags;			/* WT_SESSION_* asked at open */
 };
 
-int get_ph_dev_max()
+/*
+ * Changes whenever any valve in any tank moves or a tank is created, and
+ * starts from a random value in every instance, so the host can cache
+ * verdicts for as long as it keeps seeing the same epoch.
+ */
+static uint32_t state_epoch;
+
+/* Returns NULL when the tank has none yet and create is not set or no room */
+static struct tank_auth *tank_auth_find(uint32_t tank_id, int create)
 {
-	return ph_dev_max;
-};
+	uint32_t i;
+
+	for (i = 0; i < tank_auth_count; i++)
+		if (tank_auths[i].tank_id == tank_id)
+			return &tank_auths[i];
 
-int get_acid_flow_dev_min()
+	if (!create || tank_auth_count == WT_MAX_TANKS)
+		return NULL;
+	tank_auths[i].tank_id = tank_id;
+	tank_auths[i].seq = 0;
+	tank_auth_count++;
+	return &tank_auths[i];
+}
+
+static struct tank_state *tank_get(uint32_t tank_id)
 {
-	return acid_flow_dev_min;
-};
+	struct tank_state *t;
+
+	for (t = tanks; t; t = t->next) {
+		if (t->tank_id == tank_id) {
+			t->refs++;
+			return t;
+		}
+	}
+
+	if (tank_count >= WT_MAX_TANKS)
+		return NULL;
+	t = TEE_Malloc(sizeof(*t), TEE_MALLOC_FILL_ZERO);
+	if (!t)
+		return NULL;
+	t->tank_id = tank_id;
+	t->refs = 1;
+	t->auth = tank_auth_find(tank_id, 0);
+	t->next = tanks;
+	tanks = t;
+	tank_count++;
+	state_epoch++;
+	return t;
+}
 
-int get_acid_flow_dev_max()
+static void tank_put(struct tank_state *t)
 {
-	return acid_flow_dev_max;
-};
+	struct tank_state **pp;
+
+	if (--t->refs)
+		return;
 
-int get_sod_hydrox_flow_dev_min()
+	for (pp = &tanks; *pp; pp = &(*pp)->next) {
+		if (*pp == t) {
+			*pp = t->next;
+			break;
+		}
+	}
+	tank_count--;
+	if (t->mac_op != TEE_HANDLE_NULL)
+		TEE_FreeOperation(t->mac_op);
+	TEE_Free(t);
+}
+
+static void tank_set_bit(struct tank_state *tank, uint32_t act, int on)
 {
-	return sod_hydrox_flow_dev_min;
-};
+	if (on)
+		tank->actuators[act / 64] |= 1ULL << (act % 64);
+	else
+		tank->actuators[act / 64] &= ~(1ULL << (act % 64));
+}
 
-int get_sod_hydrox_flow_dev_max()
+/* Returns nonzero if the flow changed */
+static int tank_set_flow(struct tank_state *tank, enum pump_valve valve,
+			 uint32_t flow)
 {
-	return sod_hydrox_flow_dev_max;
-};
+	if (tank->valve_is_on[valve] == (int)flow)
+		return 0;
+	tank->valve_is_on[valve] = flow;
+	/* enum pump_valve and WT_ACT_* agree on the valves */
+	tank_set_bit(tank, valve, flow != 0);
+	state_epoch++;
+	return 1;
+}
 
-int get_sod_hydrox_flow()
+static void tank_apply(struct tank_state *tank, const struct pump_rule *rule)
 {
-	return sod_hydrox_flow_is_on;
-};
+	tank_set_flow(tank, rule->valve, rule->state);
+}
 
-int get_acid_flow()
+static int tank_actuator_is_on(struct tank_state *tank, uint32_t act)
 {
-	return acid_flow_is_on;
-};
+	return (tank->actuators[act / 64] >> (act % 64)) & 1;
+}
 
 /*
  * Called when the instance of the TA is created. This is the first call in
  * the TA.
+ *
+ * Nothing is assumed of the file-scope data: an instance that panicked
+ * never reached TA_DestroyEntryPoint() and, where the TA is not loaded
+ * afresh (the stand-in links it into the host), left its state half
+ * updated. Whatever it held is dropped, tanks included.
  */
 TEE_Result TA_CreateEntryPoint(void)
 {
 	DMSG("has been called");
 
+	tanks = NULL;
+	tank_count = 0;
+	tank_auth_count = 0;
+	event_log_init();
+	ta_stats_init();
+	TEE_GenerateRandom(&state_epoch, sizeof(state_epoch));
+
 	return TEE_SUCCESS;
 }
 
@@ -122,28 +216,73 @@ void TA_DestroyEntryPoint(void)
  * TA.
  */
 TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
-		TEE_Param __maybe_unused params[4],
-		void __maybe_unused **sess_ctx)
+		TEE_Param params[4],
+		void **sess_ctx)
 {
-	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
-						   TEE_PARAM_TYPE_NONE,
-						   TEE_PARAM_TYPE_NONE,
-						   TEE_PARAM_TYPE_NONE);
+	uint32_t no_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE,
+						  TEE_PARAM_TYPE_NONE);
+	uint32_t tank_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						    TEE_PARAM_TYPE_NONE,
+						    TEE_PARAM_TYPE_NONE,
+						    TEE_PARAM_TYPE_NONE);
+	uint32_t version_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	uint32_t mode_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_NONE);
+	struct ta_session *sess;
+	uint32_t version = WT_PARAMS_LEGACY;
+	uint32_t flags = 0;
+	uint32_t tank_id;
 
 	DMSG("has been called");
 
-	if (param_types != exp_param_types)
+	if (param_types == no_param_types) {
+		tank_id = 0;
+	} else if (param_types == tank_param_types) {
+		tank_id = params[0].value.a;
+	} else if (param_types == version_param_types ||
+		   param_types == mode_param_types) {
+		if (param_types == mode_param_types)
+			flags = params[2].value.a;
+		if (flags & ~WT_SESSION_FLAGS)
+			return TEE_ERROR_BAD_PARAMETERS;
+		tank_id = params[0].value.a;
+		version = params[1].value.a;
+		if (version > WT_PARAMS_VERSION)
+			version = WT_PARAMS_VERSION;
+		params[1].value.a = version;
+	} else {
 		return TEE_ERROR_BAD_PARAMETERS;
+	}
 
-	/* Unused parameters */
-	(void)&params;
-	(void)&sess_ctx;
+	sess = TEE_Malloc(sizeof(*sess), TEE_MALLOC_FILL_ZERO);
+	if (!sess)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	sess->tank = tank_get(tank_id);
+	if (!sess->tank) {
+		TEE_Free(sess);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	if (flags & WT_SESSION_SIGNED_ONLY)
+		sess->tank->signed_only++;
+	sess->param_version = version;
+	sess->flags = flags;
+	*sess_ctx = sess;
 
 	/*
 	 * The DMSG() macro is non-standard, TEE Internal API doesn't
 	 * specify any means to logging from a TA.
 	 */
-	IMSG("\n\n***** Secure water treatment process started *****\n");
+	IMSG("\n\n***** Secure water treatment process started, tank %u *****\n",
+	     tank_id);
 
 	/* If return value != TEE_SUCCESS the session will not be created. */
 	return TEE_SUCCESS;
@@ -153,212 +292,882 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
  * Called when a session is closed, sess_ctx hold the value that was
  * assigned by TA_OpenSessionEntryPoint().
  */
-void TA_CloseSessionEntryPoint(void __maybe_unused *sess_ctx)
+void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
-	(void)&sess_ctx; /* Unused parameter */
-	IMSG("\n***** Secure water treatment process ended *****\n\n");
+	struct ta_session *sess = sess_ctx;
+
+	IMSG("\n***** Secure water treatment process ended, tank %u *****\n\n",
+	     sess->tank->tank_id);
+	if (sess->flags & WT_SESSION_SIGNED_ONLY)
+		sess->tank->signed_only--;
+	tank_put(sess->tank);
+	TEE_Free(sess);
 }
 
-int verify_safe_bounds(int temp, int ph, int acid_flow, int sh_flow)
+/*
+ * Shared by every pump command: the readings must be within the device
+ * limits and inside the command's rule in pump_rules[] for the valve to
+ * move. In the legacy encoding params[0..3] come back zeroed on success
+ * except for the slot that reports the new valve state, and either way
+ * params[0].value.b carries the state epoch after the command. The
+ * packed encoding answers with an explicit WT_REJECT_* instead.
+ */
+static TEE_Result pump_command(struct ta_session *sess,
+	const struct pump_rule *rule, uint32_t param_types, TEE_Param params[4])
 {
-	if(
-		temp >= temp_dev_min && temp <= temp_dev_max && \
-		ph >= ph_dev_min && ph <= ph_dev_max && \
-		acid_flow >= acid_flow_dev_min && acid_flow <= acid_flow_dev_max && \
-		sh_flow >= sod_hydrox_flow_dev_min && sh_flow <= sod_hydrox_flow_dev_max
-	){
-		return 1;
-	}else{
-		return 0;
+	uint32_t legacy_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_VALUE_INOUT);
+	uint32_t packed_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_VALUE_INOUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	struct tank_state *tank = sess->tank;
+	uint32_t in[PUMP_INPUTS];
+	uint32_t reject = WT_REJECT_NONE;
+	int packed = 0;
+	int k;
+
+	DMSG("has been called");
+
+	if (param_types == legacy_param_types) {
+		for (k = 0; k < PUMP_INPUTS; k++)
+			in[k] = params[k].value.a;
+	} else if (param_types == packed_param_types &&
+		   sess->param_version >= WT_PARAMS_PACKED &&
+		   WT_PACKED_VERSION(params[0].value.a) == WT_PARAMS_PACKED &&
+		   params[1].value.b == tank->tank_id) {
+		in[PUMP_IN_TEMP] = WT_PACKED_TEMP(params[0].value.a);
+		in[PUMP_IN_PH] = WT_PACKED_PH(params[0].value.a);
+		in[PUMP_IN_ACID_FLOW] = WT_PACKED_ACID_FLOW(params[0].value.b);
+		in[PUMP_IN_SOD_HYDROX_FLOW] =
+			WT_PACKED_SOD_HYDROX_FLOW(params[0].value.b);
+		packed = 1;
+	} else {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (wt_log_level >= WT_LOG_VERBOSE) {
+		IMSG("Temperature value:             %u from REE", in[PUMP_IN_TEMP]);
+		IMSG("pH value:                      %u from REE", in[PUMP_IN_PH]);
+		IMSG("Acid flow value:               %u from REE", in[PUMP_IN_ACID_FLOW]);
+		IMSG("Sodium hydroxide flow value:   %u from REE", in[PUMP_IN_SOD_HYDROX_FLOW]);
+	}
+
+	if (!pump_in_bounds(in)) {
+		reject = WT_REJECT_DEVICE_LIMITS;
+	} else if (!(pump_rules_eval(in) & (1u << rule->cmd))) {
+		reject = WT_REJECT_ARGS_OOB;
+	} else {
+		tank_apply(tank, rule);
+		if (!packed) {
+			for (k = 0; k < PUMP_INPUTS; k++)
+				params[k].value.a = 0;
+			params[rule->out_param].value.a =
+				tank->valve_is_on[rule->valve];
+		}
+	}
+
+	event_log_record(tank->tank_id, rule->cmd, in, reject,
+			 tank->valve_is_on[rule->valve]);
+	params[0].value.b = state_epoch;
+	if (packed) {
+		/* params[1].value.a goes back as it came, the sequence number */
+		params[0].value.a = reject;
+		params[1].value.b = tank->valve_is_on[rule->valve];
+	}
+
+	ta_stats_count(rule->cmd, reject == WT_REJECT_NONE,
+		       reject == WT_REJECT_DEVICE_LIMITS,
+		       reject == WT_REJECT_ARGS_OOB);
+
+	if (reject != WT_REJECT_NONE && wt_log_level >= WT_LOG_ALERTS) {
+		IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
+		if (reject == WT_REJECT_DEVICE_LIMITS)
+			IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
+		else
+			IMSG("\n***** TAI Alert - Failed due to function arguments OOB *****\n\n");
+		IMSG("Exit process with no action taken.\n");
+	} else if (reject == WT_REJECT_NONE && wt_log_level >= WT_LOG_VERBOSE) {
+		IMSG("\n%s pump value now: %d\n",
+		     rule->valve == PUMP_VALVE_ACID ? "Acid" : "Sodium hydroxide",
+		     tank->valve_is_on[rule->valve]);
 	}
+
+	return TEE_SUCCESS;
 }
 
-static TEE_Result sod_hydrox_on(uint32_t param_types,
+static TEE_Result control(struct tank_state *tank, uint32_t param_types,
 	TEE_Param params[4])
 {
-	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT);
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT);
+	uint32_t in[PUMP_INPUTS];
+	uint32_t reason;
+	uint32_t mask = 0;
+	size_t r;
 
 	DMSG("has been called");
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	IMSG("Temperature value:             %u from REE", params[0].value.a);
-	IMSG("pH value:                      %u from REE", params[1].value.a);
-	IMSG("Acid flow value:               %u from REE", params[2].value.a);
-	IMSG("Sodium hydroxide flow value:   %u from REE", params[3].value.a);
-
-	if (verify_safe_bounds(params[0].value.a, params[1].value.a, params[2].value.a, params[3].value.a)){
-		if(params[0].value.a > 40 && params[1].value.a < 5 && params[2].value.a == 0 && params[3].value.a == 0){
-			sod_hydrox_flow_is_on = 1;
-			params[0].value.a = 0;	//temp
-			params[1].value.a = 0;	//ph
-			params[2].value.a = 0;	//acid flow
-			params[3].value.a = get_sod_hydrox_flow();
-			IMSG("\nSetting sodium hydroxide pump value to: %d\n", params[3].value.a);
-		}else{
-			IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-			IMSG("\n***** TAI Alert - Failed due to function arguments OOB *****\n\n");
-			IMSG("Exit process with no action taken.\n");
-		}
-		
-	}else{
-		IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-		IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
-		IMSG("Exit process with no action taken.\n");
+	in[PUMP_IN_TEMP] = params[0].value.a;
+	in[PUMP_IN_PH] = params[0].value.b;
+	in[PUMP_IN_ACID_FLOW] = params[1].value.a;
+	in[PUMP_IN_SOD_HYDROX_FLOW] = params[1].value.b;
+
+	if (!pump_in_bounds(in)) {
+		reason = WT_CONTROL_DEVICE_LIMITS;
+	} else {
+		ph_window_add(&tank->ph, in[PUMP_IN_PH] * 1000);
+		/*
+		 * The rules for one valve exclude each other through its flow
+		 * reading, so whatever holds can be applied together.
+		 */
+		mask = pump_rules_eval(in);
+		for (r = 0; r < pump_rule_count; r++)
+			if (mask & (1u << pump_rules[r].cmd))
+				tank_apply(tank, &pump_rules[r]);
+		reason = mask ? WT_CONTROL_ACTED : WT_CONTROL_HOLD;
 	}
+
+	params[2].value.a = tank->valve_is_on[PUMP_VALVE_SOD_HYDROX];
+	params[2].value.b = tank->valve_is_on[PUMP_VALVE_ACID];
+	params[3].value.a = reason;
+	params[3].value.b = mask;
+
+	event_log_record(tank->tank_id, TA_WATER_TREATMENT_CMD_CONTROL, in,
+			 reason == WT_CONTROL_DEVICE_LIMITS ?
+			 WT_REJECT_DEVICE_LIMITS : WT_REJECT_NONE,
+			 params[2].value.a | params[2].value.b << 1);
+	ta_stats_count(TA_WATER_TREATMENT_CMD_CONTROL,
+		       reason != WT_CONTROL_DEVICE_LIMITS,
+		       reason == WT_CONTROL_DEVICE_LIMITS, 0);
+
+	if (reason == WT_CONTROL_DEVICE_LIMITS && wt_log_level >= WT_LOG_ALERTS)
+		IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
+
 	return TEE_SUCCESS;
+}
+
+static TEE_Result dose(struct tank_state *tank, uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	uint32_t milli_ph;
+	uint32_t in[PUMP_INPUTS];
+	uint32_t sod_hydrox = 0, acid = 0;
+	uint32_t reason;
+	int changed;
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	milli_ph = params[0].value.b;
+	in[PUMP_IN_TEMP] = params[0].value.a;
+	in[PUMP_IN_PH] = milli_ph / 1000;
+	in[PUMP_IN_ACID_FLOW] = tank->valve_is_on[PUMP_VALVE_ACID];
+	in[PUMP_IN_SOD_HYDROX_FLOW] = tank->valve_is_on[PUMP_VALVE_SOD_HYDROX];
+
+	if (milli_ph > 14000 || !pump_in_bounds(in)) {
+		reason = WT_CONTROL_DEVICE_LIMITS;
+	} else {
+		ph_window_add(&tank->ph, milli_ph);
+		ph_dosing_step(&tank->dose, milli_ph, &sod_hydrox, &acid);
+		changed = tank_set_flow(tank, PUMP_VALVE_SOD_HYDROX,
+					sod_hydrox);
+		changed |= tank_set_flow(tank, PUMP_VALVE_ACID, acid);
+		reason = changed ? WT_CONTROL_ACTED : WT_CONTROL_HOLD;
+	}
+
+	params[1].value.a = tank->valve_is_on[PUMP_VALVE_SOD_HYDROX];
+	params[1].value.b = tank->valve_is_on[PUMP_VALVE_ACID];
+	params[2].value.a = reason;
+	params[2].value.b = tank->dose.demand;
+
+	/* The event keeps the milli-pH reading and the setpoints */
+	in[PUMP_IN_PH] = milli_ph;
+	in[PUMP_IN_ACID_FLOW] = params[1].value.b;
+	in[PUMP_IN_SOD_HYDROX_FLOW] = params[1].value.a;
+	event_log_record(tank->tank_id, TA_WATER_TREATMENT_CMD_DOSE, in,
+			 reason == WT_CONTROL_DEVICE_LIMITS ?
+			 WT_REJECT_DEVICE_LIMITS : WT_REJECT_NONE,
+			 params[1].value.a | params[1].value.b << 8);
+	ta_stats_count(TA_WATER_TREATMENT_CMD_DOSE,
+		       reason != WT_CONTROL_DEVICE_LIMITS,
+		       reason == WT_CONTROL_DEVICE_LIMITS, 0);
+
+	if (reason == WT_CONTROL_DEVICE_LIMITS && wt_log_level >= WT_LOG_ALERTS)
+		IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
 
+	return TEE_SUCCESS;
 }
 
-static TEE_Result sod_hydrox_off(uint32_t param_types,
+static TEE_Result ph_check(struct tank_state *tank, uint32_t param_types,
 	TEE_Param params[4])
 {
 	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT);
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT);
+	struct ph_summary s;
+	uint32_t ph;
 
 	DMSG("has been called");
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	IMSG("Temperature value:             %u from REE", params[0].value.a);
-	IMSG("pH value:                      %u from REE", params[1].value.a);
-	IMSG("Acid flow value:               %u from REE", params[2].value.a);
-	IMSG("Sodium hydroxide flow value:   %u from REE", params[3].value.a);
-
-	if (verify_safe_bounds(params[0].value.a, params[1].value.a, params[2].value.a, params[3].value.a)){
-		if(params[1].value.a >= 6 && params[3].value.a > 0){
-			sod_hydrox_flow_is_on = 0;
-			params[0].value.a = 0;
-			params[1].value.a = 0;
-			params[2].value.a = 0;
-			params[3].value.a = get_sod_hydrox_flow();
-			IMSG("\nSodium hydroxide pump value now: %d\n", params[1].value.a);
-		}else{
-			IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-			IMSG("\n***** TAI Alert - Failed due to function arguments OOB *****\n\n");
-			IMSG("Exit process with no action taken.\n");
+	ph = params[0].value.a;
+	/* Same device limits as every other reading */
+	if ((params[0].value.b & WT_PH_CHECK_RECORD) && ph > 14)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (params[0].value.b & WT_PH_CHECK_RESET)
+		ph_window_reset(&tank->ph);
+	if (params[0].value.b & WT_PH_CHECK_RECORD)
+		ph_window_add(&tank->ph, ph * 1000);
+
+	ph_window_summary(&tank->ph, &s);
+
+	params[0].value.a = s.flags;
+	params[0].value.b = s.rate;
+	params[1].value.a = s.mean;
+	params[1].value.b = s.variance;
+	params[2].value.a = s.min;
+	params[2].value.b = s.max;
+	params[3].value.a = s.count;
+	params[3].value.b = s.latest;
+
+	if (s.flags && wt_log_level >= WT_LOG_ALERTS)
+		IMSG("\n***** TAI Alert - Backward Edge Failure, pH flags 0x%x *****\n",
+		     s.flags);
+
+	return TEE_SUCCESS;
+}
+
+static void sample_inputs(const struct wt_sample *s, uint32_t in[PUMP_INPUTS])
+{
+	in[PUMP_IN_TEMP] = s->temp;
+	in[PUMP_IN_PH] = s->ph;
+	in[PUMP_IN_ACID_FLOW] = s->acid_flow;
+	in[PUMP_IN_SOD_HYDROX_FLOW] = s->sod_hydrox_flow;
+}
+
+/* Runs the bounds check and every pump rule against one sample */
+static uint32_t evaluate_sample(const struct wt_sample *s,
+				struct wt_decision *d)
+{
+	uint32_t in[PUMP_INPUTS];
+
+	sample_inputs(s, in);
+	d->timestamp = s->timestamp;
+	d->verdict = pump_in_bounds(in) ? WT_VERDICT_OK :
+					  WT_VERDICT_DEVICE_LIMITS;
+	d->actions = d->verdict == WT_VERDICT_OK ? pump_rules_eval(in) : 0;
+
+	return d->verdict;
+}
+
+/* Samples evaluated per pump_rules_eval_many() call, sized for the TA stack */
+#define BATCH_CHUNK	16
+
+/*
+ * Evaluates n samples at in into n decisions at out and returns how many
+ * were past the device limits. With act set the rules that hold for each
+ * sample are applied to the tank in turn, as CONTROL would.
+ */
+static uint32_t evaluate_records(struct tank_state *tank, const uint8_t *in,
+				 uint8_t *out, uint32_t n, int act)
+{
+	struct wt_sample s;
+	struct wt_decision d;
+	uint32_t inputs[BATCH_CHUNK][PUMP_INPUTS];
+	uint32_t bounds[BATCH_CHUNK];
+	uint32_t masks[BATCH_CHUNK];
+	uint64_t stamps[BATCH_CHUNK];
+	uint32_t rejected = 0;
+	uint32_t i;
+	uint32_t j;
+	uint32_t chunk;
+	size_t r;
+
+	for (i = 0; i < n; i += chunk) {
+		chunk = n - i < BATCH_CHUNK ? n - i : BATCH_CHUNK;
+
+		/* Read each record once, the REE can rewrite shared memory */
+		for (j = 0; j < chunk; j++) {
+			TEE_MemMove(&s, in + (i + j) * sizeof(s), sizeof(s));
+			sample_inputs(&s, inputs[j]);
+			stamps[j] = s.timestamp;
 		}
-		
-	}else{
-		IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-		IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
-		IMSG("Exit process with no action taken.\n");
+
+		pump_rules_eval_many(inputs, chunk, bounds, masks);
+
+		for (j = 0; j < chunk; j++) {
+			d.timestamp = stamps[j];
+			d.verdict = bounds[j] ? WT_VERDICT_OK :
+						WT_VERDICT_DEVICE_LIMITS;
+			d.actions = masks[j];
+			rejected += !bounds[j];
+			if (bounds[j])
+				ph_window_add(&tank->ph,
+					      inputs[j][PUMP_IN_PH] * 1000);
+			for (r = 0; act && r < pump_rule_count; r++)
+				if (masks[j] & (1u << pump_rules[r].cmd))
+					tank_apply(tank, &pump_rules[r]);
+			TEE_MemMove(out + (i + j) * sizeof(d), &d, sizeof(d));
+		}
+	}
+
+	return rejected;
+}
+
+static TEE_Result evaluate_batch(struct tank_state *tank, uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	uint32_t rejected;
+	uint32_t n;
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[0].memref.size % sizeof(struct wt_sample))
+		return TEE_ERROR_BAD_PARAMETERS;
+	n = params[0].memref.size / sizeof(struct wt_sample);
+
+	if (params[1].memref.size < n * sizeof(struct wt_decision)) {
+		params[1].memref.size = n * sizeof(struct wt_decision);
+		return TEE_ERROR_SHORT_BUFFER;
 	}
 
+	rejected = evaluate_records(tank, params[0].memref.buffer,
+				    params[1].memref.buffer, n, 0);
+
+	ta_stats_count(TA_WATER_TREATMENT_CMD_EVALUATE_BATCH, n - rejected,
+		       rejected, 0);
+
+	params[1].memref.size = n * sizeof(struct wt_decision);
+	params[2].value.a = n;
+	params[2].value.b = rejected;
+
 	return TEE_SUCCESS;
 }
 
-static TEE_Result acid_on(uint32_t param_types,
+/* Readings of the ACTUATE call in progress, the TA runs one at a time */
+static struct channel_readings act_readings;
+
+static TEE_Result actuate(struct tank_state *tank, uint32_t param_types,
 	TEE_Param params[4])
 {
-	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT);
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_MEMREF_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT);
+	const struct channel_map *m = &plant_channels;
+	struct wt_reading readings[WT_ACT_READINGS_MAX];
+	uint32_t act;
+	uint32_t on;
+	uint32_t n;
+	uint32_t in[4];
+	uint64_t word;
+	int reject;
 
 	DMSG("has been called");
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	IMSG("Temperature value:             %u from REE", params[0].value.a);
-	IMSG("pH value:                      %u from REE", params[1].value.a);
-	IMSG("Acid flow value:               %u from REE", params[2].value.a);
-	IMSG("Sodium hydroxide flow value:   %u from REE", params[3].value.a);
-
-	if (verify_safe_bounds(params[0].value.a, params[1].value.a, params[2].value.a, params[3].value.a)){
-		if(params[0].value.a < 90 && params[1].value.a > 9 && params[2].value.a == 0 && params[3].value.a == 0){
-			acid_flow_is_on = 1;
-			params[0].value.a = 0;
-			params[1].value.a = 0;
-			params[2].value.a = get_acid_flow();
-			params[3].value.a = 0;
-			IMSG("\nAcid pump value now: %d\n", params[2].value.a);
-		}else{
-			IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-			IMSG("\n***** TAI Alert - Failed due to function arguments OOB *****\n\n");
-			IMSG("Exit process with no action taken.\n");
+	act = params[0].value.a;
+	on = !!params[0].value.b;
+	if (act >= m->actuator_count)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* Bounded, so the cost does not grow with the plant's channels */
+	if (params[1].memref.size % sizeof(struct wt_reading) ||
+	    params[1].memref.size > sizeof(readings))
+		return TEE_ERROR_BAD_PARAMETERS;
+	n = params[1].memref.size / sizeof(struct wt_reading);
+	TEE_MemMove(readings, params[1].memref.buffer, params[1].memref.size);
+
+	reject = channel_load(m, &act_readings, readings, n);
+	if (reject < 0)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (reject == WT_REJECT_NONE)
+		reject = channel_check(m, &act_readings, act, on);
+
+	if (reject == WT_REJECT_NONE) {
+		if (act < PUMP_VALVES) {
+			tank_set_flow(tank, act, on);
+		} else if (tank_actuator_is_on(tank, act) != (int)on) {
+			tank_set_bit(tank, act, on);
+			state_epoch++;
 		}
-		
-	}else{
-		IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-		IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
-		IMSG("Exit process with no action taken.\n");
+		if (act_readings.present[0] & (1ULL << WT_SENSOR_PH))
+			ph_window_add(&tank->ph,
+				      act_readings.value[WT_SENSOR_PH] * 1000);
 	}
 
+	word = tank->actuators[act / 64];
+	params[2].value.a = reject;
+	params[2].value.b = state_epoch;
+	params[3].value.a = (uint32_t)word;
+	params[3].value.b = (uint32_t)(word >> 32);
+
+	in[0] = act;
+	in[1] = on;
+	in[2] = n;
+	in[3] = 0;
+	event_log_record(tank->tank_id, TA_WATER_TREATMENT_CMD_ACTUATE, in,
+			 reject, tank_actuator_is_on(tank, act));
+	ta_stats_count(TA_WATER_TREATMENT_CMD_ACTUATE,
+		       reject == WT_REJECT_NONE,
+		       reject == WT_REJECT_DEVICE_LIMITS,
+		       reject == WT_REJECT_ARGS_OOB ||
+		       reject == WT_REJECT_MISSING);
+
+	if (reject != WT_REJECT_NONE && wt_log_level >= WT_LOG_ALERTS)
+		IMSG("\n***** TAI Alert - Actuator %u not switched %s, reject %d *****\n\n",
+		     act, on ? "on" : "off", reject);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result describe(uint32_t param_types, TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	const struct channel_map *m = &plant_channels;
+	const struct channel_actuator *a;
+	struct wt_sensor_info si;
+	struct wt_actuator_info ai;
+	uint8_t *out;
+	uint32_t i;
+	uint32_t k;
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	params[2].value.a = m->sensor_count;
+	params[2].value.b = m->actuator_count;
+	if (params[0].memref.size < m->sensor_count * sizeof(si) ||
+	    params[1].memref.size < m->actuator_count * sizeof(ai)) {
+		params[0].memref.size = m->sensor_count * sizeof(si);
+		params[1].memref.size = m->actuator_count * sizeof(ai);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	out = params[0].memref.buffer;
+	for (i = 0; i < m->sensor_count; i++) {
+		si.min = m->limits[i].lo;
+		si.max = m->limits[i].lo + m->limits[i].span;
+		TEE_MemMove(out + i * sizeof(si), &si, sizeof(si));
+	}
+	params[0].memref.size = m->sensor_count * sizeof(si);
+
+	out = params[1].memref.buffer;
+	for (i = 0; i < m->actuator_count; i++) {
+		a = &m->actuators[i];
+		TEE_MemFill(&ai, 0, sizeof(ai));
+		ai.on_terms = a->on_terms;
+		ai.off_terms = a->off_terms;
+		for (k = 0; k < a->on_terms; k++)
+			ai.on_sensors[k] = a->on[k].sensor;
+		for (k = 0; k < a->off_terms; k++)
+			ai.off_sensors[k] = a->off[k].sensor;
+		TEE_MemMove(out + i * sizeof(ai), &ai, sizeof(ai));
+	}
+	params[1].memref.size = m->actuator_count * sizeof(ai);
+
 	return TEE_SUCCESS;
 }
 
-static TEE_Result acid_off(uint32_t param_types,
+/*
+ * Private copy of the batch being authenticated, the REE could rewrite
+ * shared memory between the MAC check and the evaluation otherwise.
+ */
+static struct wt_sample auth_samples[WT_AUTH_MAX_SAMPLES];
+
+/* Keys the tank's HMAC operation once, every batch after reuses it */
+static TEE_Result auth_setup(struct tank_state *tank)
+{
+	TEE_ObjectHandle key;
+	TEE_Attribute attr;
+	TEE_Result res;
+
+	if (!tank->auth)
+		tank->auth = tank_auth_find(tank->tank_id, 1);
+	if (!tank->auth)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = TEE_AllocateOperation(&tank->mac_op, TEE_ALG_HMAC_SHA256,
+				    TEE_MODE_MAC, WT_AUTH_DEMO_KEY_SIZE * 8);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA256,
+					  WT_AUTH_DEMO_KEY_SIZE * 8, &key);
+	if (res != TEE_SUCCESS)
+		goto err;
+
+	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, WT_AUTH_DEMO_KEY,
+			     WT_AUTH_DEMO_KEY_SIZE);
+	res = TEE_PopulateTransientObject(key, &attr, 1);
+	if (res == TEE_SUCCESS)
+		res = TEE_SetOperationKey(tank->mac_op, key);
+	TEE_FreeTransientObject(key);
+	if (res == TEE_SUCCESS)
+		return TEE_SUCCESS;
+err:
+	TEE_FreeOperation(tank->mac_op);
+	tank->mac_op = TEE_HANDLE_NULL;
+	return res;
+}
+
+static TEE_Result auth_batch(struct tank_state *tank, uint32_t param_types,
 	TEE_Param params[4])
 {
-	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT,
-						   TEE_PARAM_TYPE_VALUE_INOUT);
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+						   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	struct wt_auth_batch hdr;
+	size_t bytes;
+	uint32_t rejected;
+	uint32_t n;
+	TEE_Result res;
 
 	DMSG("has been called");
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	IMSG("Temperature value:             %u from REE", params[0].value.a);
-	IMSG("pH value:                      %u from REE", params[1].value.a);
-	IMSG("Acid flow value:               %u from REE", params[2].value.a);
-	IMSG("Sodium hydroxide flow value:   %u from REE", params[3].value.a);
-
-	if (verify_safe_bounds(params[0].value.a, params[1].value.a, params[2].value.a, params[3].value.a)){
-		if(params[1].value.a <= 8 && params[2].value.a > 0){
-			acid_flow_is_on = 0;
-			params[0].value.a = 0;
-			params[1].value.a = 0;
-			params[2].value.a = get_acid_flow();
-			params[3].value.a = 0;
-			IMSG("\nAcid pump value now: %d\n", params[2].value.a);
-		}else{
-			IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-			IMSG("\n***** TAI Alert - Failed due to function arguments OOB *****\n\n");
-			IMSG("Exit process with no action taken.\n");
-		}
-		
-	}else{
-		IMSG("\n***** TAI Alert - Forward Edge Failure *****\n");
-		IMSG("\n***** TAI Alert - Failed due to device limits exceeded *****\n\n");
-		IMSG("Exit process with no action taken.\n");
+	if (params[0].memref.size < sizeof(hdr))
+		return TEE_ERROR_BAD_PARAMETERS;
+	TEE_MemMove(&hdr, params[0].memref.buffer, sizeof(hdr));
+	n = hdr.count;
+	if (n > WT_AUTH_MAX_SAMPLES)
+		return TEE_ERROR_EXCESS_DATA;
+	bytes = n * sizeof(struct wt_sample);
+	if (params[0].memref.size != sizeof(hdr) + bytes)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[1].memref.size < n * sizeof(struct wt_decision)) {
+		params[1].memref.size = n * sizeof(struct wt_decision);
+		return TEE_ERROR_SHORT_BUFFER;
 	}
 
+	if (tank->mac_op == TEE_HANDLE_NULL) {
+		res = auth_setup(tank);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	TEE_MemMove(auth_samples,
+		    (uint8_t *)params[0].memref.buffer + sizeof(hdr), bytes);
+
+	TEE_MACInit(tank->mac_op, NULL, 0);
+	TEE_MACUpdate(tank->mac_op, &hdr,
+		      offsetof(struct wt_auth_batch, mac));
+	res = TEE_MACCompareFinal(tank->mac_op, auth_samples, bytes, hdr.mac,
+				  sizeof(hdr.mac));
+
+	/* A valid MAC for another tank or an old batch is a replay */
+	if (res != TEE_SUCCESS || hdr.tank != tank->tank_id ||
+	    hdr.seq <= tank->auth->seq) {
+		if (wt_log_level >= WT_LOG_ALERTS)
+			IMSG("\n***** TAI Alert - Sensor batch for tank %u failed authentication *****\n\n",
+			     hdr.tank);
+		return TEE_ERROR_SECURITY;
+	}
+	tank->auth->seq = hdr.seq;
+
+	/* On a signed only tank nothing else can move the valves */
+	rejected = evaluate_records(tank, (const uint8_t *)auth_samples,
+				    params[1].memref.buffer, n,
+				    tank->signed_only != 0);
+
+	ta_stats_count(TA_WATER_TREATMENT_CMD_AUTH_BATCH, n - rejected,
+		       rejected, 0);
+
+	params[1].memref.size = n * sizeof(struct wt_decision);
+	params[2].value.a = n;
+	params[2].value.b = rejected;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result drain(struct tank_state *tank, uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+	volatile struct wt_ring *ring;
+	uint8_t *samples;
+	uint8_t *decisions;
+	struct wt_sample s;
+	struct wt_decision d;
+	uint32_t rejected = 0;
+	uint32_t head;
+	uint32_t tail;
+	uint32_t size;
+	uint32_t slot;
+	uint32_t n;
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[0].memref.size < sizeof(struct wt_ring))
+		return TEE_ERROR_BAD_PARAMETERS;
+	ring = params[0].memref.buffer;
+
+	/* Snapshot the header, the REE keeps producing while we drain */
+	size = ring->size;
+	head = ring->head;
+	tail = ring->tail;
+
+	if (!size || (size & (size - 1)) ||
+	    size > (params[0].memref.size - sizeof(struct wt_ring)) /
+		   (sizeof(struct wt_sample) + sizeof(struct wt_decision)))
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (head - tail > size)
+		return TEE_ERROR_BAD_STATE;
+
+	samples = (uint8_t *)params[0].memref.buffer + sizeof(struct wt_ring);
+	decisions = samples + size * sizeof(struct wt_sample);
+
+	for (n = 0; tail != head; tail++, n++) {
+		slot = tail & (size - 1);
+		TEE_MemMove(&s, samples + slot * sizeof(s), sizeof(s));
+		if (evaluate_sample(&s, &d) != WT_VERDICT_OK)
+			rejected++;
+		else
+			ph_window_add(&tank->ph, s.ph * 1000);
+		TEE_MemMove(decisions + slot * sizeof(d), &d, sizeof(d));
+	}
+	ring->tail = tail;
+
+	ta_stats_count(TA_WATER_TREATMENT_CMD_DRAIN, n - rejected, rejected, 0);
+
+	params[1].value.a = n;
+	params[1].value.b = rejected;
+
 	return TEE_SUCCESS;
 }
 
+static TEE_Result read_events(uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+	uint32_t lost;
+	uint32_t n;
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	n = event_log_read(params[0].memref.buffer,
+			   params[0].memref.size / sizeof(struct wt_event),
+			   &lost);
+
+	params[0].memref.size = n * sizeof(struct wt_event);
+	params[1].value.a = n;
+	params[1].value.b = lost;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result set_log_level(uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (params[0].value.a > WT_LOG_VERBOSE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	params[1].value.a = wt_log_level;
+	wt_log_level = params[0].value.a;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_stats(uint32_t param_types,
+	TEE_Param params[4])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (params[0].memref.size < sizeof(struct wt_stats)) {
+		params[0].memref.size = sizeof(struct wt_stats);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	/* Only written, never read back, so straight into shared memory */
+	ta_stats_read(params[0].memref.buffer);
+	params[0].memref.size = sizeof(struct wt_stats);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ping(uint32_t param_types)
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+
+	DMSG("has been called");
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	return TEE_SUCCESS;
+}
+
+/* What a session of a signed only tank may still do unsigned */
+static int signed_only_allows(uint32_t cmd_id, uint32_t param_types,
+	TEE_Param params[4])
+{
+	switch (cmd_id) {
+	case TA_WATER_TREATMENT_CMD_PING:
+	case TA_WATER_TREATMENT_CMD_READ_EVENTS:
+	case TA_WATER_TREATMENT_CMD_SET_LOG_LEVEL:
+	case TA_WATER_TREATMENT_CMD_GET_STATS:
+	case TA_WATER_TREATMENT_CMD_AUTH_BATCH:
+	case TA_WATER_TREATMENT_CMD_DESCRIBE:
+		return 1;
+	case TA_WATER_TREATMENT_CMD_PH_CHECK:
+		/* Judging the window is fine, feeding or clearing it is not */
+		return TEE_PARAM_TYPE_GET(param_types, 0) ==
+		       TEE_PARAM_TYPE_VALUE_INOUT && !params[0].value.b;
+	default:
+		return 0;
+	}
+}
+
+static TEE_Result dispatch(void *sess_ctx, uint32_t cmd_id,
+	uint32_t param_types, TEE_Param params[4])
+{
+	struct ta_session *sess = sess_ctx;
+	struct tank_state *tank = sess->tank;
+	const struct pump_rule *rule;
+
+	if (tank->signed_only &&
+	    !signed_only_allows(cmd_id, param_types, params)) {
+		if (wt_log_level >= WT_LOG_ALERTS)
+			IMSG("\n***** TAI Alert - Unsigned command %u refused, tank %u is signed only *****\n\n",
+			     cmd_id, tank->tank_id);
+		return TEE_ERROR_ACCESS_DENIED;
+	}
+
+	rule = pump_rule_find(cmd_id);
+	if (rule)
+		return pump_command(sess, rule, param_types, params);
+
+	switch (cmd_id) {
+
+	case TA_WATER_TREATMENT_CMD_PING:
+		return ping(param_types);
+	case TA_WATER_TREATMENT_CMD_EVALUATE_BATCH:
+		return evaluate_batch(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_DRAIN:
+		return drain(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_READ_EVENTS:
+		return read_events(param_types, params);
+	case TA_WATER_TREATMENT_CMD_SET_LOG_LEVEL:
+		return set_log_level(param_types, params);
+	case TA_WATER_TREATMENT_CMD_GET_STATS:
+		return get_stats(param_types, params);
+	case TA_WATER_TREATMENT_CMD_CONTROL:
+		return control(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_PH_CHECK:
+		return ph_check(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_DOSE:
+		return dose(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_AUTH_BATCH:
+		return auth_batch(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_ACTUATE:
+		return actuate(tank, param_types, params);
+	case TA_WATER_TREATMENT_CMD_DESCRIBE:
+		return describe(param_types, params);
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+}
+
 /*
  * Called when a TA is invoked. sess_ctx hold that value that was
  * assigned by TA_OpenSessionEntryPoint(). The rest of the paramters
  * comes from normal world.
  */
-TEE_Result TA_InvokeCommandEntryPoint(void __maybe_unused *sess_ctx,
+TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx,
 			uint32_t cmd_id,
 			uint32_t param_types, TEE_Param params[4])
 {
-	(void)&sess_ctx; /* Unused parameter */
+	uint64_t start = ta_stats_now_ms();
+	uint64_t end;
+	TEE_Result res;
+	int trace = 0;
 
-	switch (cmd_id) {
+	/* The handlers never see the trace slot */
+	if (TEE_PARAM_TYPE_GET(param_types, WT_TRACE_PARAM) ==
+	    TEE_PARAM_TYPE_VALUE_OUTPUT &&
+	    cmd_id != TA_WATER_TREATMENT_CMD_CONTROL &&
+	    cmd_id != TA_WATER_TREATMENT_CMD_PH_CHECK &&
+	    cmd_id != TA_WATER_TREATMENT_CMD_ACTUATE) {
+		param_types &= ~(0xfu << (WT_TRACE_PARAM * 4));
+		trace = 1;
+	}
 
-	case TA_WATER_TREATMENT_CMD_SOD_HYDROX_ON:
-		return sod_hydrox_on(param_types, params);
-	case TA_WATER_TREATMENT_CMD_SOD_HYDROX_OFF:
-		return sod_hydrox_off(param_types, params);		
-	case TA_WATER_TREATMENT_CMD_ACID_ON:
-		return acid_on(param_types, params);
-	case TA_WATER_TREATMENT_CMD_ACID_OFF:
-		return acid_off(param_types, params);
-	default:
-		return TEE_ERROR_BAD_PARAMETERS;
+	res = dispatch(sess_ctx, cmd_id, param_types, params);
+	end = ta_stats_now_ms();
+	ta_stats_invoke(cmd_id, res, end - start);
+
+	if (trace) {
+		params[WT_TRACE_PARAM].value.a = (uint32_t)start;
+		params[WT_TRACE_PARAM].value.b = (uint32_t)end;
 	}
+	return res;
 }